@@ -0,0 +1,34 @@
+#ifndef __MEMEX_DEBUG_H__
+#define __MEMEX_DEBUG_H__
+
+/*
+ *  Debug builds check that objects created with MEMEX_NOLOCK are never used
+ *  by two threads at once: the lock/unlock points claim the object for the
+ *  calling thread instead of taking a mutex.
+ */
+#ifdef MEMEX_DEBUG
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+struct memex_owner_t {
+    _Atomic uintptr_t thread;
+    uint32_t depth;
+};
+
+#define memex_owner_enter(o, obj) {\
+    uintptr_t _memex_owner_self = (uintptr_t)pthread_self(); \
+    uintptr_t _memex_owner_cur = 0; \
+    if (!atomic_compare_exchange_strong(&(o)->thread, &_memex_owner_cur, _memex_owner_self) && \
+        _memex_owner_cur != _memex_owner_self) { \
+        error("%p: MEMEX_NOLOCK object used by two threads at once", obj); \
+    } \
+    (o)->depth++;}
+
+#define memex_owner_exit(o) {\
+    if (--(o)->depth == 0) { \
+        atomic_store(&(o)->thread, 0); \
+    }}
+#endif
+
+#endif
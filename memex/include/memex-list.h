@@ -0,0 +1,175 @@
+#ifndef __MEMEX_LIST_H__
+#define __MEMEX_LIST_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "memex.h"
+#include "memex-debug.h"
+
+enum memex_type_e {
+    MEMEX_TYPE_LIST=0,
+    MEMEX_TYPE_FIFO,
+    MEMEX_TYPE_STACK,
+    MEMEX_TYPE_SPSC,
+    MEMEX_TYPE_QUEUE,
+    MEMEX_TYPE_SEGMENTED,
+    MEMEX_TYPE_PQUEUE,
+    MEMEX_TYPE_DEQUE,
+    MEMEX_TYPE_RESERVED,
+};
+
+struct memex_list_t {
+    // Number of new entries to allocate at a time
+    uint32_t step;
+
+    // Geometric growth factor (fixed step growth when <= 1.0)
+    double growth;
+
+    // Number of total entries
+    uint32_t size;
+
+    // Number of filled entries
+    uint32_t n_entry;
+
+    // Entry size in bytes
+    uint32_t entry_size;
+
+    // Data buffer
+    void *entries;
+
+    // FIFO ring: index of the oldest entry
+    uint32_t head;
+
+    // Sort
+    enum memex_sort_type_e sort_type;
+    int sort_off;
+
+    // Sorted mode: entries are kept in key order (sorted.c)
+    int sorted;
+
+    pthread_mutex_t lock;
+#ifdef MEMEX_DEBUG
+    struct memex_owner_t owner;
+#endif
+
+    int state;
+    int type;
+    int flags;
+    POOL *pool;
+
+    // Type-specific state for lists that do not use the entry buffer
+    void *impl;
+
+    // Buffer generation shared with snapshot readers (snapshot.c)
+    struct memex_snapshot_t *snap;
+
+    // Hash index over a key member (index.c)
+    struct memex_index_t *index;
+
+    // FIFO overflow journal (journal.c)
+    struct memex_journal_t *journal;
+
+    // Open append reservation: slots being filled outside the lock
+    uint32_t reserved;
+    uint32_t reserve_slot;
+};
+
+// The list lock; MEMEX_NOLOCK lists skip the mutex
+#ifdef MEMEX_DEBUG
+#define memex_list_lock(m) {\
+    if ((m)->flags & MEMEX_NOLOCK) { \
+        memex_owner_enter(&(m)->owner, (m)); \
+    } else { \
+        pthread_mutex_lock(&(m)->lock); \
+    }}
+
+#define memex_list_unlock(m) {\
+    if ((m)->flags & MEMEX_NOLOCK) { \
+        memex_owner_exit(&(m)->owner); \
+    } else { \
+        pthread_mutex_unlock(&(m)->lock); \
+    }}
+#else
+#define memex_list_lock(m) {\
+    if (!((m)->flags & MEMEX_NOLOCK)) { \
+        pthread_mutex_lock(&(m)->lock); \
+    }}
+
+#define memex_list_unlock(m) {\
+    if (!((m)->flags & MEMEX_NOLOCK)) { \
+        pthread_mutex_unlock(&(m)->lock); \
+    }}
+#endif
+
+#define MEMEX_SORTED_OFF   0
+#define MEMEX_SORTED_CLEAN 1
+#define MEMEX_SORTED_DIRTY 2
+
+// List internals (list.c)
+void memex_list_linearize(struct memex_list_t *m);
+int memex_list_grow(struct memex_list_t *m, uint32_t min_size);
+
+// Single-producer/single-consumer ring (spsc.c)
+int memex_spsc_push(struct memex_list_t *m, void *entry);
+int memex_spsc_pop(struct memex_list_t *m, void *entry, uint32_t *n_entries);
+uint32_t memex_spsc_count(struct memex_list_t *m);
+
+// Work-stealing deque (deque.c)
+int memex_deque_push(struct memex_list_t *m, void *entry);
+int memex_deque_pop(struct memex_list_t *m, void *entry, uint32_t *n_entries);
+uint32_t memex_deque_count(struct memex_list_t *m);
+void memex_deque_release(struct memex_list_t *m);
+
+// Blocking bounded queue (queue.c)
+void memex_queue_clear(struct memex_list_t *m);
+void memex_queue_hold(struct memex_list_t *m, int held);
+void memex_queue_release(struct memex_list_t *m);
+
+// Segmented list (seglist.c)
+void *memex_seglist_new_entry(struct memex_list_t *m, int zero);
+void *memex_seglist_get_entry(struct memex_list_t *m, uint32_t index);
+uint32_t memex_seglist_count(struct memex_list_t *m);
+void memex_seglist_clear(struct memex_list_t *m);
+
+// Reserved-range list (vmlist.c)
+void *memex_vmlist_new_entry(struct memex_list_t *m, int zero);
+void *memex_vmlist_list_get_entry(struct memex_list_t *m, uint32_t index);
+uint32_t memex_vmlist_list_count(struct memex_list_t *m);
+void memex_vmlist_clear(struct memex_list_t *m);
+
+// Typed sort keys (sort.c)
+int memex_sort_key(const void *entry, int off, int type, int64_t *val);
+int memex_sort_cmp(int64_t a, int64_t b, int type);
+
+// Binary heap priority queue (pqueue.c)
+void memex_pqueue_clear(struct memex_list_t *m);
+
+// Key index (index.c); callers check m->index first
+uint32_t memex_index_find(struct memex_list_t *m, void *key);
+void memex_index_drop(struct memex_list_t *m, uint32_t i, uint32_t n);
+void memex_index_stale(struct memex_list_t *m);
+void memex_index_fresh(struct memex_list_t *m, uint32_t i);
+void memex_index_swap_remove(struct memex_list_t *m, uint32_t i);
+void memex_index_destroy(struct memex_list_t *m);
+
+// FIFO overflow journal (journal.c); callers check m->journal first
+uint32_t memex_journal_split(struct memex_list_t *m, uint32_t n);
+int memex_journal_append(struct memex_list_t *m, const void *entries, uint32_t n);
+int memex_journal_refill(struct memex_list_t *m);
+void memex_journal_skip(struct memex_list_t *m, uint32_t n);
+uint64_t memex_journal_count(struct memex_list_t *m);
+void memex_journal_clear(struct memex_list_t *m);
+void memex_journal_destroy(struct memex_list_t *m);
+
+// Snapshots (snapshot.c)
+int memex_snapshot_detach(struct memex_list_t *m, int keep);
+
+// Give the list a private buffer before anything writes to it
+static inline int
+memex_list_modify(struct memex_list_t *m)
+{
+    return m->snap ? memex_snapshot_detach(m, 1) : 0;
+}
+
+#endif
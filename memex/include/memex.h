@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/types.h>
 
 // Memory Pools
 typedef void POOL;
@@ -13,13 +14,26 @@ typedef void POOL;
 POOL *create_pool();
 POOL *create_pool_unmanaged();
 POOL *create_subpool(POOL *pool);
+POOL *create_pool_flags(int flags);
+POOL *create_subpool_flags(POOL *pool, int flags);
 POOL *copy_pool(POOL *pool);
 void *palloc(POOL *pool, size_t bytes);
 void *pcalloc(POOL *pool, size_t bytes);
 void *repalloc(void *addr, size_t bytes, POOL *pool);
 void free_pool(POOL *pool);
+void pool_reset(POOL *pool);
 void pool_cleanup();
 void pfree(POOL *pool, void *addr);
+int pool_move(POOL *src, POOL *dst, void *addr);
+void *pmmap(POOL *pool, int fd, off_t offset, size_t bytes);
+void *pvreserve(POOL *pool, size_t bytes);
+
+// Epoch-based reclamation
+void memex_epoch_enter();
+void memex_epoch_exit();
+void pfree_deferred(POOL *pool, void *addr);
+uint32_t memex_epoch_reclaim();
+void memex_epoch_synchronize();
 
 // Auto Cleanup
 typedef void (*memex_cleanup_fn)(void);
@@ -32,32 +46,167 @@ void memex_cleanup_push_args(memex_cleanup_args_fn fn, void *args);
 
 // Lists
 typedef void MLIST;
+typedef int (*memex_list_pred_fn)(const void *entry, void *ctx);
+typedef void (*memex_list_for_fn)(void *entry, void *ctx);
+typedef void (*memex_list_reduce_fn)(void *acc, const void *entry, void *ctx);
+
+// List creation flags
+#define MEMEX_NOSUBPOOL 0x0001  // Allocate from the caller's pool, not a sub-pool
+#define MEMEX_EVENTFD   0x0002  // Queue exposes an eventfd readable while non-empty
+#define MEMEX_NOLOCK    0x0004  // Used by one thread at a time: no locking (pools too)
 
 MLIST *memex_list_create(POOL *pool, const size_t entry_size);
 MLIST *memex_fifo_create(POOL *pool, const size_t entry_size);
 MLIST *memex_stack_create(POOL *pool, const size_t entry_size);
+MLIST *memex_list_create_flags(POOL *pool, const size_t entry_size, int flags);
+MLIST *memex_fifo_create_flags(POOL *pool, const size_t entry_size, int flags);
+int memex_fifo_set_journal(MLIST *list, const char *path, uint32_t hot);
+MLIST *memex_stack_create_flags(POOL *pool, const size_t entry_size, int flags);
 MLIST *memex_list_copy(POOL *pool, MLIST *list);
+MLIST *memex_list_copy_shared(POOL *pool, MLIST *list);
+int memex_list_save(MLIST *list, const char *path);
+MLIST *memex_list_map(POOL *pool, const char *path);
 void memex_list_clear(MLIST *list);
 void memex_list_remove_index(MLIST *list, uint32_t index);
 void memex_list_remove_after_index(MLIST *list, uint32_t index);
 void memex_list_remove_before_index(MLIST *list, uint32_t index);
+uint32_t memex_list_remove_if(MLIST *list, memex_list_pred_fn pred, void *ctx);
+void memex_list_swap_remove(MLIST *list, uint32_t index);
 void *memex_list_new_entry(MLIST *list);
+void *memex_list_new_entry_uninit(MLIST *list);
+int memex_list_append_reserve(MLIST *list, uint32_t n, void **first);
+int memex_list_append_commit(MLIST *list, uint32_t n);
 void *memex_list_get_entries(MLIST *list, uint32_t *n_entries);
 void *memex_list_get_entries_copy(MLIST *list, uint32_t *n_entries);
+void *memex_list_get_segments(MLIST *list, uint32_t *n_first, void **second, uint32_t *n_second);
+void *memex_list_get_entry(MLIST *list, uint32_t index);
+uint32_t memex_list_count(MLIST *list);
 void memex_list_set_step_size(MLIST *list, size_t size);
+void memex_list_set_growth_factor(MLIST *list, double factor);
+int memex_list_reserve(MLIST *list, uint32_t n);
+void memex_list_shrink_to_fit(MLIST *list);
 void memex_list_destroy(MLIST *list);
 POOL *memex_list_get_pool(MLIST *list);
 void memex_list_acquire(MLIST *list);
 void memex_list_release(MLIST *list);
 int memex_list_push(MLIST *list, void *entry);
 int memex_list_pop(MLIST *list, void *entry, uint32_t *n_entries);
+int memex_list_push_n(MLIST *list, void *entries, uint32_t n);
+int memex_list_pop_n(MLIST *list, void *entries, uint32_t max, uint32_t *n_entries);
+void *memex_list_peek_front(MLIST *list, uint32_t *n_contig);
+void *memex_list_peek_back(MLIST *list, uint32_t *n_contig);
+void memex_list_consume(MLIST *list, uint32_t n);
+
+// Parallel passes over the entries; n_threads 0 means one per CPU
+//   The list is locked once for the whole pass
+int memex_list_parallel_for(MLIST *list, memex_list_for_fn fn, void *ctx, uint32_t n_threads);
+int memex_list_parallel_reduce(MLIST *list, memex_list_reduce_fn fn, memex_list_reduce_fn combine,
+    void *result, size_t result_size, void *ctx, uint32_t n_threads);
+
+// Read-only snapshots; a live snapshot never changes, whatever the list does
+typedef void MSNAP;
+
+MSNAP *memex_list_snapshot(MLIST *list);
+void *memex_snapshot_get_entries(MSNAP *snap, uint32_t *n_entries);
+void *memex_snapshot_get_entry(MSNAP *snap, uint32_t index);
+void memex_snapshot_release(MSNAP *snap);
+
+// Lock-free single-producer/single-consumer FIFO: push returns 1 when full
+MLIST *memex_spsc_create(POOL *pool, const size_t entry_size, uint32_t capacity);
+
+// Chase-Lev work-stealing deque
+//   memex_list_push() and memex_list_pop() work at the bottom, owner thread only
+//   memex_deque_steal() takes from the top, from any thread
+MLIST *memex_deque_create(POOL *pool, const size_t entry_size, uint32_t capacity);
+int memex_deque_steal(MLIST *list, void *entry, uint32_t *n_entries);
+
+// Blocking bounded multi-producer/multi-consumer FIFO
+//   timeout_ms: -1 waits forever, 0 never waits
+//   memex_list_push() blocks while full, memex_list_pop() never blocks
+//   Calls that would block fail instead inside memex_list_acquire()
+MLIST *memex_queue_create(POOL *pool, const size_t entry_size, uint32_t capacity, int flags);
+int memex_queue_push_timed(MLIST *list, void *entry, int timeout_ms);
+int memex_queue_pop_timed(MLIST *list, void *entry, uint32_t *n_entries, int timeout_ms);
+int memex_queue_get_fd(MLIST *list);
+void memex_queue_close(MLIST *list);
+
+// Segmented list: grows by fixed-size chunks, so entry addresses never move
+//   memex_list_new_entry() is safe from multiple threads without the lock
+//   memex_list_get_entries() is not supported; use memex_list_get_entry()
+MLIST *memex_seglist_create(POOL *pool, const size_t entry_size, uint32_t chunk_entries);
+
+// Reserved list: address space for max_entries is reserved up front and
+// committed as the list grows, so entries never move and growth never copies
+//   memex_list_new_entry() is safe from multiple threads without the lock
+//   Counts and indices past UINT32_MAX need the memex_vmlist calls
+MLIST *memex_vmlist_create(POOL *pool, const size_t entry_size, uint64_t max_entries);
+uint64_t memex_vmlist_count(MLIST *list);
+void *memex_vmlist_get_entry(MLIST *list, uint64_t index);
+void *memex_vmlist_get_entries(MLIST *list, uint64_t *n_entries);
+
+// Priority queue: memex_list_pop() returns the entry with the smallest key
+//   Handles stay valid until their entry is popped or removed
+#define memex_pqueue_create(pool, _STRUCT_, _MEMBER_, type) \
+    _memex_pqueue_create(pool, sizeof(_STRUCT_), offsetof(_STRUCT_, _MEMBER_), type)
+
+MLIST *_memex_pqueue_create(POOL *pool, const size_t entry_size, int offset, int type);
+int memex_pqueue_push(MLIST *list, void *entry, uint32_t *handle);
+int memex_pqueue_pop(MLIST *list, void *entry, uint32_t *n_entries);
+void *memex_pqueue_peek(MLIST *list);
+int memex_pqueue_update(MLIST *list, uint32_t handle, void *entry);
+int memex_pqueue_remove(MLIST *list, uint32_t handle, void *entry);
+
+// Hash maps: fixed-size keys and values stored inline, compared bytewise
+//   Returned value pointers are valid until the next put or remove
+typedef void MMAP;
+typedef int (*memex_map_fn)(const void *key, void *value, void *ctx);
+
+MMAP *memex_map_create(POOL *pool, const size_t key_size, const size_t value_size);
+void *memex_map_put(MMAP *map, const void *key, const void *value);
+void *memex_map_get(MMAP *map, const void *key);
+int memex_map_remove(MMAP *map, const void *key, void *value);
+uint32_t memex_map_count(MMAP *map);
+void memex_map_foreach(MMAP *map, memex_map_fn fn, void *ctx);
+void memex_map_clear(MMAP *map);
+void memex_map_destroy(MMAP *map);
+
+// Timer wheels: entries stored inline, fired once their deadline passes
+//   Handles are valid until the timer fires or is cancelled
+typedef void MWHEEL;
+typedef void (*memex_timer_fn)(void *entry, uint64_t deadline, void *ctx);
+
+MWHEEL *memex_timer_wheel_create(POOL *pool, const size_t entry_size, uint64_t now);
+int memex_timer_schedule(MWHEEL *wheel, uint64_t deadline, const void *entry, uint32_t *handle);
+int memex_timer_cancel(MWHEEL *wheel, uint32_t handle, void *entry);
+uint32_t memex_timer_advance(MWHEEL *wheel, uint64_t now, memex_timer_fn fn, void *ctx);
+uint32_t memex_timer_count(MWHEEL *wheel);
+void memex_timer_wheel_destroy(MWHEEL *wheel);
+
+// Task executor: a fixed set of worker threads with work stealing
+//   Tasks get a scratch pool that is reset when they return
+//   Tasks submitted from a task run on the same worker unless stolen
+typedef void MEXEC;
+typedef void MFUTURE;
+typedef void *(*memex_task_fn)(void *arg, POOL *scratch);
+
+MEXEC *memex_exec_create(POOL *pool, uint32_t n_workers);
+int memex_exec_submit(MEXEC *exec, memex_task_fn fn, void *arg);
+MFUTURE *memex_exec_async(MEXEC *exec, memex_task_fn fn, void *arg);
+void *memex_future_join(MFUTURE *future);
+void memex_exec_wait(MEXEC *exec);
+void memex_exec_destroy(MEXEC *exec);
 
 void memex_list_set_default_step_size(size_t size);
+void memex_list_set_default_growth_factor(double factor);
 
 // Logging
 void memex_pool_set_log_level(char *level);
 void memex_cleanup_set_log_level(char *level);
 void memex_list_set_log_level(char *level);
+void memex_epoch_set_log_level(char *level);
+void memex_map_set_log_level(char *level);
+void memex_timer_set_log_level(char *level);
+void memex_exec_set_log_level(char *level);
 
 // Sort
 enum memex_sort_type_e {
@@ -119,6 +268,25 @@ struct memex_sort_t {
 void _memex_list_sort_set(MLIST *list, int offset, enum memex_sort_type_e type);
 void memex_list_sort(MLIST *list);
 
+// Sorted lists: keys are passed by pointer, in the sort type's C type
+//   memex_list_new_entry() appends out of order; the next lookup re-sorts
+#define memex_list_set_sorted(list, _STRUCT_, _MEMBER_, type) \
+    _memex_list_set_sorted(list, offsetof(_STRUCT_, _MEMBER_), type)
+
+int _memex_list_set_sorted(MLIST *list, int offset, enum memex_sort_type_e type);
+void *memex_list_insert(MLIST *list, void *entry);
+uint32_t memex_list_lower_bound(MLIST *list, void *key);
+uint32_t memex_list_upper_bound(MLIST *list, void *key);
+void *memex_list_find(MLIST *list, void *key);
+void *memex_list_get_range(MLIST *list, void *lo, void *hi, uint32_t *n_entries);
+
+// Key index: memex_list_find() becomes a hash lookup on this member
+//   Re-create the index after changing keys in place
+#define memex_list_index_create(list, _STRUCT_, _MEMBER_, type) \
+    _memex_list_index_create(list, offsetof(_STRUCT_, _MEMBER_), type)
+
+int _memex_list_index_create(MLIST *list, int offset, enum memex_sort_type_e type);
+
 void memex_merge_sort(struct memex_sort_t *list, int len);
 
 #endif
@@ -0,0 +1,311 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "memex.h"
+#include "memex-list.h"
+
+#define LOGEX_TAG "MEMEX-LIST"
+#include "memex-log.h"
+
+#define CACHE_LINE 64
+
+/*
+ *  Chase-Lev work-stealing deque
+ *
+ *  The owner thread pushes and pops at the bottom without locking; other
+ *  threads steal from the top, claiming an entry with a CAS on top.  Only
+ *  the last entry is contended, when the owner and a thief race for it.
+ *
+ *  The ring grows by copying into a buffer twice the size.  Thieves may
+ *  still be reading the old one, so it is retired with pfree_deferred() and
+ *  steals run inside an epoch.
+ */
+struct deque_buf_t {
+    int64_t mask;
+    char entries[];
+};
+
+struct memex_deque_t {
+    // Thief side
+    _Alignas(CACHE_LINE) _Atomic int64_t top;
+
+    // Owner side
+    _Alignas(CACHE_LINE) _Atomic int64_t bottom;
+    struct deque_buf_t *_Atomic buf;
+    int retired;
+
+    _Alignas(CACHE_LINE) uint32_t entry_size;
+};
+
+static inline char *
+deque_slot(struct memex_deque_t *q, struct deque_buf_t *a, int64_t i)
+{
+    return a->entries + ((size_t)(i & a->mask) * q->entry_size);
+}
+
+/*
+ *  A thief may copy a slot while the owner's push is overwriting it; the CAS
+ *  on top then fails and the copy is thrown away.  Both sides go through
+ *  relaxed atomics a word at a time so that race is not undefined behaviour.
+ *  Slots are 8-byte aligned when entry_size is a multiple of 8.
+ */
+static inline void
+deque_store(struct memex_deque_t *q, char *slot, const void *entry)
+{
+    const char *src = (const char *)entry;
+    size_t i;
+
+    if ((q->entry_size & 7) == 0) {
+        for (i = 0; i < q->entry_size; i += 8) {
+            uint64_t w;
+            memcpy(&w, src + i, 8);
+            atomic_store_explicit((_Atomic uint64_t *)(slot + i), w, memory_order_relaxed);
+        }
+        return;
+    }
+
+    for (i = 0; i < q->entry_size; i++) {
+        atomic_store_explicit((_Atomic char *)(slot + i), src[i], memory_order_relaxed);
+    }
+}
+
+static inline void
+deque_load(struct memex_deque_t *q, void *entry, char *slot)
+{
+    char *dst = (char *)entry;
+    size_t i;
+
+    if ((q->entry_size & 7) == 0) {
+        for (i = 0; i < q->entry_size; i += 8) {
+            uint64_t w = atomic_load_explicit((_Atomic uint64_t *)(slot + i), memory_order_relaxed);
+            memcpy(dst + i, &w, 8);
+        }
+        return;
+    }
+
+    for (i = 0; i < q->entry_size; i++) {
+        dst[i] = atomic_load_explicit((_Atomic char *)(slot + i), memory_order_relaxed);
+    }
+}
+
+static struct deque_buf_t *
+deque_buf_alloc(POOL *pool, struct memex_deque_t *q, int64_t size)
+{
+    struct deque_buf_t *a = palloc(pool, sizeof(struct deque_buf_t) + ((size_t)size * q->entry_size));
+    if (a) {
+        a->mask = size - 1;
+    }
+    return a;
+}
+
+MLIST *
+memex_deque_create(POOL *pool, const size_t entry_size, uint32_t capacity)
+{
+    if (capacity == 0 || capacity > 0x80000000) {
+        error("%s: Invalid capacity (%u)", __FUNCTION__, capacity);
+        return NULL;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)memex_list_create(pool, entry_size);
+    if (!m) {
+        return NULL;
+    }
+
+    // Round up to a power of two so indices wrap with a mask
+    int64_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    // Pool memory is only malloc-aligned; align the deque to a cache line
+    size_t bytes = sizeof(struct memex_deque_t) + CACHE_LINE;
+    uintptr_t raw = (uintptr_t)pcalloc(m->pool, bytes);
+    if (!raw) {
+        error("%s: Failed to allocate deque", __FUNCTION__);
+        memex_list_destroy(m);
+        return NULL;
+    }
+    struct memex_deque_t *q = (struct memex_deque_t *)((raw + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1));
+    q->entry_size = entry_size;
+
+    struct deque_buf_t *a = deque_buf_alloc(m->pool, q, size);
+    if (!a) {
+        error("%s: Failed to allocate deque", __FUNCTION__);
+        memex_list_destroy(m);
+        return NULL;
+    }
+    atomic_init(&q->top, 0);
+    atomic_init(&q->bottom, 0);
+    atomic_init(&q->buf, a);
+
+    m->type = MEMEX_TYPE_DEQUE;
+    m->size = size;
+    m->impl = q;
+
+    trace("%p: deque created (capacity=%ld)", m, (long)size);
+
+    return (MLIST *)m;
+}
+
+// Owner only: copy the live range into a buffer twice the size
+static struct deque_buf_t *
+deque_grow(struct memex_list_t *m, struct memex_deque_t *q, struct deque_buf_t *a, int64_t t, int64_t b)
+{
+    int64_t size = (a->mask + 1) * 2;
+    struct deque_buf_t *g = deque_buf_alloc(m->pool, q, size);
+    if (!g) {
+        error("%s: Failed to grow deque to %ld entries", __FUNCTION__, (long)size);
+        return NULL;
+    }
+
+    int64_t i;
+    for (i = t; i < b; i++) {
+        memcpy(deque_slot(q, g, i), deque_slot(q, a, i), q->entry_size);
+    }
+
+    trace("Expanding deque size from %ld to %ld", (long)(a->mask + 1), (long)size);
+    atomic_store_explicit(&q->buf, g, memory_order_release);
+    m->size = (uint32_t)((size > UINT32_MAX) ? UINT32_MAX : size);
+
+    // Thieves that loaded the old buffer may still be copying from it
+    pfree_deferred(m->pool, a);
+    q->retired = 1;
+
+    return g;
+}
+
+int
+memex_deque_push(struct memex_list_t *m, void *entry)
+{
+    struct memex_deque_t *q = (struct memex_deque_t *)m->impl;
+
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+    struct deque_buf_t *a = atomic_load_explicit(&q->buf, memory_order_relaxed);
+
+    if (b - t > a->mask) {
+        a = deque_grow(m, q, a, t, b);
+        if (!a) {
+            return 1;
+        }
+    }
+
+    deque_store(q, deque_slot(q, a, b), entry);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+
+    return 0;
+}
+
+// Owner only: take the most recently pushed entry
+int
+memex_deque_pop(struct memex_list_t *m, void *entry, uint32_t *n_entries)
+{
+    struct memex_deque_t *q = (struct memex_deque_t *)m->impl;
+    if (n_entries) {
+        *n_entries = 0;
+    }
+
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    struct deque_buf_t *a = atomic_load_explicit(&q->buf, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_relaxed);
+
+    if (t > b) {
+        // Empty
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        return 0;
+    }
+
+    memcpy(entry, deque_slot(q, a, b), q->entry_size);
+    if (t == b) {
+        // Last entry: race the thieves for it
+        int won = atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        if (!won) {
+            return 0;
+        }
+    }
+
+    if (n_entries) {
+        *n_entries = 1;
+    }
+    return 0;
+}
+
+/*
+ *  Take the oldest entry from any thread.  n_entries is 0 when the deque is
+ *  empty; a steal that loses a race retries.
+ */
+int
+memex_deque_steal(MLIST *list, void *entry, uint32_t *n_entries)
+{
+    if (n_entries) {
+        *n_entries = 0;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    if (!m) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return 1;
+    }
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return 1;
+    }
+
+    if (m->type != MEMEX_TYPE_DEQUE) {
+        error("%s: Not a deque", __FUNCTION__);
+        return 1;
+    }
+    struct memex_deque_t *q = (struct memex_deque_t *)m->impl;
+
+    memex_epoch_enter();
+    while (1) {
+        int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+        if (t >= b) {
+            break;
+        }
+
+        struct deque_buf_t *a = atomic_load_explicit(&q->buf, memory_order_acquire);
+        deque_load(q, entry, deque_slot(q, a, t));
+        if (atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                memory_order_seq_cst, memory_order_relaxed)) {
+            if (n_entries) {
+                *n_entries = 1;
+            }
+            break;
+        }
+    }
+    memex_epoch_exit();
+
+    return 0;
+}
+
+uint32_t
+memex_deque_count(struct memex_list_t *m)
+{
+    struct memex_deque_t *q = (struct memex_deque_t *)m->impl;
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+    return (b > t) ? (uint32_t)(b - t) : 0;
+}
+
+// Retired buffers belong to the list's pool; release them before it goes
+void
+memex_deque_release(struct memex_list_t *m)
+{
+    struct memex_deque_t *q = (struct memex_deque_t *)m->impl;
+    if (q->retired) {
+        memex_epoch_synchronize();
+    }
+}
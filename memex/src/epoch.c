@@ -0,0 +1,238 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <envex.h>
+
+#include "memex.h"
+
+#define LOGEX_TAG "MEMEX-EPOCH"
+#include "memex-log.h"
+
+/*
+ *  Epoch-based reclamation
+ *
+ *  Readers bracket their accesses with memex_epoch_enter()/memex_epoch_exit().
+ *  Writers unlink shared memory, then hand it to pfree_deferred().  Memory
+ *  retired in epoch E is released once the global epoch reaches E + 2, which
+ *  can only happen after every reader has left epoch E.
+ */
+
+// Reader state is (epoch << 1) | 1 while inside a critical section
+#define EPOCH_ACTIVE 0x1
+
+struct memex_epoch_rec_t {
+    _Atomic uint64_t state;
+    _Atomic int in_use;
+    int nest;
+    struct memex_epoch_rec_t *next;
+};
+
+struct memex_epoch_limbo_t {
+    POOL *pool;
+    void *addr;
+    uint64_t epoch;
+};
+
+static _Atomic uint64_t global_epoch = 0;
+static struct memex_epoch_rec_t *_Atomic records = NULL;
+
+static __thread struct memex_epoch_rec_t *local_rec = NULL;
+static pthread_key_t rec_key;
+static pthread_once_t rec_key_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t limbo_lock = PTHREAD_MUTEX_INITIALIZER;
+static MLIST *limbo = NULL;
+
+static void
+epoch_rec_release(void *arg)
+{
+    struct memex_epoch_rec_t *rec = (struct memex_epoch_rec_t *)arg;
+    atomic_store(&rec->state, 0);
+    rec->nest = 0;
+    atomic_store(&rec->in_use, 0);
+}
+
+static void
+epoch_key_init()
+{
+    pthread_key_create(&rec_key, epoch_rec_release);
+}
+
+static struct memex_epoch_rec_t *
+epoch_rec_get()
+{
+    if (local_rec) {
+        return local_rec;
+    }
+
+    if (memex_logging_init == 0 && ENVEX_EXISTS("MEMEX_EPOCH_LOG_LEVEL")) {
+        char lvl[32];
+        ENVEX_COPY(lvl, 32, "MEMEX_EPOCH_LOG_LEVEL", "");
+        memex_epoch_set_log_level(lvl);
+    }
+
+    pthread_once(&rec_key_once, epoch_key_init);
+
+    // Reuse a record abandoned by an exited thread
+    struct memex_epoch_rec_t *rec;
+    for (rec = atomic_load(&records); rec; rec = rec->next) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&rec->in_use, &expected, 1)) {
+            goto do_return;
+        }
+    }
+
+    // Records are never freed, so readers can walk the list without locking
+    rec = calloc(1, sizeof(struct memex_epoch_rec_t));
+    trace("%p:  Buf alloc (%p)", rec, rec);
+    atomic_store(&rec->in_use, 1);
+
+    struct memex_epoch_rec_t *head = atomic_load(&records);
+    do {
+        rec->next = head;
+    } while (!atomic_compare_exchange_weak(&records, &head, rec));
+
+do_return:
+    pthread_setspecific(rec_key, rec);
+    local_rec = rec;
+    return rec;
+}
+
+void
+memex_epoch_enter()
+{
+    struct memex_epoch_rec_t *rec = epoch_rec_get();
+    if (rec->nest++ > 0) {
+        return;
+    }
+
+    uint64_t e = atomic_load(&global_epoch);
+    atomic_store(&rec->state, (e << 1) | EPOCH_ACTIVE);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void
+memex_epoch_exit()
+{
+    struct memex_epoch_rec_t *rec = local_rec;
+    if (!rec || rec->nest == 0) {
+        error("%s: Not inside an epoch", __FUNCTION__);
+        return;
+    }
+
+    if (--rec->nest > 0) {
+        return;
+    }
+
+    atomic_store_explicit(&rec->state, 0, memory_order_release);
+}
+
+/*
+ *  Advance the global epoch if every active reader has observed it
+ */
+static uint64_t
+epoch_try_advance()
+{
+    uint64_t e = atomic_load(&global_epoch);
+
+    struct memex_epoch_rec_t *rec;
+    for (rec = atomic_load(&records); rec; rec = rec->next) {
+        uint64_t s = atomic_load(&rec->state);
+        if ((s & EPOCH_ACTIVE) && (s >> 1) != e) {
+            return e;
+        }
+    }
+
+    if (atomic_compare_exchange_strong(&global_epoch, &e, e + 1)) {
+        e++;
+    }
+    return e;
+}
+
+/*
+ *  Release retired memory that no reader can still reference
+ */
+static uint32_t
+epoch_reclaim(uint64_t e)
+{
+    uint32_t N;
+    struct memex_epoch_limbo_t *entries = memex_list_get_entries(limbo, &N);
+
+    // Retirements are appended in epoch order, so the safe set is a prefix
+    uint32_t n;
+    for (n = 0; n < N; n++) {
+        struct memex_epoch_limbo_t *l = entries + n;
+        if (l->epoch + 2 > e) {
+            break;
+        }
+        pfree(l->pool, l->addr);
+    }
+
+    if (n == N) {
+        memex_list_clear(limbo);
+    } else if (n > 0) {
+        memex_list_remove_before_index(limbo, n);
+    }
+
+    return N - n;
+}
+
+void
+pfree_deferred(POOL *pool, void *addr)
+{
+    if (!pool || !addr) {
+        error("%s: Invalid pool or address", __FUNCTION__);
+        return;
+    }
+
+    pthread_mutex_lock(&limbo_lock);
+    if (!limbo) {
+        POOL *p = create_pool_unmanaged();
+        limbo = memex_list_create(p, sizeof(struct memex_epoch_limbo_t));
+    }
+
+    struct memex_epoch_limbo_t *l = memex_list_new_entry(limbo);
+    l->pool = pool;
+    l->addr = addr;
+    l->epoch = atomic_load(&global_epoch);
+    trace("%p: Deferred free (%p, epoch=%" PRIu64 ")", pool, addr, l->epoch);
+
+    epoch_reclaim(epoch_try_advance());
+    pthread_mutex_unlock(&limbo_lock);
+}
+
+uint32_t
+memex_epoch_reclaim()
+{
+    uint32_t pending = 0;
+
+    pthread_mutex_lock(&limbo_lock);
+    if (limbo) {
+        pending = epoch_reclaim(epoch_try_advance());
+    }
+    pthread_mutex_unlock(&limbo_lock);
+
+    return pending;
+}
+
+void
+memex_epoch_synchronize()
+{
+    if (local_rec && local_rec->nest > 0) {
+        error("%s: Called from inside an epoch", __FUNCTION__);
+        return;
+    }
+
+    while (memex_epoch_reclaim() > 0) {
+        sched_yield();
+    }
+}
+
+void
+memex_epoch_set_log_level(char *level)
+{
+    memex_set_log_level_str(level);
+}
@@ -0,0 +1,549 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <envex.h>
+
+#include "memex.h"
+
+#define LOGEX_TAG "MEMEX-EXEC"
+#include "memex-log.h"
+
+#define EXEC_BATCH 32
+#define EXEC_SPIN 16
+
+/*
+ *  Task executor
+ *
+ *  Each worker owns a work-stealing deque and an inbox.  Tasks submitted
+ *  from outside the executor go round-robin into the inboxes, which are
+ *  ordinary locked FIFOs; a worker drains its inbox in batches into its
+ *  deque.  Tasks submitted by a running task go straight onto that worker's
+ *  deque, lock-free.  Idle workers steal from the others' deques and inboxes
+ *  before going to sleep.
+ *
+ *  Every task gets a scratch pool from its worker, which is reset after the
+ *  task returns.  A task waiting in memex_future_join() runs other tasks
+ *  meanwhile, so those get the scratch pool of the next level down.
+ */
+struct exec_task_t {
+    memex_task_fn fn;
+    void *arg;
+    struct memex_future_t *future;
+};
+
+struct memex_future_t {
+    struct memex_exec_t *exec;
+    _Atomic int done;
+    void *result;
+};
+
+struct exec_worker_t {
+    struct memex_exec_t *exec;
+    uint32_t id;
+    pthread_t thread;
+    MLIST *deque;
+    MLIST *inbox;
+
+    // One scratch pool per nesting level: a joining task runs others
+    POOL **scratch;
+    uint32_t n_scratch;
+    uint32_t depth;
+};
+
+struct memex_exec_t {
+    POOL *pool;
+    uint32_t n_workers;
+    struct exec_worker_t *workers;
+    _Atomic uint32_t next_inbox;
+
+    // Tasks queued but not yet started, and submitted but not yet finished
+    _Atomic int64_t queued;
+    _Atomic int64_t active;
+
+    // Sleeping workers wait on work; joiners and waiters on done
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    _Atomic uint32_t sleepers;
+    _Atomic uint32_t waiters;
+    _Atomic int stop;
+
+    // Live executors, for memex_cleanup()
+    struct memex_exec_t *next;
+};
+
+static __thread struct exec_worker_t *self = NULL;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct memex_exec_t *registry = NULL;
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+
+static void
+exec_cleanup_all()
+{
+    if (self) {
+        error("%s: Called from an executor task", __FUNCTION__);
+        return;
+    }
+
+    while (1) {
+        pthread_mutex_lock(&registry_lock);
+        struct memex_exec_t *e = registry;
+        pthread_mutex_unlock(&registry_lock);
+        if (!e) {
+            break;
+        }
+        memex_exec_destroy(e);
+    }
+}
+
+static void
+registry_init()
+{
+    memex_cleanup_push(exec_cleanup_all);
+}
+
+static void exec_run(struct exec_worker_t *w, struct exec_task_t *task);
+
+// Take one queued task: own deque, own inbox, then the other workers
+static int
+exec_find(struct exec_worker_t *w, struct exec_task_t *task)
+{
+    struct memex_exec_t *e = w->exec;
+    uint32_t n;
+
+    memex_list_pop(w->deque, task, &n);
+    if (n == 1) {
+        goto do_found;
+    }
+
+    // Move a batch from the inbox to the deque, where thieves can reach it
+    struct exec_task_t batch[EXEC_BATCH];
+    memex_list_pop_n(w->inbox, batch, EXEC_BATCH, &n);
+    if (n > 0) {
+        uint32_t i;
+        for (i = n - 1; i > 0; i--) {
+            if (memex_list_push(w->deque, batch + i) != 0) {
+                break;
+            }
+        }
+
+        // The deque could not grow: the rest go back to the inbox, or run here
+        if (i > 0 && memex_list_push_n(w->inbox, batch + 1, i) != 0) {
+            error("%s: Failed to requeue %u tasks, running them inline", __FUNCTION__, i);
+            uint32_t j;
+            for (j = 1; j <= i; j++) {
+                atomic_fetch_sub(&e->queued, 1);
+                exec_run(w, batch + j);
+            }
+        }
+        *task = batch[0];
+        goto do_found;
+    }
+
+    uint32_t k;
+    for (k = 1; k < e->n_workers; k++) {
+        struct exec_worker_t *v = e->workers + ((w->id + k) % e->n_workers);
+        memex_deque_steal(v->deque, task, &n);
+        if (n == 1) {
+            goto do_found;
+        }
+
+        memex_list_pop(v->inbox, task, &n);
+        if (n == 1) {
+            goto do_found;
+        }
+    }
+    return 0;
+
+do_found:
+    atomic_fetch_sub(&e->queued, 1);
+    return 1;
+}
+
+static void
+exec_scratch_grow(struct exec_worker_t *w)
+{
+    POOL *p = w->exec->pool;
+    POOL **scratch = repalloc(w->scratch, (w->n_scratch * 2) * sizeof(POOL *), p);
+    if (!scratch) {
+        error("%s: Failed to allocate scratch pools", __FUNCTION__);
+        return;
+    }
+    w->scratch = scratch;
+
+    uint32_t i;
+    for (i = w->n_scratch; i < w->n_scratch * 2; i++) {
+        w->scratch[i] = create_subpool(p);
+    }
+    w->n_scratch *= 2;
+}
+
+static void
+exec_run(struct exec_worker_t *w, struct exec_task_t *task)
+{
+    struct memex_exec_t *e = w->exec;
+
+    if (w->depth == w->n_scratch) {
+        exec_scratch_grow(w);
+    }
+
+    // Past the scratch levels we could allocate, use a throwaway pool
+    POOL *scratch = (w->depth < w->n_scratch) ? w->scratch[w->depth] : create_subpool(e->pool);
+    w->depth++;
+    void *result = task->fn(task->arg, scratch);
+    w->depth--;
+    if (w->depth < w->n_scratch) {
+        pool_reset(scratch);
+    } else {
+        free_pool(scratch);
+    }
+
+    if (task->future) {
+        task->future->result = result;
+        atomic_store(&task->future->done, 1);
+    }
+
+    // The last task to finish, or one a joiner waits for, wakes the waiters
+    int64_t left = atomic_fetch_sub(&e->active, 1) - 1;
+    if (atomic_load(&e->waiters) > 0 && (task->future || left == 0)) {
+        pthread_mutex_lock(&e->lock);
+        pthread_cond_broadcast(&e->done);
+        pthread_mutex_unlock(&e->lock);
+    }
+}
+
+static void *
+exec_worker(void *args)
+{
+    struct exec_worker_t *w = (struct exec_worker_t *)args;
+    struct memex_exec_t *e = w->exec;
+    self = w;
+
+    struct exec_task_t task;
+    while (1) {
+        int spin;
+        for (spin = 0; spin < EXEC_SPIN; spin++) {
+            if (exec_find(w, &task)) {
+                break;
+            }
+            sched_yield();
+        }
+
+        if (spin < EXEC_SPIN) {
+            exec_run(w, &task);
+            continue;
+        }
+
+        // Announce the sleep before the last look, so submitters see it
+        pthread_mutex_lock(&e->lock);
+        atomic_fetch_add(&e->sleepers, 1);
+        while (atomic_load(&e->queued) == 0 && !atomic_load(&e->stop)) {
+            pthread_cond_wait(&e->work, &e->lock);
+        }
+        atomic_fetch_sub(&e->sleepers, 1);
+        pthread_mutex_unlock(&e->lock);
+
+        if (atomic_load(&e->stop) && atomic_load(&e->queued) == 0) {
+            break;
+        }
+    }
+
+    self = NULL;
+    return NULL;
+}
+
+// Stop and join the first n_started workers, then free the executor
+static void
+exec_stop(struct memex_exec_t *e, uint32_t n_started)
+{
+    pthread_mutex_lock(&e->lock);
+    atomic_store(&e->stop, 1);
+    pthread_cond_broadcast(&e->work);
+    pthread_mutex_unlock(&e->lock);
+
+    uint32_t i;
+    for (i = 0; i < n_started; i++) {
+        pthread_join(e->workers[i].thread, NULL);
+    }
+    for (i = 0; i < e->n_workers; i++) {
+        if (e->workers[i].deque) {
+            memex_list_destroy(e->workers[i].deque);
+        }
+        if (e->workers[i].inbox) {
+            memex_list_destroy(e->workers[i].inbox);
+        }
+    }
+
+    pthread_cond_destroy(&e->work);
+    pthread_cond_destroy(&e->done);
+    pthread_mutex_destroy(&e->lock);
+
+    free_pool(e->pool);
+}
+
+MEXEC *
+memex_exec_create(POOL *pool, uint32_t n_workers)
+{
+    if (memex_logging_init == 0 && ENVEX_EXISTS("MEMEX_EXEC_LOG_LEVEL")) {
+        char lvl[32];
+        ENVEX_COPY(lvl, 32, "MEMEX_EXEC_LOG_LEVEL", "");
+        memex_exec_set_log_level(lvl);
+    }
+
+    if (n_workers == 0) {
+        error("%s: Invalid worker count (%u)", __FUNCTION__, n_workers);
+        return NULL;
+    }
+
+    POOL *p = create_subpool(pool);
+    struct memex_exec_t *e = pcalloc(p, sizeof(struct memex_exec_t));
+    if (!e || !(e->workers = pcalloc(p, n_workers * sizeof(struct exec_worker_t)))) {
+        error("%s: Failed to allocate executor", __FUNCTION__);
+        free_pool(p);
+        return NULL;
+    }
+    e->pool = p;
+    e->n_workers = n_workers;
+
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->work, NULL);
+    pthread_cond_init(&e->done, NULL);
+
+    uint32_t i;
+    for (i = 0; i < n_workers; i++) {
+        struct exec_worker_t *w = e->workers + i;
+        w->exec = e;
+        w->id = i;
+        w->deque = memex_deque_create(p, sizeof(struct exec_task_t), 256);
+        w->inbox = memex_fifo_create(p, sizeof(struct exec_task_t));
+        w->n_scratch = 1;
+        w->scratch = palloc(p, sizeof(POOL *));
+        if (!w->deque || !w->inbox || !w->scratch || !(w->scratch[0] = create_subpool(p))) {
+            error("%s: Failed to allocate worker %u", __FUNCTION__, i);
+            exec_stop(e, 0);
+            return NULL;
+        }
+    }
+
+    for (i = 0; i < n_workers; i++) {
+        int rc = pthread_create(&e->workers[i].thread, NULL, exec_worker, e->workers + i);
+        if (rc != 0) {
+            error("%s: Failed to start worker %u: %s", __FUNCTION__, i, strerror(rc));
+            exec_stop(e, i);
+            return NULL;
+        }
+    }
+
+    pthread_once(&registry_once, registry_init);
+    pthread_mutex_lock(&registry_lock);
+    e->next = registry;
+    registry = e;
+    pthread_mutex_unlock(&registry_lock);
+
+    info("%p: Executor started with %u workers", e, n_workers);
+
+    return (MEXEC *)e;
+}
+
+static int
+exec_submit(struct memex_exec_t *e, memex_task_fn fn, void *arg, struct memex_future_t *f)
+{
+    struct exec_task_t task = {fn, arg, f};
+    atomic_fetch_add(&e->active, 1);
+
+    // Tasks spawned by a task stay on its worker's deque
+    int ret;
+    if (self && self->exec == e) {
+        ret = memex_list_push(self->deque, &task);
+    } else {
+        uint32_t i = atomic_fetch_add_explicit(&e->next_inbox, 1, memory_order_relaxed);
+        ret = memex_list_push(e->workers[i % e->n_workers].inbox, &task);
+    }
+
+    if (ret != 0) {
+        atomic_fetch_sub(&e->active, 1);
+        return 1;
+    }
+
+    atomic_fetch_add(&e->queued, 1);
+    if (atomic_load(&e->sleepers) > 0) {
+        pthread_mutex_lock(&e->lock);
+        pthread_cond_signal(&e->work);
+        pthread_mutex_unlock(&e->lock);
+    }
+
+    return 0;
+}
+
+int
+memex_exec_submit(MEXEC *exec, memex_task_fn fn, void *arg)
+{
+    struct memex_exec_t *e = (struct memex_exec_t *)exec;
+    if (!e || !fn) {
+        error("%s: Invalid executor or task", __FUNCTION__);
+        return 1;
+    }
+
+    if (atomic_load(&e->stop)) {
+        error("%s: Executor is shutting down", __FUNCTION__);
+        return 1;
+    }
+
+    return exec_submit(e, fn, arg, NULL);
+}
+
+/*
+ *  Submit a task whose result is collected with memex_future_join().  Every
+ *  future must be joined exactly once.
+ */
+MFUTURE *
+memex_exec_async(MEXEC *exec, memex_task_fn fn, void *arg)
+{
+    struct memex_exec_t *e = (struct memex_exec_t *)exec;
+    if (!e || !fn) {
+        error("%s: Invalid executor or task", __FUNCTION__);
+        return NULL;
+    }
+
+    if (atomic_load(&e->stop)) {
+        error("%s: Executor is shutting down", __FUNCTION__);
+        return NULL;
+    }
+
+    struct memex_future_t *f = palloc(e->pool, sizeof(struct memex_future_t));
+    if (!f) {
+        error("%s: Failed to allocate future", __FUNCTION__);
+        return NULL;
+    }
+    f->exec = e;
+    f->result = NULL;
+    atomic_init(&f->done, 0);
+
+    if (exec_submit(e, fn, arg, f) != 0) {
+        pfree(e->pool, f);
+        return NULL;
+    }
+
+    return (MFUTURE *)f;
+}
+
+// Block until done() holds; a worker runs other tasks instead of blocking
+static void
+exec_wait(struct memex_exec_t *e, int (*done)(void *), void *ctx)
+{
+    if (self && self->exec == e) {
+        struct exec_task_t task;
+        while (!done(ctx)) {
+            if (exec_find(self, &task)) {
+                exec_run(self, &task);
+            } else {
+                sched_yield();
+            }
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&e->lock);
+    atomic_fetch_add(&e->waiters, 1);
+    while (!done(ctx)) {
+        pthread_cond_wait(&e->done, &e->lock);
+    }
+    atomic_fetch_sub(&e->waiters, 1);
+    pthread_mutex_unlock(&e->lock);
+}
+
+static int
+future_done(void *ctx)
+{
+    return atomic_load(&((struct memex_future_t *)ctx)->done);
+}
+
+static int
+exec_idle(void *ctx)
+{
+    return atomic_load(&((struct memex_exec_t *)ctx)->active) == 0;
+}
+
+// Wait for a task to finish, release its future, and return its result
+void *
+memex_future_join(MFUTURE *future)
+{
+    struct memex_future_t *f = (struct memex_future_t *)future;
+    if (!f) {
+        error("%s: Invalid future", __FUNCTION__);
+        return NULL;
+    }
+
+    struct memex_exec_t *e = f->exec;
+    exec_wait(e, future_done, f);
+
+    void *result = f->result;
+    pfree(e->pool, f);
+    return result;
+}
+
+// Wait until every submitted task, including ones they submit, has finished
+void
+memex_exec_wait(MEXEC *exec)
+{
+    struct memex_exec_t *e = (struct memex_exec_t *)exec;
+    if (!e) {
+        error("%s: Invalid executor", __FUNCTION__);
+        return;
+    }
+
+    if (self && self->exec == e) {
+        error("%s: Called from one of the executor's tasks", __FUNCTION__);
+        return;
+    }
+
+    exec_wait(e, exec_idle, e);
+}
+
+/*
+ *  Finish every queued task, stop the workers and free the executor.
+ *  Executors still running at memex_cleanup() are destroyed there.
+ */
+void
+memex_exec_destroy(MEXEC *exec)
+{
+    struct memex_exec_t *e = (struct memex_exec_t *)exec;
+    if (!e) {
+        error("%s: Invalid executor", __FUNCTION__);
+        return;
+    }
+
+    if (self && self->exec == e) {
+        error("%s: Called from one of the executor's tasks", __FUNCTION__);
+        return;
+    }
+
+    // Unregister first, so cleanup and an explicit destroy never both run
+    pthread_mutex_lock(&registry_lock);
+    struct memex_exec_t **p = &registry;
+    while (*p && *p != e) {
+        p = &(*p)->next;
+    }
+    if (!*p) {
+        pthread_mutex_unlock(&registry_lock);
+        error("%s: Unknown executor %p", __FUNCTION__, e);
+        return;
+    }
+    *p = e->next;
+    pthread_mutex_unlock(&registry_lock);
+
+    exec_wait(e, exec_idle, e);
+    exec_stop(e, e->n_workers);
+
+    info("%p: Executor stopped", e);
+}
+
+void
+memex_exec_set_log_level(char *level)
+{
+    memex_set_log_level_str(level);
+}
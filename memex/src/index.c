@@ -0,0 +1,297 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "memex.h"
+#include "memex-list.h"
+
+#define LOGEX_TAG "MEMEX-LIST"
+#include "memex-log.h"
+
+/*
+ *  Key index
+ *
+ *  A hash map from an entry's key to its sequence number, base + i for the
+ *  entry at logical index i.  Dropping entries off the front only advances
+ *  base, so FIFO pops and ring moves leave the index valid; removing from
+ *  the middle or sorting marks it stale and the next lookup rebuilds it.
+ *  Appends are indexed lazily: lookups first catch up on entries past
+ *  n_indexed, so keys written after memex_list_new_entry() are picked up.
+ *  The newest entry from memex_list_new_entry() may not have its key yet,
+ *  so it is left out of the map while it is the last entry and lookups
+ *  compare its key directly; any later append publishes it.
+ *
+ *  With duplicate keys the index maps the first entry.  Dropping that entry
+ *  can't reveal the next one without a scan, so it marks the index stale.
+ */
+struct memex_index_t {
+    MMAP *map;
+    int off;
+    int type;
+
+    uint64_t base;
+    uint32_t n_indexed;
+    int dups;
+    int stale;
+
+    // Sequence number of the newest memex_list_new_entry() entry
+    int fresh;
+    uint64_t fresh_seq;
+};
+
+// Map key for an entry's typed key; equal floating point keys hash alike
+static inline int64_t
+index_key(struct memex_index_t *x, const void *entry, int off)
+{
+    int64_t val = 0;
+    memex_sort_key(entry, off, x->type, &val);
+    if ((x->type == MEMEX_SORT_TYPE_DOUBLE || x->type == MEMEX_SORT_TYPE_FLOAT) &&
+        val == INT64_MIN) {
+        // -0.0
+        val = 0;
+    }
+    return val;
+}
+
+static inline char *
+index_entry(struct memex_list_t *m, uint32_t i)
+{
+    uint32_t slot = m->head + i;
+    if (slot >= m->size) {
+        slot -= m->size;
+    }
+    return (char *)m->entries + ((size_t)slot * m->entry_size);
+}
+
+// Entries that may be indexed: all but a fresh last entry
+static inline uint32_t
+index_limit(struct memex_list_t *m, struct memex_index_t *x)
+{
+    uint32_t n = m->n_entry;
+    if (x->fresh && n > 0 && x->fresh_seq == x->base + n - 1) {
+        return n - 1;
+    }
+    return n;
+}
+
+// Index any entries appended since the last lookup; caller holds the list lock
+static void
+index_catch_up(struct memex_list_t *m, struct memex_index_t *x)
+{
+    uint32_t n = index_limit(m, x);
+    for (; x->n_indexed < n; x->n_indexed++) {
+        int64_t key = index_key(x, index_entry(m, x->n_indexed), x->off);
+        if (memex_map_get(x->map, &key)) {
+            x->dups = 1;
+            continue;
+        }
+
+        uint64_t seq = x->base + x->n_indexed;
+        memex_map_put(x->map, &key, &seq);
+    }
+}
+
+static void
+index_rebuild(struct memex_list_t *m, struct memex_index_t *x)
+{
+    trace("%p: Rebuilding index over %u entries", m, m->n_entry);
+    memex_map_clear(x->map);
+    x->base = 0;
+    x->n_indexed = 0;
+    x->dups = 0;
+    x->stale = 0;
+    index_catch_up(m, x);
+}
+
+/*
+ *  Declare a key for memex_list_find() and index it.  Calling it again
+ *  rebuilds the index, which is required after changing keys in place.
+ */
+int
+_memex_list_index_create(MLIST *list, int offset, enum memex_sort_type_e type)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return 1;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return 1;
+    }
+
+    if (m->impl) {
+        error("%s: Not supported for this list type", __FUNCTION__);
+        return 1;
+    }
+
+    if (type <= MEMEX_SORT_TYPE_NOINIT || type > MEMEX_SORT_TYPE_INT8) {
+        error("%s: Invalid key type (%d)", __FUNCTION__, type);
+        return 1;
+    }
+
+    int ret = 1;
+    memex_list_lock(m);
+    struct memex_index_t *x = m->index;
+    if (!x) {
+        x = pcalloc(m->pool, sizeof(struct memex_index_t));
+        if (!x) {
+            error("%s: Failed to allocate index", __FUNCTION__);
+            goto do_return;
+        }
+
+        x->map = memex_map_create(m->pool, sizeof(int64_t), sizeof(uint64_t));
+        if (!x->map) {
+            pfree(m->pool, x);
+            goto do_return;
+        }
+        m->index = x;
+    }
+
+    x->off = offset;
+    x->type = type;
+    index_rebuild(m, x);
+    ret = 0;
+
+    trace("%p: indexed (key offset=%d, type=%d)", m, offset, type);
+
+do_return:
+    memex_list_unlock(m);
+    return ret;
+}
+
+/*
+ *  Logical index of the entry with key, or UINT32_MAX; caller holds the
+ *  list lock
+ */
+uint32_t
+memex_index_find(struct memex_list_t *m, void *key)
+{
+    struct memex_index_t *x = m->index;
+    if (x->stale) {
+        index_rebuild(m, x);
+    } else {
+        index_catch_up(m, x);
+    }
+
+    int64_t k = index_key(x, key, 0);
+    int retry;
+    for (retry = 0; retry < 2; retry++) {
+        uint64_t *seq = memex_map_get(x->map, &k);
+        if (!seq) {
+            break;
+        }
+
+        // The entry's key may have been changed in place since it was indexed
+        uint64_t i = *seq - x->base;
+        if (i < m->n_entry && index_key(x, index_entry(m, (uint32_t)i), x->off) == k) {
+            return (uint32_t)i;
+        }
+        index_rebuild(m, x);
+    }
+
+    // A fresh last entry is not in the map yet
+    uint32_t last = m->n_entry - 1;
+    if (index_limit(m, x) == last && index_key(x, index_entry(m, last), x->off) == k) {
+        return last;
+    }
+
+    return UINT32_MAX;
+}
+
+/*
+ *  Entry i was just handed out by memex_list_new_entry(), with its key still
+ *  to be written; caller holds the lock
+ */
+void
+memex_index_fresh(struct memex_list_t *m, uint32_t i)
+{
+    struct memex_index_t *x = m->index;
+    x->fresh = 1;
+    x->fresh_seq = x->base + i;
+}
+
+/*
+ *  Forget n entries starting at logical index i, before they are dropped
+ *  from the front (i == 0) or the back of the list; caller holds the lock
+ */
+void
+memex_index_drop(struct memex_list_t *m, uint32_t i, uint32_t n)
+{
+    struct memex_index_t *x = m->index;
+    if (x->stale) {
+        return;
+    }
+
+    uint32_t end = (i + n < x->n_indexed) ? i + n : x->n_indexed;
+    uint32_t j;
+    for (j = i; j < end; j++) {
+        int64_t key = index_key(x, index_entry(m, j), x->off);
+        uint64_t *seq = memex_map_get(x->map, &key);
+        if (!seq || *seq != x->base + j) {
+            continue;
+        }
+
+        if (x->dups) {
+            x->stale = 1;
+            return;
+        }
+        memex_map_remove(x->map, &key, NULL);
+    }
+
+    if (i == 0) {
+        x->base += n;
+        x->n_indexed = (x->n_indexed > n) ? x->n_indexed - n : 0;
+    } else if (x->n_indexed > i) {
+        x->n_indexed = i;
+    }
+}
+
+/*
+ *  The last entry is about to replace entry i; caller holds the lock and
+ *  i is not the last entry
+ */
+void
+memex_index_swap_remove(struct memex_list_t *m, uint32_t i)
+{
+    struct memex_index_t *x = m->index;
+    uint32_t last = m->n_entry - 1;
+    if (x->stale || x->dups || last >= x->n_indexed) {
+        // Unindexed entries would be caught up at the wrong position
+        x->stale = 1;
+        return;
+    }
+
+    int64_t key = index_key(x, index_entry(m, i), x->off);
+    uint64_t *seq = memex_map_get(x->map, &key);
+    if (seq && *seq == x->base + i) {
+        memex_map_remove(x->map, &key, NULL);
+    }
+
+    key = index_key(x, index_entry(m, last), x->off);
+    seq = memex_map_get(x->map, &key);
+    if (seq && *seq == x->base + last) {
+        *seq = x->base + i;
+    }
+    x->n_indexed--;
+}
+
+// Entries moved within the list; rebuild on the next lookup
+void
+memex_index_stale(struct memex_list_t *m)
+{
+    m->index->stale = 1;
+}
+
+void
+memex_index_destroy(struct memex_list_t *m)
+{
+    struct memex_index_t *x = m->index;
+    m->index = NULL;
+    memex_map_destroy(x->map);
+    pfree(m->pool, x);
+}
@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "memex.h"
+#include "memex-list.h"
+
+#define LOGEX_TAG "MEMEX-LIST"
+#include "memex-log.h"
+
+#define JOURNAL_SEGMENT_BYTES (16 * 1024 * 1024)
+
+/*
+ *  FIFO overflow journal
+ *
+ *  A journaled FIFO keeps at most hot entries in its ring.  Pushes beyond
+ *  that are appended to the journal, a chain of fixed-size segment files
+ *  (path.000000, path.000001, ...) that are mapped shared, so their pages
+ *  belong to the page cache rather than the process.  Once anything is in
+ *  the journal every push goes there too, which keeps FIFO order: the ring
+ *  holds the oldest entries, the journal everything after them.  Pops refill
+ *  the ring from the journal, and fully read segments are unlinked.
+ *
+ *  At most the write segment and the read segment are mapped.  The journal
+ *  is overflow space, not a durable log: it is removed with the list.
+ */
+struct journal_seg_t {
+    uint64_t seq;
+    char *map;
+};
+
+struct memex_journal_t {
+    char *path;
+    uint32_t hot;
+    uint32_t seg_entries;
+    size_t seg_bytes;
+
+    // Append position
+    struct journal_seg_t w;
+    uint32_t w_pos;
+
+    // Read position; shares the write mapping when on the same segment
+    struct journal_seg_t r;
+    uint32_t r_pos;
+
+    uint64_t count;
+};
+
+static void
+seg_name(struct memex_journal_t *j, uint64_t seq, char *name, size_t len)
+{
+    snprintf(name, len, "%s.%06llu", j->path, (unsigned long long)seq);
+}
+
+static char *
+seg_map(struct memex_journal_t *j, uint64_t seq, int create)
+{
+    char name[4096];
+    seg_name(j, seq, name, sizeof(name));
+
+    int fd = open(name, create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0600);
+    if (fd < 0) {
+        error("%s: Failed to open %s", __FUNCTION__, name);
+        return NULL;
+    }
+
+    // Reserve the blocks up front; a full disk must fail here, not fault later
+    if (create && posix_fallocate(fd, 0, j->seg_bytes) != 0) {
+        error("%s: Failed to allocate %zu bytes for %s", __FUNCTION__, j->seg_bytes, name);
+        close(fd);
+        unlink(name);
+        return NULL;
+    }
+
+    char *map = mmap(NULL, j->seg_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        error("%s: Failed to map %s", __FUNCTION__, name);
+        return NULL;
+    }
+
+    trace("Journal segment %s mapped", name);
+    return map;
+}
+
+static void
+seg_unlink(struct memex_journal_t *j, uint64_t seq)
+{
+    char name[4096];
+    seg_name(j, seq, name, sizeof(name));
+    unlink(name);
+}
+
+/*
+ *  Put a FIFO in journal mode: keep at most hot entries in memory and spill
+ *  the rest to segment files named after path
+ */
+int
+memex_fifo_set_journal(MLIST *list, const char *path, uint32_t hot)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return 1;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return 1;
+    }
+
+    if (m->type != MEMEX_TYPE_FIFO) {
+        error("%s: Only FIFOs can be journaled", __FUNCTION__);
+        return 1;
+    }
+
+    if (hot == 0 || !path) {
+        error("%s: Invalid journal settings", __FUNCTION__);
+        return 1;
+    }
+
+    int ret = 1;
+    memex_list_lock(m);
+    if (m->journal) {
+        error("%s: FIFO is already journaled", __FUNCTION__);
+        goto do_return;
+    }
+
+    struct memex_journal_t *j = pcalloc(m->pool, sizeof(struct memex_journal_t));
+    if (!j || !(j->path = palloc(m->pool, strlen(path) + 1))) {
+        error("%s: Failed to allocate journal", __FUNCTION__);
+        goto do_return;
+    }
+    strcpy(j->path, path);
+
+    j->hot = hot;
+    j->seg_entries = JOURNAL_SEGMENT_BYTES / m->entry_size;
+    if (j->seg_entries == 0) {
+        j->seg_entries = 1;
+    }
+    j->seg_bytes = (size_t)j->seg_entries * m->entry_size;
+    m->journal = j;
+    ret = 0;
+
+    trace("%p: journaled to %s (hot=%u)", m, path, hot);
+
+do_return:
+    memex_list_unlock(m);
+    return ret;
+}
+
+/*
+ *  Number of the n entries being pushed that belong in the ring; the rest go
+ *  to memex_journal_append().  Caller holds the list lock.
+ */
+uint32_t
+memex_journal_split(struct memex_list_t *m, uint32_t n)
+{
+    struct memex_journal_t *j = m->journal;
+    if (j->count > 0 || m->n_entry >= j->hot) {
+        return 0;
+    }
+    return (n < j->hot - m->n_entry) ? n : j->hot - m->n_entry;
+}
+
+int
+memex_journal_append(struct memex_list_t *m, const void *entries, uint32_t n)
+{
+    struct memex_journal_t *j = m->journal;
+    const char *src = (const char *)entries;
+    size_t es = m->entry_size;
+
+    while (n > 0) {
+        if (!j->w.map || j->w_pos == j->seg_entries) {
+            uint64_t seq = j->w.map ? j->w.seq + 1 : j->r.seq;
+            char *map = seg_map(j, seq, 1);
+            if (!map) {
+                return 1;
+            }
+
+            // Keep the old write segment mapped if the reader is still on it
+            if (j->w.map && j->w.map != j->r.map) {
+                munmap(j->w.map, j->seg_bytes);
+            }
+            j->w.seq = seq;
+            j->w.map = map;
+            j->w_pos = 0;
+            if (!j->r.map && j->r.seq == seq) {
+                j->r.map = map;
+            }
+        }
+
+        uint32_t k = j->seg_entries - j->w_pos;
+        k = (n < k) ? n : k;
+        memcpy(j->w.map + ((size_t)j->w_pos * es), src, k * es);
+        j->w_pos += k;
+        j->count += k;
+        src += k * es;
+        n -= k;
+    }
+
+    return 0;
+}
+
+/*
+ *  Move up to n of the oldest journal entries to dst, or drop them if dst is
+ *  NULL; caller holds the list lock and n <= count
+ */
+static void
+journal_read(struct memex_list_t *m, struct memex_journal_t *j, char *dst, uint32_t n)
+{
+    size_t es = m->entry_size;
+    while (n > 0) {
+        if (!j->r.map) {
+            j->r.map = (j->r.seq == j->w.seq) ? j->w.map : seg_map(j, j->r.seq, 0);
+            if (!j->r.map) {
+                return;
+            }
+        }
+
+        uint32_t end = (j->r.seq == j->w.seq) ? j->w_pos : j->seg_entries;
+        uint32_t k = end - j->r_pos;
+        k = (n < k) ? n : k;
+        if (dst) {
+            memcpy(dst, j->r.map + ((size_t)j->r_pos * es), k * es);
+            dst += k * es;
+        }
+        j->r_pos += k;
+        j->count -= k;
+        n -= k;
+
+        if (j->r_pos < j->seg_entries) {
+            continue;
+        }
+
+        // Segment fully read
+        if (j->r.map != j->w.map) {
+            munmap(j->r.map, j->seg_bytes);
+        } else {
+            munmap(j->w.map, j->seg_bytes);
+            j->w.map = NULL;
+        }
+        seg_unlink(j, j->r.seq);
+        j->r.map = NULL;
+        j->r.seq++;
+        j->r_pos = 0;
+    }
+}
+
+/*
+ *  Top the ring back up to the hot window from the journal.  Caller holds
+ *  the list lock and has made the buffer writable.
+ */
+int
+memex_journal_refill(struct memex_list_t *m)
+{
+    struct memex_journal_t *j = m->journal;
+    if (j->count == 0 || m->n_entry >= j->hot) {
+        return 0;
+    }
+
+    uint32_t n = j->hot - m->n_entry;
+    if (n > j->count) {
+        n = (uint32_t)j->count;
+    }
+
+    if (m->n_entry + n > m->size && memex_list_grow(m, m->n_entry + n) != 0) {
+        return 1;
+    }
+    memex_list_linearize(m);
+
+    journal_read(m, j, (char *)m->entries + ((size_t)m->n_entry * m->entry_size), n);
+    m->n_entry += n;
+
+    trace("%p: refilled %u entries from the journal (%llu left)", m, n, (unsigned long long)j->count);
+
+    return 0;
+}
+
+// Drop up to n of the oldest journal entries; caller holds the list lock
+void
+memex_journal_skip(struct memex_list_t *m, uint32_t n)
+{
+    struct memex_journal_t *j = m->journal;
+    if (n > j->count) {
+        n = (uint32_t)j->count;
+    }
+    journal_read(m, j, NULL, n);
+}
+
+uint64_t
+memex_journal_count(struct memex_list_t *m)
+{
+    return m->journal->count;
+}
+
+// Drop every journaled entry and its files; caller holds the list lock
+void
+memex_journal_clear(struct memex_list_t *m)
+{
+    struct memex_journal_t *j = m->journal;
+    if (j->r.map && j->r.map != j->w.map) {
+        munmap(j->r.map, j->seg_bytes);
+    }
+    if (j->w.map) {
+        munmap(j->w.map, j->seg_bytes);
+    }
+
+    uint64_t seq;
+    uint64_t last = j->w.seq;
+    for (seq = j->r.seq; seq <= last; seq++) {
+        seg_unlink(j, seq);
+    }
+
+    j->w.map = NULL;
+    j->r.map = NULL;
+    j->r.seq = last + 1;
+    j->w.seq = last + 1;
+    j->w_pos = 0;
+    j->r_pos = 0;
+    j->count = 0;
+}
+
+void
+memex_journal_destroy(struct memex_list_t *m)
+{
+    memex_journal_clear(m);
+    pfree(m->pool, m->journal->path);
+    pfree(m->pool, m->journal);
+    m->journal = NULL;
+}
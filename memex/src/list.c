@@ -4,6 +4,7 @@
 #include <envex.h>
 
 #include "memex.h"
+#include "memex-list.h"
 
 #define LOGEX_TAG "MEMEX-LIST"
 #include "memex-log.h"
@@ -13,48 +14,260 @@
 static pthread_mutex_t master_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static size_t memex_list_step_size = DEFAULT_STEP_SIZE;
+static double memex_list_growth = 0.0;
 
-enum memex_type_e {
-    MEMEX_TYPE_LIST=0,
-    MEMEX_TYPE_FIFO,
-    MEMEX_TYPE_STACK,
-};
+// Address of the logical entry at index i
+static inline char *
+list_entry(struct memex_list_t *m, uint32_t i)
+{
+    uint32_t slot = m->head + i;
+    if (slot >= m->size) {
+        slot -= m->size;
+    }
+    return (char *)m->entries + ((size_t)slot * m->entry_size);
+}
+
+/*
+ *  Copy n logical entries starting at index i out of / into the buffer,
+ *  splitting the copy where a FIFO ring wraps
+ */
+static void
+list_copy_out(struct memex_list_t *m, void *dst, uint32_t i, uint32_t n)
+{
+    // An empty list may have no buffer at all
+    if (n == 0) {
+        return;
+    }
+
+    uint32_t slot = (m->head + i) % m->size;
+    uint32_t n_first = (slot + n > m->size) ? m->size - slot : n;
+    size_t es = m->entry_size;
 
-struct memex_list_t {
-    // Number of new entries to allocate at a time
-    uint32_t step;
+    memcpy(dst, (char *)m->entries + (slot * es), n_first * es);
+    memcpy((char *)dst + (n_first * es), m->entries, (n - n_first) * es);
+}
 
-    // Number of total entries
-    uint32_t size;
+static void
+list_copy_in(struct memex_list_t *m, uint32_t i, const void *src, uint32_t n)
+{
+    // An empty list may have no buffer at all
+    if (n == 0) {
+        return;
+    }
 
-    // Number of filled entries
-    uint32_t n_entry;
+    uint32_t slot = (m->head + i) % m->size;
+    uint32_t n_first = (slot + n > m->size) ? m->size - slot : n;
+    size_t es = m->entry_size;
 
-    // Entry size in bytes
-    uint32_t entry_size;
+    memcpy((char *)m->entries + (slot * es), src, n_first * es);
+    memcpy(m->entries, (const char *)src + (n_first * es), (n - n_first) * es);
+}
 
-    // Data buffer
-    void *entries;
+/*
+ *  Expand the buffer to exactly size entries.  A wrapped FIFO ring is
+ *  unwrapped into the new space, so the entries keep their order.
+ */
+static int
+list_resize(struct memex_list_t *m, uint32_t size)
+{
+    uint32_t old_size = m->size;
 
-    // Sort
-    enum memex_sort_type_e sort_type;
-    int sort_off;
+    // Reserved slots are being written outside the lock; the buffer stays put
+    if (m->reserved) {
+        error("%s: List has an open append reservation", __FUNCTION__);
+        return 1;
+    }
 
-    pthread_mutex_t lock;
-    pthread_mutexattr_t attr;
+    trace("Expanding list size from %u to %u", old_size, size);
+    void *entries = repalloc(m->entries, (size_t)size * m->entry_size, m->pool);
+    if (!entries) {
+        error("%s: Failed to expand list to %u entries", __FUNCTION__, size);
+        return 1;
+    }
+    m->entries = entries;
+    m->size = size;
+
+    if (m->head + m->n_entry <= old_size) {
+        return 0;
+    }
+
+    // Move whichever segment of the wrapped ring is shorter
+    char *addr = (char *)m->entries;
+    size_t es = m->entry_size;
+    uint32_t n_tail = m->head + m->n_entry - old_size;
+    uint32_t n_head = old_size - m->head;
+    if (n_tail <= m->size - old_size && n_tail <= n_head) {
+        memcpy(addr + (old_size * es), addr, n_tail * es);
+    } else {
+        uint32_t head = m->size - n_head;
+        memmove(addr + (head * es), addr + (m->head * es), n_head * es);
+        m->head = head;
+    }
+
+    return 0;
+}
+
+/*
+ *  Grow the buffer to hold at least min_size entries, following the list's
+ *  growth policy
+ */
+int
+memex_list_grow(struct memex_list_t *m, uint32_t min_size)
+{
+    uint64_t size = m->size;
+    while (size < min_size) {
+        uint64_t inc = m->step;
+        if (m->growth > 1.0 && (uint64_t)(size * (m->growth - 1.0)) > inc) {
+            inc = (uint64_t)(size * (m->growth - 1.0));
+        }
+        size += inc;
+    }
+
+    if (size > UINT32_MAX) {
+        size = UINT32_MAX;
+    }
+
+    return list_resize(m, (uint32_t)size);
+}
+
+/*
+ *  Rotate a FIFO ring so that its entries start at the front of the buffer
+ */
+void
+memex_list_linearize(struct memex_list_t *m)
+{
+    if (m->head == 0) {
+        return;
+    }
+
+    char *addr = (char *)m->entries;
+    size_t es = m->entry_size;
+    if (m->n_entry == 0) {
+        m->head = 0;
+
+    } else if (m->head + m->n_entry <= m->size) {
+        memmove(addr, addr + (m->head * es), m->n_entry * es);
+        m->head = 0;
+
+    } else {
+        // Reserved slots are being written outside the lock; the buffer stays put
+        if (m->reserved) {
+            error("%s: List has an open append reservation", __FUNCTION__);
+            return;
+        }
+
+        char *entries = palloc(m->pool, (size_t)m->size * es);
+        if (!entries) {
+            error("%s: Failed to linearize list", __FUNCTION__);
+            return;
+        }
+
+        uint32_t n_head = m->size - m->head;
+        memcpy(entries, addr + (m->head * es), n_head * es);
+        memcpy(entries + (n_head * es), addr, (m->n_entry - n_head) * es);
+        pfree(m->pool, m->entries);
+        m->entries = entries;
+        m->head = 0;
+    }
+}
+
+static void *
+list_new_entry(MLIST *list, int zero, const char *fn)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", fn);
+        return NULL;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", fn, __LINE__, m->state);
+        }
+        return NULL;
+    }
+
+    if (m->type == MEMEX_TYPE_SEGMENTED) {
+        return memex_seglist_new_entry(m, zero);
+    }
 
-    int state;
-    int type;
-    POOL *pool;
-};
+    if (m->type == MEMEX_TYPE_RESERVED) {
+        return memex_vmlist_new_entry(m, zero);
+    }
+
+    if (m->impl || m->journal) {
+        error("%s: Entries cannot be added directly to this list type", fn);
+        return NULL;
+    }
+    memex_list_lock(m);
+
+    // Manage list size, get last empty buffer, increment counter
+    char *entry = NULL;
+    uint32_t i = m->n_entry;
+
+    if (m->reserved) {
+        error("%s: List has an open append reservation", fn);
+        goto do_return;
+    }
+
+    if (memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+
+    if (i >= m->size && memex_list_grow(m, i + 1) != 0) {
+        goto do_return;
+    }
+
+    entry = list_entry(m, i);
+    if (zero) {
+        memset(entry, 0, m->entry_size);
+    }
+    m->n_entry++;
+
+    if (m->index) {
+        memex_index_fresh(m, i);
+    }
+
+    // The key is not filled in yet; sort before the next lookup
+    if (m->sorted) {
+        m->sorted = MEMEX_SORTED_DIRTY;
+    }
+
+do_return:
+    memex_list_unlock(m);
+
+    return (void *)entry;
+}
 
 void *
 memex_list_new_entry(MLIST *list)
 {
+    return list_new_entry(list, 1, __FUNCTION__);
+}
+
+// As memex_list_new_entry(), for callers that overwrite the whole entry
+void *
+memex_list_new_entry_uninit(MLIST *list)
+{
+    return list_new_entry(list, 0, __FUNCTION__);
+}
+
+/*
+ *  Reserve n contiguous, uninitialized slots at the back of the list.  The
+ *  caller fills them without holding the lock, then publishes them with
+ *  memex_list_append_commit().  Until then, other threads may read the list
+ *  and pop or remove entries, but adding entries or growing the list fails.
+ */
+int
+memex_list_append_reserve(MLIST *list, uint32_t n, void **first)
+{
+    *first = NULL;
+
     // Dereference input pointer
     if (!list) {
         error("%s: Invalid MLIST", __FUNCTION__);
-        return NULL;
+        return 1;
     }
     struct memex_list_t *m = (struct memex_list_t *)list;
 
@@ -62,26 +275,115 @@ memex_list_new_entry(MLIST *list)
         if (m->state != MEMEX_STATE_FREED) {
             error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
         }
-        return NULL;
+        return 1;
     }
-    pthread_mutex_lock(&m->lock);
 
-    // Increment counter, manage list size, get last empty buffer
-    size_t i = m->n_entry++;
+    if (m->impl || m->journal) {
+        error("%s: Entries cannot be added directly to this list type", __FUNCTION__);
+        return 1;
+    }
 
-    if (i >= m->size) {
-        trace("Expanding list size from %d to %d", m->size, m->size + m->step);
-        m->size += m->step;
-        size_t bytes = m->size * m->entry_size;
-        m->entries = repalloc(m->entries, bytes, m->pool);
+    if (n == 0) {
+        error("%s: Invalid reservation size (%u)", __FUNCTION__, n);
+        return 1;
     }
 
-    char *addr = (char *)m->entries;
-    char *entry = addr + (i * m->entry_size);
-    memset(entry, 0, m->entry_size);
-    pthread_mutex_unlock(&m->lock);
+    int ret = 1;
+    memex_list_lock(m);
+    if (m->reserved) {
+        error("%s: List has an open append reservation", __FUNCTION__);
+        goto do_return;
+    }
 
-    return (void *)entry;
+    if (memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+
+    if (m->n_entry + n > m->size && memex_list_grow(m, m->n_entry + n) != 0) {
+        goto do_return;
+    }
+
+    // With the ring unwrapped, pops and removes only ever free slots below
+    // the reservation, so it stays contiguous until the commit
+    memex_list_linearize(m);
+    if (m->head != 0) {
+        goto do_return;
+    }
+
+    m->reserved = n;
+    m->reserve_slot = m->n_entry;
+    *first = list_entry(m, m->n_entry);
+    ret = 0;
+
+do_return:
+    memex_list_unlock(m);
+    return ret;
+}
+
+/*
+ *  Publish the first n reserved slots and release the rest of the
+ *  reservation.  n = 0 cancels it.
+ */
+int
+memex_list_append_commit(MLIST *list, uint32_t n)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return 1;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return 1;
+    }
+
+    int ret = 1;
+    memex_list_lock(m);
+    if (n > m->reserved) {
+        error("%s: Committing %u entries, %u reserved", __FUNCTION__, n, m->reserved);
+        goto do_return;
+    }
+
+    // Entries removed meanwhile leave a gap below the reserved slots
+    size_t es = m->entry_size;
+    char *src = (char *)m->entries + ((size_t)m->reserve_slot * es);
+    uint32_t slot = m->head + m->n_entry;
+    m->reserved = 0;
+    if (n > 0 && slot != m->reserve_slot) {
+        if (!m->snap) {
+            memmove((char *)m->entries + ((size_t)slot * es), src, n * es);
+        } else {
+            // The gap may still hold a snapshot's entries; copy them away
+            char *tmp = palloc(m->pool, n * es);
+            if (!tmp) {
+                error("%s: Failed to copy reserved entries", __FUNCTION__);
+                goto do_return;
+            }
+            memcpy(tmp, src, n * es);
+            int detached = (memex_list_modify(m) == 0);
+            if (detached) {
+                list_copy_in(m, m->n_entry, tmp, n);
+            }
+            pfree(m->pool, tmp);
+            if (!detached) {
+                goto do_return;
+            }
+        }
+    }
+
+    m->n_entry += n;
+    if (n > 0 && m->sorted) {
+        m->sorted = MEMEX_SORTED_DIRTY;
+    }
+    ret = 0;
+
+do_return:
+    memex_list_unlock(m);
+    return ret;
 }
 
 void *
@@ -101,11 +403,159 @@ memex_list_get_entries(MLIST *list, uint32_t *n_entries)
         }
         return NULL;
     }
-    pthread_mutex_lock(&m->lock);
+    if (m->type == MEMEX_TYPE_SEGMENTED) {
+        error("%s: Segmented lists are not contiguous", __FUNCTION__);
+        *n_entries = 0;
+        return NULL;
+    }
+
+    if (m->type == MEMEX_TYPE_RESERVED) {
+        uint64_t n;
+        void *entries = memex_vmlist_get_entries(list, &n);
+        if (n > UINT32_MAX) {
+            error("%s: List is too long; use memex_vmlist_get_entries()", __FUNCTION__);
+            *n_entries = 0;
+            return NULL;
+        }
+        *n_entries = (uint32_t)n;
+        return entries;
+    }
+
+    // The caller may write through the returned buffer
+    void *entries = NULL;
+    memex_list_lock(m);
+    if (memex_list_modify(m) != 0) {
+        *n_entries = 0;
+        goto do_return;
+    }
+    memex_list_linearize(m);
     *n_entries = m->n_entry;
-    pthread_mutex_unlock(&m->lock);
+    entries = m->entries;
+
+do_return:
+    memex_list_unlock(m);
 
-    return m->entries;
+    return entries;
+}
+
+void *
+memex_list_get_entry(MLIST *list, uint32_t index)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return NULL;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return NULL;
+    }
+
+    if (m->type == MEMEX_TYPE_SEGMENTED) {
+        return memex_seglist_get_entry(m, index);
+    }
+
+    if (m->type == MEMEX_TYPE_RESERVED) {
+        return memex_vmlist_list_get_entry(m, index);
+    }
+
+    void *entry = NULL;
+    memex_list_lock(m);
+    if (index < m->n_entry && memex_list_modify(m) == 0) {
+        entry = list_entry(m, index);
+    }
+    memex_list_unlock(m);
+
+    return entry;
+}
+
+uint32_t
+memex_list_count(MLIST *list)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return 0;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return 0;
+    }
+
+    if (m->type == MEMEX_TYPE_SEGMENTED) {
+        return memex_seglist_count(m);
+    }
+
+    if (m->type == MEMEX_TYPE_RESERVED) {
+        return memex_vmlist_list_count(m);
+    }
+
+    if (m->type == MEMEX_TYPE_DEQUE) {
+        return memex_deque_count(m);
+    }
+
+    if (m->type == MEMEX_TYPE_SPSC) {
+        return memex_spsc_count(m);
+    }
+
+    memex_list_lock(m);
+    uint64_t n = m->n_entry;
+    if (m->journal) {
+        n += memex_journal_count(m);
+        n = (n > UINT32_MAX) ? UINT32_MAX : n;
+    }
+    memex_list_unlock(m);
+
+    return n;
+}
+
+void *
+memex_list_get_segments(MLIST *list, uint32_t *n_first, void **second, uint32_t *n_second)
+{
+    *n_first = 0;
+    *second = NULL;
+    *n_second = 0;
+
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return NULL;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return NULL;
+    }
+    void *first = NULL;
+    memex_list_lock(m);
+    if (memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+
+    first = list_entry(m, 0);
+    if (m->head + m->n_entry <= m->size) {
+        *n_first = m->n_entry;
+    } else {
+        *n_first = m->size - m->head;
+        *second = m->entries;
+        *n_second = m->n_entry - *n_first;
+    }
+
+do_return:
+    memex_list_unlock(m);
+
+    return first;
 }
 
 void *
@@ -125,19 +575,19 @@ memex_list_get_entries_copy(MLIST *list, uint32_t *n_entries)
         }
         return NULL;
     }
-    pthread_mutex_lock(&m->lock);
+    memex_list_lock(m);
     size_t bytes = m->entry_size * m->n_entry;
-    void *copy = pcalloc(m->pool, bytes);
-    memcpy(copy, m->entries, bytes);
+    char *copy = pcalloc(m->pool, bytes);
+    list_copy_out(m, copy, 0, m->n_entry);
 
     *n_entries = m->n_entry;
-    pthread_mutex_unlock(&m->lock);
+    memex_list_unlock(m);
 
     return copy;
 }
 
 MLIST *
-memex_list_create(POOL *pool, const size_t entry_size)
+memex_list_create_flags(POOL *pool, const size_t entry_size, int flags)
 {
     if (memex_logging_init == 0 && ENVEX_EXISTS("MEMEX_LIST_LOG_LEVEL")) {
         char lvl[32];
@@ -145,15 +595,25 @@ memex_list_create(POOL *pool, const size_t entry_size)
         memex_list_set_log_level(lvl);
     }
 
-    POOL *p = create_subpool(pool);
+    // Lightweight lists live directly in the caller's pool; a single-thread
+    // list's own pool needs no lock either
+    POOL *p = (flags & MEMEX_NOSUBPOOL) ? pool : create_subpool_flags(pool, flags & MEMEX_NOLOCK);
     struct memex_list_t *m = (struct memex_list_t *)pcalloc(p, sizeof(struct memex_list_t));
+    if (!m) {
+        error("%s: Failed to allocate MLIST", __FUNCTION__);
+        return NULL;
+    }
     m->pool = p;
     m->step = memex_list_step_size;
+    m->growth = memex_list_growth;
     m->entry_size = entry_size;
+    m->flags = flags;
 
-    pthread_mutexattr_init(&m->attr);
-    pthread_mutexattr_settype(&m->attr, PTHREAD_MUTEX_RECURSIVE);
-    pthread_mutex_init(&m->lock, &m->attr);
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&m->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
     m->state = MEMEX_STATE_VALID;
 
     trace("%p: created", m);
@@ -161,20 +621,42 @@ memex_list_create(POOL *pool, const size_t entry_size)
     return (MLIST *)m;
 }
 
+MLIST *
+memex_list_create(POOL *pool, const size_t entry_size)
+{
+    return memex_list_create_flags(pool, entry_size, 0);
+}
+
+MLIST *
+memex_fifo_create_flags(POOL *pool, const size_t entry_size, int flags)
+{
+    struct memex_list_t *m = (struct memex_list_t *)memex_list_create_flags(pool, entry_size, flags);
+    if (m) {
+        m->type = MEMEX_TYPE_FIFO;
+    }
+    return (MLIST *)m;
+}
+
 MLIST *
 memex_fifo_create(POOL *pool, const size_t entry_size)
 {
-    struct memex_list_t *m = (struct memex_list_t *)memex_list_create(pool, entry_size);
-    m->type = MEMEX_TYPE_FIFO;
+    return memex_fifo_create_flags(pool, entry_size, 0);
+}
+
+MLIST *
+memex_stack_create_flags(POOL *pool, const size_t entry_size, int flags)
+{
+    struct memex_list_t *m = (struct memex_list_t *)memex_list_create_flags(pool, entry_size, flags);
+    if (m) {
+        m->type = MEMEX_TYPE_STACK;
+    }
     return (MLIST *)m;
 }
 
 MLIST *
 memex_stack_create(POOL *pool, const size_t entry_size)
 {
-    struct memex_list_t *m = (struct memex_list_t *)memex_list_create(pool, entry_size);
-    m->type = MEMEX_TYPE_STACK;
-    return (MLIST *)m;
+    return memex_stack_create_flags(pool, entry_size, 0);
 }
 
 MLIST *
@@ -189,19 +671,30 @@ memex_list_copy(POOL *pool, MLIST *list)
         return NULL;
     }
 
-    pthread_mutex_lock(&m->lock);
-    struct memex_list_t *new = (struct memex_list_t *)memex_list_create(pool, (const size_t)m->entry_size);
+    if (m->impl || m->journal) {
+        error("%s: Cannot copy this list type", __FUNCTION__);
+        return NULL;
+    }
+
+    memex_list_lock(m);
+    struct memex_list_t *new = (struct memex_list_t *)memex_list_create_flags(pool,
+        (const size_t)m->entry_size, m->flags);
 
     new->size = m->size;
+    new->step = m->step;
+    new->growth = m->growth;
+    new->type = m->type;
 
     size_t bytes = m->size * m->entry_size;
-    new->entries = palloc(pool, bytes);
+    new->entries = palloc(new->pool, bytes);
     memcpy(new->entries, m->entries, bytes);
     new->n_entry = m->n_entry;
+    new->head = m->head;
     new->sort_type = m->sort_type;
     new->sort_off = m->sort_off;
+    new->sorted = m->sorted;
     new->state = m->state;
-    pthread_mutex_unlock(&m->lock);
+    memex_list_unlock(m);
 
     return new;
 }
@@ -214,160 +707,613 @@ memex_list_get_pool(MLIST *list) {
         return NULL;
     }
 
-    struct memex_list_t *m = (struct memex_list_t *)list;
-    return m->pool;
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    return m->pool;
+}
+
+void
+memex_list_clear(MLIST *list)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return;
+    }
+    if (m->type == MEMEX_TYPE_SEGMENTED) {
+        memex_seglist_clear(m);
+        return;
+    }
+
+    if (m->type == MEMEX_TYPE_RESERVED) {
+        memex_vmlist_clear(m);
+        return;
+    }
+
+    // Lock-free rings are only emptied by their consumers
+    if (m->type == MEMEX_TYPE_SPSC || m->type == MEMEX_TYPE_DEQUE) {
+        error("%s: Not supported for this list type", __FUNCTION__);
+        return;
+    }
+
+    memex_list_lock(m);
+    if (m->snap) {
+        // Leave the old entries to the snapshot rather than copying them
+        memex_snapshot_detach(m, 0);
+    }
+    if (m->type == MEMEX_TYPE_PQUEUE) {
+        memex_pqueue_clear(m);
+    }
+    if (m->index) {
+        memex_index_stale(m);
+    }
+    if (m->journal) {
+        memex_journal_clear(m);
+    }
+    m->n_entry = 0;
+    m->head = 0;
+    if (m->type == MEMEX_TYPE_QUEUE) {
+        memex_queue_clear(m);
+    }
+    memex_list_unlock(m);
+}
+
+void
+memex_list_remove_index(MLIST *list, uint32_t index)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return;
+    }
+
+    if (m->impl) {
+        error("%s: Not supported for this list type", __FUNCTION__);
+        return;
+    }
+
+    memex_list_lock(m);
+    if (index >= m->n_entry || memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+
+    if (index == (m->n_entry - 1)) {
+        if (m->index) {
+            memex_index_drop(m, index, 1);
+        }
+        goto dec_return;
+    }
+
+    if (m->index) {
+        memex_index_stale(m);
+    }
+    memex_list_linearize(m);
+    char *dst = m->entries + (index * m->entry_size);
+    char *src = dst + m->entry_size;
+    size_t bytes = (m->n_entry - index - 1) * m->entry_size;
+    memmove(dst, src, bytes);
+
+dec_return:
+    m->n_entry--;
+
+do_return:
+    memex_list_unlock(m);
+}
+
+/*
+ *  Remove every entry for which pred returns nonzero, keeping the order of
+ *  the rest, in one pass.  pred must not call back into the list.  Returns
+ *  the number of entries removed.
+ */
+uint32_t
+memex_list_remove_if(MLIST *list, memex_list_pred_fn pred, void *ctx)
+{
+    // Dereference input pointer
+    if (!list || !pred) {
+        error("%s: Invalid MLIST or predicate", __FUNCTION__);
+        return 0;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return 0;
+    }
+
+    if (m->impl || m->journal) {
+        error("%s: Not supported for this list type", __FUNCTION__);
+        return 0;
+    }
+
+    uint32_t removed = 0;
+    memex_list_lock(m);
+
+    // Nothing is written until the first match
+    uint32_t i = 0;
+    while (i < m->n_entry && !pred(list_entry(m, i), ctx)) {
+        i++;
+    }
+    if (i == m->n_entry || memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+
+    // Entries from j on are free to be overwritten
+    uint32_t j = i;
+    size_t es = m->entry_size;
+    for (i++; i < m->n_entry; i++) {
+        char *entry = list_entry(m, i);
+        if (pred(entry, ctx)) {
+            continue;
+        }
+        memcpy(list_entry(m, j), entry, es);
+        j++;
+    }
+
+    removed = m->n_entry - j;
+    if (m->index) {
+        memex_index_stale(m);
+    }
+    m->n_entry = j;
+    if (j == 0) {
+        m->head = 0;
+    }
+
+    trace("%p: removed %u entries", m, removed);
+
+do_return:
+    memex_list_unlock(m);
+    return removed;
+}
+
+/*
+ *  Remove the entry at index in O(1) by moving the last entry into its
+ *  place.  The order of the list is not kept.
+ */
+void
+memex_list_swap_remove(MLIST *list, uint32_t index)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return;
+    }
+
+    if (m->impl || m->journal) {
+        error("%s: Not supported for this list type", __FUNCTION__);
+        return;
+    }
+
+    memex_list_lock(m);
+    if (index >= m->n_entry || memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+
+    uint32_t last = m->n_entry - 1;
+    if (index == last) {
+        if (m->index) {
+            memex_index_drop(m, index, 1);
+        }
+    } else {
+        if (m->index) {
+            memex_index_swap_remove(m, index);
+        }
+        memcpy(list_entry(m, index), list_entry(m, last), m->entry_size);
+        if (m->sorted) {
+            m->sorted = MEMEX_SORTED_DIRTY;
+        }
+    }
+
+    m->n_entry--;
+    if (m->n_entry == 0) {
+        m->head = 0;
+    }
+
+do_return:
+    memex_list_unlock(m);
+}
+
+int
+memex_list_push(MLIST *list, void *entry)
+{
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return 1;
+    }
+
+    // Dereference input pointer
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    if (m->type == MEMEX_TYPE_SPSC) {
+        return memex_spsc_push(m, entry);
+    }
+
+    if (m->type == MEMEX_TYPE_DEQUE) {
+        return memex_deque_push(m, entry);
+    }
+
+    // Queues apply backpressure by blocking until there is room
+    if (m->type == MEMEX_TYPE_QUEUE) {
+        return memex_queue_push_timed(list, entry, -1);
+    }
+
+    if (m->type == MEMEX_TYPE_PQUEUE) {
+        return memex_pqueue_push(list, entry, NULL);
+    }
+
+    return memex_list_push_n(list, entry, 1);
+}
+
+int
+memex_list_pop(MLIST *list, void *entry, uint32_t *n_entries)
+{
+    int ret = 1;
+    if (n_entries) {
+        *n_entries = 0;
+    }
+
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        goto do_return;
+    }
+
+    // Dereference input pointer
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    if (m->type == MEMEX_TYPE_SPSC) {
+        return memex_spsc_pop(m, entry, n_entries);
+    }
+
+    if (m->type == MEMEX_TYPE_DEQUE) {
+        return memex_deque_pop(m, entry, n_entries);
+    }
+
+    if (m->type == MEMEX_TYPE_QUEUE) {
+        return memex_queue_pop_timed(list, entry, n_entries, 0);
+    }
+
+    if (m->type == MEMEX_TYPE_PQUEUE) {
+        return memex_pqueue_pop(list, entry, n_entries);
+    }
+
+    if (m->type != MEMEX_TYPE_FIFO && m->type != MEMEX_TYPE_STACK) {
+        error("%s: Can only pop from type FIFO or STACK", __FUNCTION__);
+        goto do_return;
+    }
+
+    // Hnadle race condition
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        goto do_return;
+    }
+
+    memex_list_lock(m);
+    ret = 0;
+
+    if (m->journal && m->n_entry == 0 && memex_list_modify(m) == 0) {
+        memex_journal_refill(m);
+    }
+
+    if (m->n_entry == 0) {
+        goto do_unlock;
+    }
+
+    if (n_entries) {
+        *n_entries = 1;
+    }
+    if (m->index) {
+        memex_index_drop(m, (m->type == MEMEX_TYPE_FIFO) ? 0 : m->n_entry - 1, 1);
+    }
+    if (m->type == MEMEX_TYPE_FIFO) {
+        // Copy first entry and advance the ring
+        memcpy(entry, list_entry(m, 0), m->entry_size);
+        m->head = (m->n_entry == 1) ? 0 : (m->head + 1) % m->size;
+
+    } else if (m->type == MEMEX_TYPE_STACK) {
+        // Copy last entry
+        char *src = m->entries + ((m->n_entry - 1) * m->entry_size);
+        memcpy(entry, src, m->entry_size);
+    }
+
+    m->n_entry--;
+
+do_unlock:
+    memex_list_unlock(m);
+
+do_return:
+    return ret;
+}
+
+int
+memex_list_push_n(MLIST *list, void *entries, uint32_t n)
+{
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return 1;
+    }
+
+    // Dereference input pointer
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    if (m->type != MEMEX_TYPE_FIFO && m->type != MEMEX_TYPE_STACK) {
+        error("%s: Can only push to type FIFO or STACK", __FUNCTION__);
+        return 1;
+    }
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return 1;
+    }
+
+    int ret = 1;
+    memex_list_lock(m);
+    if (m->reserved) {
+        error("%s: List has an open append reservation", __FUNCTION__);
+        goto do_return;
+    }
+
+    if (memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+
+    // A journaled FIFO keeps only its hot window in the ring
+    uint32_t n_mem = m->journal ? memex_journal_split(m, n) : n;
+    if (m->n_entry + n_mem > m->size && memex_list_grow(m, m->n_entry + n_mem) != 0) {
+        goto do_return;
+    }
+
+    list_copy_in(m, m->n_entry, entries, n_mem);
+    m->n_entry += n_mem;
+
+    if (n_mem < n &&
+        memex_journal_append(m, (char *)entries + ((size_t)n_mem * m->entry_size), n - n_mem) != 0) {
+        goto do_return;
+    }
+    ret = 0;
+
+do_return:
+    memex_list_unlock(m);
+    return ret;
 }
 
-void
-memex_list_clear(MLIST *list)
+/*
+ *  Pop up to max entries in pop order: oldest first for a FIFO, most
+ *  recent first for a STACK
+ */
+int
+memex_list_pop_n(MLIST *list, void *entries, uint32_t max, uint32_t *n_entries)
 {
-    // Dereference input pointer
+    *n_entries = 0;
+
     if (!list) {
         error("%s: Invalid MLIST", __FUNCTION__);
-        return;
+        return 1;
     }
 
+    // Dereference input pointer
     struct memex_list_t *m = (struct memex_list_t *)list;
+    if (m->type != MEMEX_TYPE_FIFO && m->type != MEMEX_TYPE_STACK) {
+        error("%s: Can only pop from type FIFO or STACK", __FUNCTION__);
+        return 1;
+    }
 
     if (m->state != MEMEX_STATE_VALID) {
         if (m->state != MEMEX_STATE_FREED) {
             error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
         }
-        return;
+        return 1;
     }
-    pthread_mutex_lock(&m->lock);
-    m->n_entry = 0;
-    pthread_mutex_unlock(&m->lock);
+
+    memex_list_lock(m);
+    if (m->journal && m->n_entry < max && memex_list_modify(m) == 0) {
+        memex_journal_refill(m);
+    }
+
+    uint32_t n = (max < m->n_entry) ? max : m->n_entry;
+    if (m->index) {
+        memex_index_drop(m, (m->type == MEMEX_TYPE_FIFO) ? 0 : m->n_entry - n, n);
+    }
+
+    if (m->type == MEMEX_TYPE_FIFO) {
+        list_copy_out(m, entries, 0, n);
+        m->head = (n == m->n_entry) ? 0 : (m->head + n) % m->size;
+
+    } else {
+        // Stack order is reversed relative to the buffer
+        char *dst = (char *)entries;
+        char *src = (char *)m->entries + ((size_t)(m->n_entry - 1) * m->entry_size);
+        uint32_t i;
+        for (i = 0; i < n; i++) {
+            memcpy(dst, src, m->entry_size);
+            dst += m->entry_size;
+            src -= m->entry_size;
+        }
+    }
+
+    m->n_entry -= n;
+    *n_entries = n;
+    memex_list_unlock(m);
+
+    return 0;
 }
 
-void
-memex_list_remove_index(MLIST *list, uint32_t index)
+/*
+ *  Zero-copy access to the ends of a list.  The returned pointer refers to
+ *  the list's own buffer, so the caller must hold memex_list_acquire() until
+ *  it is done with the entries.  n_contig (optional) receives the number of
+ *  entries that are contiguous in memory starting at the front, or ending at
+ *  the back.
+ */
+void *
+memex_list_peek_front(MLIST *list, uint32_t *n_contig)
 {
+    if (n_contig) {
+        *n_contig = 0;
+    }
+
     // Dereference input pointer
     if (!list) {
         error("%s: Invalid MLIST", __FUNCTION__);
-        return;
+        return NULL;
     }
-
     struct memex_list_t *m = (struct memex_list_t *)list;
 
     if (m->state != MEMEX_STATE_VALID) {
         if (m->state != MEMEX_STATE_FREED) {
             error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
         }
-        return;
+        return NULL;
     }
 
-    pthread_mutex_lock(&m->lock);
-    if (index >= m->n_entry) {
-        goto do_return;
+    if (m->impl) {
+        error("%s: Not supported for this list type", __FUNCTION__);
+        return NULL;
     }
 
-    if (index == (m->n_entry - 1)) {
-        goto dec_return;
+    void *entry = NULL;
+    memex_list_lock(m);
+    if (m->journal && m->n_entry == 0 && memex_list_modify(m) == 0) {
+        memex_journal_refill(m);
     }
 
-    char *dst = m->entries + (index * m->entry_size);
-    char *src = dst + m->entry_size;
-    size_t bytes = (m->n_entry - index + 1) * m->entry_size;
-    memcpy(dst, src, bytes);
-
-dec_return:
-    m->n_entry--;
+    if (m->n_entry > 0 && memex_list_modify(m) == 0) {
+        entry = list_entry(m, 0);
+        if (n_contig) {
+            *n_contig = (m->head + m->n_entry > m->size) ? m->size - m->head : m->n_entry;
+        }
+    }
+    memex_list_unlock(m);
 
-do_return:
-    pthread_mutex_unlock(&m->lock);
+    return entry;
 }
 
-int
-memex_list_push(MLIST *list, void *entry)
+void *
+memex_list_peek_back(MLIST *list, uint32_t *n_contig)
 {
-    int ret = 1;
+    if (n_contig) {
+        *n_contig = 0;
+    }
 
+    // Dereference input pointer
     if (!list) {
         error("%s: Invalid MLIST", __FUNCTION__);
-        goto do_return;
+        return NULL;
     }
-
-    // Dereference input pointer
     struct memex_list_t *m = (struct memex_list_t *)list;
-    if (m->type != MEMEX_TYPE_FIFO && m->type != MEMEX_TYPE_STACK) {
-        error("%s: Can only push to type FIFO or STACK", __FUNCTION__);
-        goto do_return;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return NULL;
     }
 
-    // Create new entry
-    pthread_mutex_lock(&m->lock);
-    void *new = memex_list_new_entry(list);
-    if (!new) {
-        goto do_return;
+    // The back of a journaled FIFO is in the journal, not the ring
+    if (m->impl || m->journal) {
+        error("%s: Not supported for this list type", __FUNCTION__);
+        return NULL;
     }
 
-    memcpy(new, entry, m->entry_size);
-    pthread_mutex_unlock(&m->lock);
-    ret = 0;
+    void *entry = NULL;
+    memex_list_lock(m);
+    if (m->n_entry > 0 && memex_list_modify(m) == 0) {
+        entry = list_entry(m, m->n_entry - 1);
+        if (n_contig) {
+            // Entries wrapped to the start of the buffer end at the back
+            uint32_t n_wrap = (m->head + m->n_entry > m->size) ? m->head + m->n_entry - m->size : 0;
+            *n_contig = n_wrap ? n_wrap : m->n_entry;
+        }
+    }
+    memex_list_unlock(m);
 
-do_return:
-    return ret;
+    return entry;
 }
 
-int
-memex_list_pop(MLIST *list, void *entry, uint32_t *n_entries)
+/*
+ *  Drop n entries from the end pop takes them from: the back of a STACK,
+ *  the front of anything else
+ */
+void
+memex_list_consume(MLIST *list, uint32_t n)
 {
-    int ret = 1;
-    void *val = NULL;
-    if (n_entries) {
-        *n_entries = 0;
-    }
-
+    // Dereference input pointer
     if (!list) {
         error("%s: Invalid MLIST", __FUNCTION__);
-        goto do_return;
+        return;
     }
-
-    // Dereference input pointer
     struct memex_list_t *m = (struct memex_list_t *)list;
-    if (m->type != MEMEX_TYPE_FIFO && m->type != MEMEX_TYPE_STACK) {
-        error("%s: Can only pop from type FIFO or STACK", __FUNCTION__);
-        goto do_return;
-    }
 
-    // Hnadle race condition
     if (m->state != MEMEX_STATE_VALID) {
         if (m->state != MEMEX_STATE_FREED) {
             error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
         }
-        goto do_return;
+        return;
     }
 
-    pthread_mutex_lock(&m->lock);
-    ret = 0;
-
-    if (m->n_entry == 0) {
-        goto do_return;
+    if (m->impl) {
+        error("%s: Not supported for this list type", __FUNCTION__);
+        return;
     }
 
-    if (n_entries) {
-        *n_entries = 1;
-    }
-    if (m->type == MEMEX_TYPE_FIFO) {
-        // Copy first entry
-        memcpy(entry, m->entries, m->entry_size);
+    memex_list_lock(m);
+    if (m->journal && n > m->n_entry) {
+        // Skip the rest in the journal, then refill the ring as pop does
+        memex_journal_skip(m, n - m->n_entry);
+        if (m->index) {
+            memex_index_stale(m);
+        }
+        m->n_entry = 0;
+        m->head = 0;
+        if (memex_list_modify(m) == 0) {
+            memex_journal_refill(m);
+        }
 
-        // Overwrite first entry
-        size_t bytes = (m->n_entry - 1) * m->entry_size;
-        memcpy(m->entries, m->entries + m->entry_size, bytes);
+    } else if (n >= m->n_entry) {
+        if (m->index) {
+            memex_index_stale(m);
+        }
+        m->n_entry = 0;
+        m->head = 0;
 
     } else if (m->type == MEMEX_TYPE_STACK) {
-        // Copy last entry
-        char *src = m->entries + ((m->n_entry - 1) * m->entry_size);
-        memcpy(entry, src, m->entry_size);
-    }
-
-    m->n_entry--;
+        if (m->index) {
+            memex_index_drop(m, m->n_entry - n, n);
+        }
+        m->n_entry -= n;
 
-do_return:
-    pthread_mutex_unlock(&m->lock);
+    } else {
+        memex_list_remove_before_index(list, n);
+    }
+    memex_list_unlock(m);
 }
 
 void
@@ -388,9 +1334,17 @@ memex_list_remove_after_index(MLIST *list, uint32_t index)
         return;
     }
 
-    pthread_mutex_lock(&m->lock);
+    if (m->impl) {
+        error("%s: Not supported for this list type", __FUNCTION__);
+        return;
+    }
+
+    memex_list_lock(m);
+    if (index < (m->n_entry - 1) && m->index) {
+        memex_index_drop(m, index + 1, m->n_entry - index - 1);
+    }
     m->n_entry = (index < (m->n_entry - 1)) ? index + 1 : m->n_entry;
-    pthread_mutex_unlock(&m->lock);
+    memex_list_unlock(m);
 }
 
 void
@@ -411,17 +1365,42 @@ memex_list_remove_before_index(MLIST *list, uint32_t index)
         return;
     }
 
+    if (m->impl) {
+        error("%s: Not supported for this list type", __FUNCTION__);
+        return;
+    }
+
     if (index == 0) {
         return;
     }
 
-    pthread_mutex_lock(&m->lock);
-    char *src = m->entries + (index * m->entry_size);
-    char *dst = m->entries;
-    size_t bytes = (m->n_entry - index) * m->entry_size;
-    memcpy(dst, src, bytes);
-    m->n_entry -= index;
-    pthread_mutex_unlock(&m->lock);
+    memex_list_lock(m);
+    if (index >= m->n_entry) {
+        if (m->index) {
+            memex_index_stale(m);
+        }
+        m->n_entry = 0;
+        m->head = 0;
+
+    } else if (m->type == MEMEX_TYPE_FIFO) {
+        // Dropping the front of a ring only moves the head
+        if (m->index) {
+            memex_index_drop(m, 0, index);
+        }
+        m->head = (m->head + index) % m->size;
+        m->n_entry -= index;
+
+    } else if (memex_list_modify(m) == 0) {
+        if (m->index) {
+            memex_index_drop(m, 0, index);
+        }
+        char *src = m->entries + (index * m->entry_size);
+        char *dst = m->entries;
+        size_t bytes = (m->n_entry - index) * m->entry_size;
+        memmove(dst, src, bytes);
+        m->n_entry -= index;
+    }
+    memex_list_unlock(m);
 }
 
 void
@@ -442,15 +1421,41 @@ memex_list_destroy(MLIST *list)
         return;
     }
 
-    pthread_mutex_lock(&m->lock);
+    memex_list_lock(m);
     m->state = MEMEX_STATE_FREED;
-    pthread_mutex_unlock(&m->lock);
+    memex_list_unlock(m);
 
-    pthread_mutex_lock(&m->lock);
+    memex_list_lock(m);
+    if (m->snap) {
+        memex_snapshot_detach(m, 0);
+    }
+    if (m->index) {
+        memex_index_destroy(m);
+    }
+    if (m->journal) {
+        memex_journal_destroy(m);
+    }
     POOL *free_me = m->pool;
-    pthread_mutex_unlock(&m->lock);
+    void *entries = m->entries;
+    memex_list_unlock(m);
+
+    if (m->type == MEMEX_TYPE_QUEUE) {
+        memex_queue_release(m);
+    }
+
+    if (m->type == MEMEX_TYPE_DEQUE) {
+        memex_deque_release(m);
+    }
 
-    free_pool(free_me);
+    if (m->flags & MEMEX_NOSUBPOOL) {
+        pthread_mutex_destroy(&m->lock);
+        if (entries) {
+            pfree(free_me, entries);
+        }
+        pfree(free_me, m);
+    } else {
+        free_pool(free_me);
+    }
 
     trace("%p: destroyed", list);
 }
@@ -465,10 +1470,10 @@ _memex_list_sort_set(MLIST *list, int offset, enum memex_sort_type_e type)
     }
 
     struct memex_list_t *m = (struct memex_list_t *)list;
-    pthread_mutex_lock(&m->lock);
+    memex_list_lock(m);
     m->sort_off = offset;
     m->sort_type = type;
-    pthread_mutex_unlock(&m->lock);
+    memex_list_unlock(m);
 }
 
 void
@@ -488,59 +1493,33 @@ memex_list_sort(MLIST *list)
         }
         return;
     }
-    pthread_mutex_lock(&m->lock);
+
+    if (m->impl) {
+        error("%s: Not supported for this list type", __FUNCTION__);
+        return;
+    }
+    uint8_t *copy = NULL;
+    struct memex_sort_t *sort = NULL;
+
+    memex_list_lock(m);
+    if (memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+    memex_list_linearize(m);
 
     // Copy entries to char buffer
     size_t bytes = m->entry_size * m->n_entry;
-    uint8_t *copy = pcalloc(m->pool, bytes);
+    copy = pcalloc(m->pool, bytes);
     memcpy(copy, m->entries, bytes);
 
     bytes = m->size * sizeof(struct memex_sort_t);
-    struct memex_sort_t *sort = pcalloc(m->pool, bytes);
+    sort = pcalloc(m->pool, bytes);
 
     uint32_t N = m->n_entry;
     for (int n = 0; n < N; n++) {
         uint8_t *e = copy + (n * m->entry_size);
-        uint8_t *ptr = e + m->sort_off;
         int64_t val = 0;
-        double *dval = (double *)&val;
-        switch (m->sort_type) {
-        case MEMEX_SORT_TYPE_DOUBLE:
-            *dval = *(double *)(ptr);
-            break;
-        case MEMEX_SORT_TYPE_FLOAT:
-            *dval = (double)(*(float *)(ptr));
-            break;
-        case MEMEX_SORT_TYPE_UINT64:
-            val = *(uint64_t *)(ptr);
-            break;
-        case MEMEX_SORT_TYPE_INT64:
-            val = *(int64_t *)(ptr);
-            break;
-        case MEMEX_SORT_TYPE_UINT32:
-            val = (int64_t)(*(uint32_t *)(ptr));
-            break;
-        case MEMEX_SORT_TYPE_INT32:
-            val = (int64_t)(*(int32_t *)(ptr));
-            break;
-        case MEMEX_SORT_TYPE_UINT16:
-            val = (int64_t)(*(uint16_t *)(ptr));
-            break;
-        case MEMEX_SORT_TYPE_INT16:
-            val = (int64_t)(*(int16_t *)(ptr));
-            break;
-        case MEMEX_SORT_TYPE_UINT8:
-            val = (int64_t)(*(uint8_t *)(ptr));
-            break;
-        case MEMEX_SORT_TYPE_INT8:
-            val = (int64_t)(*(int8_t *)(ptr));
-            break;
-        case MEMEX_SORT_TYPE_NOINIT:
-            error("Uninitialized sort type");
-            goto do_return;
-
-        default:
-            error("Invalid memex sort type: %d", m->sort_type);
+        if (memex_sort_key(e, m->sort_off, m->sort_type, &val) != 0) {
             goto do_return;
         }
 
@@ -550,34 +1529,197 @@ memex_list_sort(MLIST *list)
     }
 
     memex_merge_sort(sort, N);
+    if (m->index) {
+        memex_index_stale(m);
+    }
     for (int n = 0; n < N; n++) {
         uint8_t *e = m->entries + (n * m->entry_size);
         memcpy(e, sort[n].ptr, m->entry_size);
     }
 
+    if (m->sorted) {
+        m->sorted = MEMEX_SORTED_CLEAN;
+    }
+
 do_return:
-    pfree(m->pool, copy);
-    pthread_mutex_unlock(&m->lock);
+    if (copy) {
+        pfree(m->pool, copy);
+    }
+    if (sort) {
+        pfree(m->pool, sort);
+    }
+    memex_list_unlock(m);
     return;
 }
 
 void
 memex_list_set_step_size(MLIST *list, size_t size)
 {
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return;
+    }
+
+    if (size == 0 || size > UINT32_MAX) {
+        error("%s: Invalid step size (%zd)", __FUNCTION__, size);
+        return;
+    }
+
     struct memex_list_t *m = (struct memex_list_t *)list;
+    memex_list_lock(m);
+    m->step = size;
+    m->growth = 0.0;
+    memex_list_unlock(m);
+
     trace("%p: step_size=%zd", list, size);
 }
 
+/*
+ *  Grow the list geometrically: each expansion multiplies the capacity by
+ *  factor, but never adds fewer than step entries
+ */
+void
+memex_list_set_growth_factor(MLIST *list, double factor)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return;
+    }
+
+    if (factor <= 1.0) {
+        error("%s: Invalid growth factor (%f)", __FUNCTION__, factor);
+        return;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    memex_list_lock(m);
+    m->growth = factor;
+    memex_list_unlock(m);
+
+    trace("%p: growth_factor=%f", list, factor);
+}
+
+int
+memex_list_reserve(MLIST *list, uint32_t n)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return 1;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return 1;
+    }
+
+    if (m->impl) {
+        error("%s: Cannot resize this list type", __FUNCTION__);
+        return 1;
+    }
+
+    int ret = 0;
+    memex_list_lock(m);
+    if (n > m->size && (ret = memex_list_modify(m)) == 0) {
+        // Reserve exactly what was asked for, regardless of growth policy
+        ret = list_resize(m, n);
+    }
+    memex_list_unlock(m);
+
+    return ret;
+}
+
+void
+memex_list_shrink_to_fit(MLIST *list)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return;
+    }
+
+    if (m->impl) {
+        error("%s: Cannot resize this list type", __FUNCTION__);
+        return;
+    }
+
+    memex_list_lock(m);
+    if (m->reserved) {
+        error("%s: List has an open append reservation", __FUNCTION__);
+        goto do_return;
+    }
+
+    if (m->n_entry == m->size || memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+
+    memex_list_linearize(m);
+    if (m->n_entry == 0) {
+        if (m->entries) {
+            pfree(m->pool, m->entries);
+        }
+        m->entries = NULL;
+        m->size = 0;
+        goto do_return;
+    }
+
+    void *entries = repalloc(m->entries, (size_t)m->n_entry * m->entry_size, m->pool);
+    if (entries) {
+        trace("Shrinking list size from %u to %u", m->size, m->n_entry);
+        m->entries = entries;
+        m->size = m->n_entry;
+    }
+
+do_return:
+    memex_list_unlock(m);
+}
+
 void
 memex_list_set_default_step_size(size_t size)
 {
+    if (size == 0 || size > UINT32_MAX) {
+        error("%s: Invalid step size (%zd)", __FUNCTION__, size);
+        return;
+    }
+
     pthread_mutex_lock(&master_lock);
     memex_list_step_size = size;
+    memex_list_growth = 0.0;
     pthread_mutex_unlock(&master_lock);
 
     info("default step_size=%zd", size);
 }
 
+void
+memex_list_set_default_growth_factor(double factor)
+{
+    if (factor <= 1.0) {
+        error("%s: Invalid growth factor (%f)", __FUNCTION__, factor);
+        return;
+    }
+
+    pthread_mutex_lock(&master_lock);
+    memex_list_growth = factor;
+    pthread_mutex_unlock(&master_lock);
+
+    info("default growth_factor=%f", factor);
+}
+
 void
 memex_list_acquire(MLIST *list)
 {
@@ -595,7 +1737,11 @@ memex_list_acquire(MLIST *list)
         }
         return;
     }
-    pthread_mutex_lock(&m->lock);
+    memex_list_lock(m);
+
+    if (m->type == MEMEX_TYPE_QUEUE) {
+        memex_queue_hold(m, 1);
+    }
 }
 
 void
@@ -615,7 +1761,11 @@ memex_list_release(MLIST *list)
         }
         return;
     }
-    pthread_mutex_unlock(&m->lock);
+
+    if (m->type == MEMEX_TYPE_QUEUE) {
+        memex_queue_hold(m, 0);
+    }
+    memex_list_unlock(m);
 }
 
 void
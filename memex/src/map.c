@@ -0,0 +1,589 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <envex.h>
+
+#include "memex.h"
+
+#define LOGEX_TAG "MEMEX-MAP"
+#include "memex-log.h"
+
+#define MAP_EMPTY 0
+#define MAP_TOMB 1
+#define MAP_MIN_CAP 16
+#define MAP_MIGRATE_STEP 16
+
+// Resize once more than 4/5 of the buckets are in use
+#define MAP_FULL(t, n) (((uint64_t)(n) * 5) > ((uint64_t)(t)->cap * 4))
+
+/*
+ *  Open-addressing hash map
+ *
+ *  Each bucket is one slot holding the key's 32-bit hash (0 empty, 1
+ *  tombstone), then the key and the value inline, so a probe touches a
+ *  single cache line.  The hash gives both the Robin Hood probe distance and
+ *  a cheap filter before comparing keys.
+ *
+ *  Growing is incremental: a full table becomes the old table and a table
+ *  of twice the size replaces it.  Every write then moves a few old buckets
+ *  across, so no single insert pays for a whole rehash.  Lookups check the
+ *  new table first and then the old one.  Removing from the old table
+ *  leaves a tombstone, because shifting its entries could move them behind
+ *  the migration cursor.
+ */
+struct map_table_t {
+    char *slots;
+    uint32_t cap;
+    uint32_t count;
+    uint32_t max_dist;
+};
+
+struct memex_map_t {
+    struct map_table_t cur;
+    struct map_table_t old;
+    uint32_t migrate;
+
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t value_off;
+    uint32_t slot_size;
+
+    // Robin Hood swap space: two slots
+    char *tmp;
+
+    pthread_mutex_t lock;
+    int state;
+    POOL *pool;
+};
+
+static inline uint32_t
+map_hash(const void *key, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ len;
+
+    while (len >= 8) {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        h = (h ^ k) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+        p += 8;
+        len -= 8;
+    }
+
+    if (len) {
+        uint64_t k = 0;
+        memcpy(&k, p, len);
+        h = (h ^ k) * 0xFF51AFD7ED558CCDULL;
+    }
+
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+
+    // Keep clear of the empty and tombstone markers
+    uint32_t h32 = (uint32_t)h;
+    return (h32 <= MAP_TOMB) ? h32 + 2 : h32;
+}
+
+#define MAP_KEY_OFF sizeof(uint32_t)
+
+static inline char *
+map_slot(struct memex_map_t *m, struct map_table_t *t, uint32_t i)
+{
+    return t->slots + ((size_t)i * m->slot_size);
+}
+
+static inline uint32_t
+map_slot_hash(const char *slot)
+{
+    return *(const uint32_t *)slot;
+}
+
+static inline void
+map_set_hash(char *slot, uint32_t h)
+{
+    *(uint32_t *)slot = h;
+}
+
+// Common key sizes compare with a constant length, which inlines
+static inline int
+map_key_eq(struct memex_map_t *m, const char *slot, const void *key)
+{
+    slot += MAP_KEY_OFF;
+    switch (m->key_size) {
+    case 4:
+        return memcmp(slot, key, 4) == 0;
+    case 8:
+        return memcmp(slot, key, 8) == 0;
+    case 16:
+        return memcmp(slot, key, 16) == 0;
+    default:
+        return memcmp(slot, key, m->key_size) == 0;
+    }
+}
+
+static inline uint32_t
+map_dist(struct map_table_t *t, uint32_t h, uint32_t i)
+{
+    return (i - h) & (t->cap - 1);
+}
+
+static int
+table_alloc(struct memex_map_t *m, struct map_table_t *t, uint32_t cap)
+{
+    // Zeroed slots are empty, so fresh tables come straight from the allocator
+    t->slots = pcalloc(m->pool, (size_t)cap * m->slot_size);
+    if (!t->slots) {
+        error("%s: Failed to allocate %u buckets", __FUNCTION__, cap);
+        return 1;
+    }
+    t->cap = cap;
+    t->count = 0;
+    t->max_dist = 0;
+
+    return 0;
+}
+
+static void
+table_free(struct memex_map_t *m, struct map_table_t *t)
+{
+    if (t->slots) {
+        pfree(m->pool, t->slots);
+    }
+    memset(t, 0, sizeof(struct map_table_t));
+}
+
+// Bucket holding key, or -1
+static int64_t
+table_find(struct memex_map_t *m, struct map_table_t *t, uint32_t h, const void *key)
+{
+    if (t->count == 0) {
+        return -1;
+    }
+
+    uint32_t mask = t->cap - 1;
+    uint32_t i = h & mask;
+    uint32_t d;
+    for (d = 0; d <= t->max_dist; d++, i = (i + 1) & mask) {
+        char *slot = map_slot(m, t, i);
+        uint32_t bh = map_slot_hash(slot);
+        if (bh == MAP_EMPTY) {
+            return -1;
+        }
+
+        if (bh == h && map_key_eq(m, slot, key)) {
+            return i;
+        }
+
+        // The key would have displaced any entry closer to its home
+        if (bh != MAP_TOMB && map_dist(t, bh, i) < d) {
+            return -1;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ *  Robin Hood insert of a slot that is not in the table: a probing entry
+ *  takes the bucket of any resident closer to its home, and carries the
+ *  resident on.  Returns the bucket the new slot landed in.
+ */
+static uint32_t
+table_insert(struct memex_map_t *m, struct map_table_t *t, const char *slot)
+{
+    uint32_t h = map_slot_hash(slot);
+    uint32_t mask = t->cap - 1;
+    uint32_t i = h & mask;
+    uint32_t d = 0;
+    uint32_t landed = UINT32_MAX;
+
+    char *carry = m->tmp;
+    char *swap = m->tmp + m->slot_size;
+    memcpy(carry, slot, m->slot_size);
+
+    while (1) {
+        char *bucket = map_slot(m, t, i);
+        uint32_t bh = map_slot_hash(bucket);
+        if (bh == MAP_EMPTY) {
+            memcpy(bucket, carry, m->slot_size);
+            if (d > t->max_dist) {
+                t->max_dist = d;
+            }
+            break;
+        }
+
+        uint32_t bd = map_dist(t, bh, i);
+        if (bd < d) {
+            memcpy(swap, bucket, m->slot_size);
+            memcpy(bucket, carry, m->slot_size);
+            if (d > t->max_dist) {
+                t->max_dist = d;
+            }
+            if (landed == UINT32_MAX) {
+                landed = i;
+            }
+
+            char *c = carry;
+            carry = swap;
+            swap = c;
+            h = bh;
+            d = bd;
+        }
+
+        i = (i + 1) & mask;
+        d++;
+    }
+
+    t->count++;
+    return (landed == UINT32_MAX) ? i : landed;
+}
+
+// Remove bucket i from the new table, shifting its probe run back
+static void
+table_remove(struct memex_map_t *m, struct map_table_t *t, uint32_t i)
+{
+    uint32_t mask = t->cap - 1;
+    uint32_t j = (i + 1) & mask;
+    uint32_t h;
+    while ((h = map_slot_hash(map_slot(m, t, j))) > MAP_TOMB && map_dist(t, h, j) > 0) {
+        memcpy(map_slot(m, t, i), map_slot(m, t, j), m->slot_size);
+        i = j;
+        j = (j + 1) & mask;
+    }
+    map_set_hash(map_slot(m, t, i), MAP_EMPTY);
+    t->count--;
+}
+
+// Move up to n old buckets into the new table
+static void
+map_migrate(struct memex_map_t *m, uint32_t n)
+{
+    struct map_table_t *o = &m->old;
+    while (o->cap && n--) {
+        char *slot = map_slot(m, o, m->migrate++);
+        if (map_slot_hash(slot) > MAP_TOMB) {
+            table_insert(m, &m->cur, slot);
+            o->count--;
+        }
+
+        if (m->migrate == o->cap || o->count == 0) {
+            trace("%p: Migration of %u buckets complete", m, o->cap);
+            table_free(m, o);
+            m->migrate = 0;
+        }
+    }
+}
+
+// Start a resize if one more entry would overfill the table
+static int
+map_reserve(struct memex_map_t *m)
+{
+    if (!MAP_FULL(&m->cur, m->cur.count + 1)) {
+        return 0;
+    }
+
+    // A resize is still running: finish it before starting the next
+    if (m->old.cap) {
+        map_migrate(m, m->old.cap);
+        if (!MAP_FULL(&m->cur, m->cur.count + 1)) {
+            return 0;
+        }
+    }
+
+    uint32_t cap = m->cur.cap * 2;
+    if (cap == 0) {
+        error("%s: Map is full (%u entries)", __FUNCTION__, m->cur.count);
+        return 1;
+    }
+
+    struct map_table_t t;
+    if (table_alloc(m, &t, cap) != 0) {
+        return 1;
+    }
+
+    trace("%p: Growing from %u to %u buckets", m, m->cur.cap, cap);
+    m->old = m->cur;
+    m->cur = t;
+    m->migrate = 0;
+
+    return 0;
+}
+
+static inline struct memex_map_t *
+map_valid(MMAP *map, const char *fn)
+{
+    struct memex_map_t *m = (struct memex_map_t *)map;
+    if (!m) {
+        error("%s: Invalid MMAP", fn);
+        return NULL;
+    }
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MMAP: (state = %d)", fn, __LINE__, m->state);
+        }
+        return NULL;
+    }
+
+    return m;
+}
+
+MMAP *
+memex_map_create(POOL *pool, const size_t key_size, const size_t value_size)
+{
+    if (memex_logging_init == 0 && ENVEX_EXISTS("MEMEX_MAP_LOG_LEVEL")) {
+        char lvl[32];
+        ENVEX_COPY(lvl, 32, "MEMEX_MAP_LOG_LEVEL", "");
+        memex_map_set_log_level(lvl);
+    }
+
+    if (key_size == 0 || key_size > UINT16_MAX || value_size > UINT16_MAX) {
+        error("%s: Invalid key/value size (%zd/%zd)", __FUNCTION__, key_size, value_size);
+        return NULL;
+    }
+
+    POOL *p = create_subpool(pool);
+    struct memex_map_t *m = (struct memex_map_t *)pcalloc(p, sizeof(struct memex_map_t));
+    if (!m) {
+        error("%s: Failed to allocate MMAP", __FUNCTION__);
+        free_pool(p);
+        return NULL;
+    }
+    m->pool = p;
+
+    // Slots are [hash | key | value], with the value 8-byte aligned
+    m->key_size = key_size;
+    m->value_size = value_size;
+    m->value_off = (MAP_KEY_OFF + key_size + 7) & ~7U;
+    m->slot_size = (m->value_off + value_size + 7) & ~7U;
+
+    m->tmp = palloc(p, 2 * m->slot_size);
+    if (!m->tmp || table_alloc(m, &m->cur, MAP_MIN_CAP) != 0) {
+        free_pool(p);
+        return NULL;
+    }
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&m->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    m->state = MEMEX_STATE_VALID;
+
+    trace("%p: created (key=%zd, value=%zd)", m, key_size, value_size);
+
+    return (MMAP *)m;
+}
+
+/*
+ *  Insert or overwrite.  Returns the value's address in the map, which is
+ *  valid until the next put or remove.
+ */
+void *
+memex_map_put(MMAP *map, const void *key, const void *value)
+{
+    struct memex_map_t *m = map_valid(map, __FUNCTION__);
+    if (!m) {
+        return NULL;
+    }
+
+    char *ret = NULL;
+    uint32_t h = map_hash(key, m->key_size);
+    pthread_mutex_lock(&m->lock);
+    map_migrate(m, MAP_MIGRATE_STEP);
+
+    int64_t i = table_find(m, &m->cur, h, key);
+    if (i >= 0) {
+        ret = map_slot(m, &m->cur, i) + m->value_off;
+        goto do_copy;
+    }
+
+    // An entry still waiting in the old table moves across now
+    i = table_find(m, &m->old, h, key);
+    if (i >= 0) {
+        map_set_hash(map_slot(m, &m->old, i), MAP_TOMB);
+        m->old.count--;
+    }
+
+    if (map_reserve(m) != 0) {
+        goto do_return;
+    }
+
+    // table_insert() copies the slot out before reusing the scratch space
+    char *slot = m->tmp + m->slot_size;
+    map_set_hash(slot, h);
+    memcpy(slot + MAP_KEY_OFF, key, m->key_size);
+    i = table_insert(m, &m->cur, slot);
+    ret = map_slot(m, &m->cur, i) + m->value_off;
+
+do_copy:
+    if (value) {
+        memcpy(ret, value, m->value_size);
+    } else {
+        memset(ret, 0, m->value_size);
+    }
+
+do_return:
+    pthread_mutex_unlock(&m->lock);
+    return ret;
+}
+
+// Value stored under key, or NULL; valid until the next put or remove
+void *
+memex_map_get(MMAP *map, const void *key)
+{
+    struct memex_map_t *m = map_valid(map, __FUNCTION__);
+    if (!m) {
+        return NULL;
+    }
+
+    char *ret = NULL;
+    uint32_t h = map_hash(key, m->key_size);
+    pthread_mutex_lock(&m->lock);
+
+    int64_t i = table_find(m, &m->cur, h, key);
+    if (i >= 0) {
+        ret = map_slot(m, &m->cur, i) + m->value_off;
+        goto do_return;
+    }
+
+    i = table_find(m, &m->old, h, key);
+    if (i >= 0) {
+        ret = map_slot(m, &m->old, i) + m->value_off;
+    }
+
+do_return:
+    pthread_mutex_unlock(&m->lock);
+    return ret;
+}
+
+// Returns 0 and copies out the value (if value is set) when key was present
+int
+memex_map_remove(MMAP *map, const void *key, void *value)
+{
+    struct memex_map_t *m = map_valid(map, __FUNCTION__);
+    if (!m) {
+        return 1;
+    }
+
+    int ret = 1;
+    uint32_t h = map_hash(key, m->key_size);
+    pthread_mutex_lock(&m->lock);
+    map_migrate(m, MAP_MIGRATE_STEP);
+
+    int64_t i = table_find(m, &m->cur, h, key);
+    if (i >= 0) {
+        if (value) {
+            memcpy(value, map_slot(m, &m->cur, i) + m->value_off, m->value_size);
+        }
+        table_remove(m, &m->cur, i);
+        ret = 0;
+        goto do_return;
+    }
+
+    i = table_find(m, &m->old, h, key);
+    if (i >= 0) {
+        if (value) {
+            memcpy(value, map_slot(m, &m->old, i) + m->value_off, m->value_size);
+        }
+        map_set_hash(map_slot(m, &m->old, i), MAP_TOMB);
+        m->old.count--;
+        ret = 0;
+    }
+
+do_return:
+    pthread_mutex_unlock(&m->lock);
+    return ret;
+}
+
+uint32_t
+memex_map_count(MMAP *map)
+{
+    struct memex_map_t *m = map_valid(map, __FUNCTION__);
+    if (!m) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&m->lock);
+    uint32_t n = m->cur.count + m->old.count;
+    pthread_mutex_unlock(&m->lock);
+
+    return n;
+}
+
+/*
+ *  Call fn on every entry, in no particular order, until it returns
+ *  non-zero.  fn must not put or remove.
+ */
+void
+memex_map_foreach(MMAP *map, memex_map_fn fn, void *ctx)
+{
+    struct memex_map_t *m = map_valid(map, __FUNCTION__);
+    if (!m) {
+        return;
+    }
+
+    pthread_mutex_lock(&m->lock);
+    struct map_table_t *tables[] = {&m->cur, &m->old};
+    int t;
+    for (t = 0; t < 2; t++) {
+        uint32_t i;
+        for (i = 0; i < tables[t]->cap; i++) {
+            char *slot = map_slot(m, tables[t], i);
+            if (map_slot_hash(slot) <= MAP_TOMB) {
+                continue;
+            }
+
+            if (fn(slot + MAP_KEY_OFF, slot + m->value_off, ctx) != 0) {
+                goto do_return;
+            }
+        }
+    }
+
+do_return:
+    pthread_mutex_unlock(&m->lock);
+}
+
+void
+memex_map_clear(MMAP *map)
+{
+    struct memex_map_t *m = map_valid(map, __FUNCTION__);
+    if (!m) {
+        return;
+    }
+
+    pthread_mutex_lock(&m->lock);
+    table_free(m, &m->old);
+    m->migrate = 0;
+    memset(m->cur.slots, 0, (size_t)m->cur.cap * m->slot_size);
+    m->cur.count = 0;
+    m->cur.max_dist = 0;
+    pthread_mutex_unlock(&m->lock);
+}
+
+void
+memex_map_destroy(MMAP *map)
+{
+    struct memex_map_t *m = map_valid(map, __FUNCTION__);
+    if (!m) {
+        return;
+    }
+
+    pthread_mutex_lock(&m->lock);
+    m->state = MEMEX_STATE_FREED;
+    pthread_mutex_unlock(&m->lock);
+
+    pthread_mutex_destroy(&m->lock);
+    free_pool(m->pool);
+
+    trace("%p: destroyed", map);
+}
+
+void
+memex_map_set_log_level(char *level)
+{
+    memex_set_log_level_str(level);
+}
@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "memex.h"
+#include "memex-list.h"
+
+#define LOGEX_TAG "MEMEX-LIST"
+#include "memex-log.h"
+
+#define CACHE_LINE 64
+
+// Below this many entries per thread, extra threads cost more than they save
+#define PARALLEL_MIN_ENTRIES 4096
+
+/*
+ *  Parallel passes over a list
+ *
+ *  The caller's thread takes the list lock once, unwraps a FIFO ring, and
+ *  splits the buffer into one range per thread.  Range boundaries fall on
+ *  cache lines where the entry size allows it, so threads writing entries
+ *  never share a line.  The caller works the first range itself.
+ */
+struct parallel_range_t {
+    struct memex_list_t *m;
+    char *entries;
+    uint32_t n;
+    pthread_t thread;
+
+    memex_list_for_fn for_fn;
+    memex_list_reduce_fn reduce_fn;
+    void *ctx;
+
+    // Private accumulator for a reduce
+    void *acc;
+};
+
+static void *
+parallel_run(void *args)
+{
+    struct parallel_range_t *r = (struct parallel_range_t *)args;
+    size_t es = r->m->entry_size;
+    char *entry = r->entries;
+    char *end = r->entries + ((size_t)r->n * es);
+
+    if (r->for_fn) {
+        for (; entry < end; entry += es) {
+            r->for_fn(entry, r->ctx);
+        }
+    } else {
+        for (; entry < end; entry += es) {
+            r->reduce_fn(r->acc, entry, r->ctx);
+        }
+    }
+
+    return NULL;
+}
+
+static uint32_t
+gcd(uint32_t a, uint32_t b)
+{
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/*
+ *  Split the list into at most n_threads ranges; caller holds the list lock
+ *  and has linearized the list.  Returns the number of ranges.
+ */
+static uint32_t
+parallel_split(struct memex_list_t *m, struct parallel_range_t *r, uint32_t n_threads)
+{
+    size_t es = m->entry_size;
+    uint32_t n_entry = m->n_entry;
+
+    uint32_t max = n_entry / PARALLEL_MIN_ENTRIES;
+    if (n_threads > max) {
+        n_threads = max ? max : 1;
+    }
+
+    // Ranges are multiples of step entries, starting from the first entry
+    // on a cache line boundary
+    uint32_t step = CACHE_LINE / gcd((uint32_t)(es % CACHE_LINE), CACHE_LINE);
+    uint32_t first = 0;
+    while (first < step && ((uintptr_t)m->entries + (first * es)) % CACHE_LINE != 0) {
+        first++;
+    }
+    if (first == step) {
+        first = 0;
+    }
+
+    uint64_t per = (n_entry / n_threads) / step * step;
+    uint32_t start = 0;
+    uint32_t i;
+    for (i = 0; i < n_threads; i++) {
+        uint32_t end = (i == n_threads - 1) ? n_entry : (uint32_t)(first + ((i + 1) * per));
+        r[i].m = m;
+        r[i].entries = (char *)m->entries + ((size_t)start * es);
+        r[i].n = end - start;
+        start = end;
+    }
+
+    return n_threads;
+}
+
+static int
+parallel_list(MLIST *list, const char *fn, struct memex_list_t **out)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", fn);
+        return 1;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", fn, __LINE__, m->state);
+        }
+        return 1;
+    }
+
+    if (m->impl || m->journal) {
+        error("%s: Not supported for this list type", fn);
+        return 1;
+    }
+
+    *out = m;
+    return 0;
+}
+
+static uint32_t
+parallel_threads(uint32_t n_threads)
+{
+    if (n_threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = (n > 0) ? (uint32_t)n : 1;
+    }
+    return n_threads;
+}
+
+// Run every range, the first on this thread; caller holds the list lock
+static void
+parallel_dispatch(struct parallel_range_t *r, uint32_t n)
+{
+    uint32_t i;
+    for (i = 1; i < n; i++) {
+        if (pthread_create(&r[i].thread, NULL, parallel_run, r + i) != 0) {
+            // Out of threads; do it here instead
+            r[i].thread = 0;
+            parallel_run(r + i);
+        }
+    }
+
+    parallel_run(r);
+
+    for (i = 1; i < n; i++) {
+        if (r[i].thread) {
+            pthread_join(r[i].thread, NULL);
+        }
+    }
+}
+
+/*
+ *  Call fn on every entry, from n_threads threads (0 for one per CPU).  fn
+ *  may change the entry it is given, but must not call into the list.
+ */
+int
+memex_list_parallel_for(MLIST *list, memex_list_for_fn fn, void *ctx, uint32_t n_threads)
+{
+    struct memex_list_t *m;
+    if (parallel_list(list, __FUNCTION__, &m) != 0) {
+        return 1;
+    }
+
+    if (!fn) {
+        error("%s: Invalid function", __FUNCTION__);
+        return 1;
+    }
+
+    n_threads = parallel_threads(n_threads);
+    struct parallel_range_t *r = calloc(n_threads, sizeof(struct parallel_range_t));
+    if (!r) {
+        error("%s: Failed to allocate ranges", __FUNCTION__);
+        return 1;
+    }
+
+    int ret = 1;
+    memex_list_lock(m);
+    if (memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+    memex_list_linearize(m);
+
+    uint32_t n = parallel_split(m, r, n_threads);
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        r[i].for_fn = fn;
+        r[i].ctx = ctx;
+    }
+    parallel_dispatch(r, n);
+    ret = 0;
+
+    trace("%p: parallel for over %u entries on %u threads", m, m->n_entry, n);
+
+do_return:
+    memex_list_unlock(m);
+    free(r);
+    return ret;
+}
+
+/*
+ *  Fold every entry into result, from n_threads threads (0 for one per CPU).
+ *  Each thread starts its own accumulator from the initial value of result
+ *  and folds entries into it with fn; combine then merges the accumulators
+ *  into result, in entry order.  result must hold the identity of combine.
+ */
+int
+memex_list_parallel_reduce(MLIST *list, memex_list_reduce_fn fn, memex_list_reduce_fn combine,
+    void *result, size_t result_size, void *ctx, uint32_t n_threads)
+{
+    struct memex_list_t *m;
+    if (parallel_list(list, __FUNCTION__, &m) != 0) {
+        return 1;
+    }
+
+    if (!fn || !combine || !result || result_size == 0) {
+        error("%s: Invalid reduction", __FUNCTION__);
+        return 1;
+    }
+
+    n_threads = parallel_threads(n_threads);
+
+    // Accumulators on their own cache lines
+    size_t acc_size = (result_size + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+    struct parallel_range_t *r = calloc(n_threads, sizeof(struct parallel_range_t));
+    char *accs = NULL;
+    if (!r || posix_memalign((void **)&accs, CACHE_LINE, n_threads * acc_size) != 0) {
+        error("%s: Failed to allocate accumulators", __FUNCTION__);
+        free(r);
+        return 1;
+    }
+
+    // Only the ring is unwrapped; the entries are not written
+    int ret = 1;
+    memex_list_lock(m);
+    if (m->head != 0 && memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+    memex_list_linearize(m);
+
+    uint32_t n = parallel_split(m, r, n_threads);
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        r[i].reduce_fn = fn;
+        r[i].ctx = ctx;
+        r[i].acc = accs + (i * acc_size);
+        memcpy(r[i].acc, result, result_size);
+    }
+    parallel_dispatch(r, n);
+
+    for (i = 0; i < n; i++) {
+        combine(result, r[i].acc, ctx);
+    }
+    ret = 0;
+
+    trace("%p: parallel reduce over %u entries on %u threads", m, m->n_entry, n);
+
+do_return:
+    memex_list_unlock(m);
+    free(accs);
+    free(r);
+    return ret;
+}
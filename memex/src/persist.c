@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "memex.h"
+#include "memex-list.h"
+
+#define LOGEX_TAG "MEMEX-LIST"
+#include "memex-log.h"
+
+#define LIST_FILE_MAGIC "MEMEXLST"
+#define LIST_FILE_VERSION 1
+
+/*
+ *  List files
+ *
+ *  A header page followed by the entries in logical order, in the host's
+ *  byte order.  The entries start on a page boundary so they can be mapped
+ *  straight into a list's buffer: memex_list_map() costs the same for ten
+ *  entries as for ten million, and pages are only read as they are used.
+ */
+struct list_file_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t data_off;
+    uint32_t entry_size;
+    uint32_t n_entry;
+    int32_t type;
+    int32_t sort_type;
+    int32_t sort_off;
+    int32_t sorted;
+};
+
+static inline uint32_t
+file_data_off()
+{
+    long page = sysconf(_SC_PAGESIZE);
+    if (page < (long)sizeof(struct list_file_t)) {
+        page = 4096;
+    }
+    return (uint32_t)page;
+}
+
+static int
+write_all(int fd, const void *buf, size_t bytes)
+{
+    const char *p = (const char *)buf;
+    while (bytes > 0) {
+        ssize_t n = write(fd, p, bytes);
+        if (n < 0) {
+            return 1;
+        }
+        p += n;
+        bytes -= n;
+    }
+    return 0;
+}
+
+/*
+ *  Write a list to path.  The file is written beside path and renamed over
+ *  it, so processes still mapping the old file keep a consistent copy.
+ */
+int
+memex_list_save(MLIST *list, const char *path)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return 1;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return 1;
+    }
+
+    if (m->impl || m->journal) {
+        error("%s: Cannot save this list type", __FUNCTION__);
+        return 1;
+    }
+
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        error("%s: Path too long", __FUNCTION__);
+        return 1;
+    }
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        error("%s: Failed to open %s", __FUNCTION__, tmp);
+        return 1;
+    }
+
+    int ret = 1;
+    char *header = NULL;
+    memex_list_lock(m);
+
+    uint32_t data_off = file_data_off();
+    header = calloc(1, data_off);
+    if (!header) {
+        goto do_return;
+    }
+
+    struct list_file_t *h = (struct list_file_t *)header;
+    memcpy(h->magic, LIST_FILE_MAGIC, sizeof(h->magic));
+    h->version = LIST_FILE_VERSION;
+    h->data_off = data_off;
+    h->entry_size = m->entry_size;
+    h->n_entry = m->n_entry;
+    h->type = m->type;
+    h->sort_type = m->sort_type;
+    h->sort_off = m->sort_off;
+    h->sorted = m->sorted;
+    if (write_all(fd, header, data_off) != 0) {
+        goto do_return;
+    }
+
+    // A FIFO ring is written in two pieces
+    size_t es = m->entry_size;
+    uint32_t n_first = m->n_entry;
+    if (m->head + m->n_entry > m->size) {
+        n_first = m->size - m->head;
+    }
+    if (write_all(fd, (char *)m->entries + (m->head * es), n_first * es) != 0 ||
+        write_all(fd, m->entries, (m->n_entry - n_first) * es) != 0) {
+        goto do_return;
+    }
+    ret = 0;
+
+    trace("%p: saved %u entries to %s", m, m->n_entry, path);
+
+do_return:
+    memex_list_unlock(m);
+    if (header) {
+        free(header);
+    }
+    if (close(fd) != 0) {
+        ret = 1;
+    }
+
+    if (ret == 0 && rename(tmp, path) != 0) {
+        ret = 1;
+    }
+    if (ret != 0) {
+        error("%s: Failed to write %s", __FUNCTION__, path);
+        unlink(tmp);
+    }
+
+    return ret;
+}
+
+/*
+ *  Load a list saved by memex_list_save().  The entry buffer is a private
+ *  copy-on-write mapping of the file: writes stay in this process, and the
+ *  first time the list grows it moves to the heap.
+ */
+MLIST *
+memex_list_map(POOL *pool, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        error("%s: Failed to open %s", __FUNCTION__, path);
+        return NULL;
+    }
+
+    struct memex_list_t *m = NULL;
+    struct list_file_t h;
+    struct stat st;
+    if (read(fd, &h, sizeof(h)) != sizeof(h) || memcmp(h.magic, LIST_FILE_MAGIC, sizeof(h.magic)) != 0) {
+        error("%s: %s is not a list file", __FUNCTION__, path);
+        goto do_return;
+    }
+
+    if (h.version != LIST_FILE_VERSION) {
+        error("%s: Unsupported list file version (%u)", __FUNCTION__, h.version);
+        goto do_return;
+    }
+
+    if (h.entry_size == 0 || (h.data_off % file_data_off()) != 0 ||
+        (h.type != MEMEX_TYPE_LIST && h.type != MEMEX_TYPE_FIFO && h.type != MEMEX_TYPE_STACK)) {
+        error("%s: Invalid list file header", __FUNCTION__);
+        goto do_return;
+    }
+
+    size_t bytes = (size_t)h.n_entry * h.entry_size;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < (uint64_t)h.data_off + bytes) {
+        error("%s: %s is truncated", __FUNCTION__, path);
+        goto do_return;
+    }
+
+    m = (struct memex_list_t *)memex_list_create(pool, h.entry_size);
+    if (!m) {
+        goto do_return;
+    }
+    m->type = h.type;
+    m->sort_type = h.sort_type;
+    m->sort_off = h.sort_off;
+    m->sorted = h.sorted;
+
+    if (h.n_entry > 0) {
+        m->entries = pmmap(m->pool, fd, h.data_off, bytes);
+        if (!m->entries) {
+            memex_list_destroy(m);
+            m = NULL;
+            goto do_return;
+        }
+        m->size = h.n_entry;
+        m->n_entry = h.n_entry;
+    }
+
+    trace("%p: mapped %u entries from %s", m, h.n_entry, path);
+
+do_return:
+    // The mapping holds its own reference to the file
+    close(fd);
+    return (MLIST *)m;
+}
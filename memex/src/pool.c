@@ -23,14 +23,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <sys/mman.h>
 #include <envex.h>
 
 #include "memex.h"
+#include "memex-debug.h"
 
 #define LOGEX_TAG "MEMEX-POOL"
 #include "memex-log.h"
 
 #define RADPOOL_ALLOC_INCREMENT 0x80
+#define RADPOOL_INDEX_THRESHOLD 0x40
 
 static pthread_mutex_t master_lock = PTHREAD_MUTEX_INITIALIZER;
 
@@ -38,28 +41,73 @@ static pthread_mutex_t master_lock = PTHREAD_MUTEX_INITIALIZER;
 struct alloc_info {
     void *addr;
     uint64_t len;
+
+    // Released with munmap(): ALLOC_FILE from pmmap(), ALLOC_RESERVED from
+    // pvreserve()
+    int mapped;
 };
 
+#define ALLOC_FILE 1
+#define ALLOC_RESERVED 2
+
 // Implementation struct
 static struct memex_pool_t {
     struct alloc_info *allocs;
     uint32_t alloc_space;
     uint32_t alloc_count;
+    uint32_t *index;
+    uint32_t index_space;
     struct memex_pool_t **pools;
     uint32_t pool_space;
     uint32_t pool_count;
     struct memex_pool_t *super_pool;
     pthread_mutex_t lock;
+    int flags;
+#ifdef MEMEX_DEBUG
+    struct memex_owner_t owner;
+#endif
     int state;
 } *master_pool = NULL;
 
+// MEMEX_NOLOCK pools skip the mutex
+static inline void
+pool_lock(struct memex_pool_t *p)
+{
+    if (p->flags & MEMEX_NOLOCK) {
+#ifdef MEMEX_DEBUG
+        memex_owner_enter(&p->owner, p);
+#endif
+        return;
+    }
+    pthread_mutex_lock(&p->lock);
+}
+
+static inline void
+pool_unlock(struct memex_pool_t *p)
+{
+    if (p->flags & MEMEX_NOLOCK) {
+#ifdef MEMEX_DEBUG
+        memex_owner_exit(&p->owner);
+#endif
+        return;
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
 static void
-init_pool(POOL *pool)
+init_pool(POOL *pool, int flags)
 {
     struct memex_pool_t *p = (struct memex_pool_t *)pool;
+    p->flags = flags & MEMEX_NOLOCK;
+#ifdef MEMEX_DEBUG
+    atomic_init(&p->owner.thread, 0);
+    p->owner.depth = 0;
+#endif
     p->super_pool = NULL;
     p->alloc_space = RADPOOL_ALLOC_INCREMENT;
     p->alloc_count = 0;
+    p->index = NULL;
+    p->index_space = 0;
     p->pool_space = RADPOOL_ALLOC_INCREMENT;
     p->pool_count = 0;
     p->state = MEMEX_STATE_VALID;
@@ -84,34 +132,117 @@ init_master_pool()
 
     info("Allocating master pool");
     master_pool = malloc(sizeof(struct memex_pool_t));
-    init_pool(master_pool);
+    init_pool(master_pool, 0);
     pthread_mutex_unlock(&master_lock);
 }
 
 /*
- *  Allocate memory in pool
+ *  Address index
+ *
+ *  Open-addressed table of (allocs slot + 1), keyed by address.  Small pools
+ *  are searched linearly; the index is built once a pool tracks more than
+ *  RADPOOL_INDEX_THRESHOLD allocations, so repalloc() and pfree() stay O(1)
+ *  for pools that hold many small objects.
  */
-void *
-palloc(POOL *pool, size_t bytes)
+static inline uint32_t
+index_hash(void *addr, uint32_t space)
 {
-    struct memex_pool_t *p = (struct memex_pool_t*)pool;
+    uint64_t h = (uint64_t)(uintptr_t)addr * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(h >> 32) & (space - 1);
+}
 
-    if (!p) {
-        error("Null pool pointer");
-        return NULL;
+static void
+index_insert(struct memex_pool_t *p, uint32_t slot)
+{
+    uint32_t mask = p->index_space - 1;
+    uint32_t h = index_hash(p->allocs[slot].addr, p->index_space);
+    while (p->index[h]) {
+        h = (h + 1) & mask;
     }
+    p->index[h] = slot + 1;
+}
 
-    if (p->state != MEMEX_STATE_VALID) {
-        if (p->state != MEMEX_STATE_FREED) {
-            error("%s:%d: Invalid Pool: (state = %d)", __FUNCTION__, __LINE__, p->state);
+static void
+index_rebuild(struct memex_pool_t *p, uint32_t space)
+{
+    free(p->index);
+    p->index = calloc(space, sizeof(uint32_t));
+    p->index_space = space;
+    trace("%p:  Buf alloc (%p)", p, p->index);
+
+    uint32_t i;
+    for (i = 0; i < p->alloc_count; i++) {
+        index_insert(p, i);
+    }
+}
+
+static int64_t
+index_find(struct memex_pool_t *p, void *addr)
+{
+    uint32_t mask = p->index_space - 1;
+    uint32_t h = index_hash(addr, p->index_space);
+    while (p->index[h]) {
+        if (p->allocs[p->index[h] - 1].addr == addr) {
+            return h;
         }
-        return NULL;
+        h = (h + 1) & mask;
     }
-    pthread_mutex_lock(&p->lock);
+    return -1;
+}
+
+// Backward-shift deletion keeps every probe sequence unbroken
+static void
+index_remove(struct memex_pool_t *p, uint32_t pos)
+{
+    uint32_t mask = p->index_space - 1;
+    uint32_t i = pos;
+    uint32_t j = pos;
+
+    p->index[i] = 0;
+    while (1) {
+        j = (j + 1) & mask;
+        if (!p->index[j]) {
+            break;
+        }
+
+        // Leave entries whose home slot lies cyclically in (i, j]
+        uint32_t k = index_hash(p->allocs[p->index[j] - 1].addr, p->index_space);
+        if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j))) {
+            continue;
+        }
+
+        p->index[i] = p->index[j];
+        p->index[j] = 0;
+        i = j;
+    }
+}
+
+// Find the allocs slot of an address, or -1
+static int64_t
+alloc_find(struct memex_pool_t *p, void *addr)
+{
+    if (p->index) {
+        int64_t h = index_find(p, addr);
+        return (h < 0) ? -1 : (int64_t)p->index[h] - 1;
+    }
+
+    // Recent allocations are the most likely to be resized or freed
+    uint32_t i;
+    for (i = p->alloc_count; i > 0; i--) {
+        if (p->allocs[i - 1].addr == addr) {
+            return i - 1;
+        }
+    }
+    return -1;
+}
 
+// Record an allocation; caller holds the pool lock
+static void
+alloc_track(struct memex_pool_t *p, void *addr, uint64_t len, int mapped)
+{
     // Resize the allocs array, if necessary
     if (p->alloc_space == p->alloc_count) {
-        uint32_t new_space = p->alloc_space + RADPOOL_ALLOC_INCREMENT;
+        uint32_t new_space = p->alloc_space * 2;
 
         void *a = realloc(p->allocs, new_space * sizeof(struct alloc_info));
         trace("%p:  Buf realloc (%p -> %p)", p, p->allocs, a);
@@ -120,30 +251,166 @@ palloc(POOL *pool, size_t bytes)
         p->alloc_space = new_space;
     }
 
+    uint32_t slot = p->alloc_count++;
+    struct alloc_info *info = p->allocs + slot;
+    info->addr = addr;
+    info->len = len;
+    info->mapped = mapped;
+
+    if (p->index && (p->alloc_count * 2) <= p->index_space) {
+        index_insert(p, slot);
+    } else if (p->index) {
+        index_rebuild(p, p->index_space * 2);
+    } else if (p->alloc_count > RADPOOL_INDEX_THRESHOLD) {
+        index_rebuild(p, RADPOOL_INDEX_THRESHOLD * 4);
+    }
+}
+
+// Forget the allocation in slot; caller holds the pool lock
+static void
+alloc_untrack(struct memex_pool_t *p, uint32_t slot)
+{
+    void *addr = p->allocs[slot].addr;
+
+    // Fill the hole with the last record to keep the allocs array dense
+    uint32_t last = --p->alloc_count;
+    if (p->index) {
+        index_remove(p, index_find(p, addr));
+    }
+    if (slot != last) {
+        if (p->index) {
+            p->index[index_find(p, p->allocs[last].addr)] = slot + 1;
+        }
+        p->allocs[slot] = p->allocs[last];
+    }
+}
+
+static inline void
+alloc_release(struct alloc_info *info)
+{
+    if (info->mapped) {
+        munmap(info->addr, info->len);
+    } else {
+        free(info->addr);
+    }
+}
+
+// Allocate and track; zeroed buffers use calloc, which skips the memset for fresh pages
+static void *
+pool_alloc(POOL *pool, size_t bytes, int zero, const char *fn)
+{
+    struct memex_pool_t *p = (struct memex_pool_t*)pool;
+
+    if (!p) {
+        error("Null pool pointer");
+        return NULL;
+    }
+
+    if (p->state != MEMEX_STATE_VALID) {
+        if (p->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid Pool: (state = %d)", fn, __LINE__, p->state);
+        }
+        return NULL;
+    }
+    pool_lock(p);
+
     // Call malloc and add pointer to allocs array
-    void *addr = malloc(bytes);
+    void *addr = zero ? calloc(1, bytes) : malloc(bytes);
     trace("%p: Data alloc (%p)", pool, addr);
-
-    struct alloc_info *info = p->allocs + p->alloc_count++;
-    info->addr = addr;
-    info->len = bytes;
-    pthread_mutex_unlock(&p->lock);
+    alloc_track(p, addr, bytes, 0);
+    pool_unlock(p);
 
     // Return the allocated memory addr
     return addr;
 }
 
+/*
+ *  Allocate memory in pool
+ */
+void *
+palloc(POOL *pool, size_t bytes)
+{
+    return pool_alloc(pool, bytes, 0, __FUNCTION__);
+}
+
 /*
  *  Allocate memory and zero buffer
  */
 void *
 pcalloc(POOL *pool, size_t bytes)
 {
-    void *addr = palloc(pool, bytes);
-    if (!addr) {
+    return pool_alloc(pool, bytes, 1, __FUNCTION__);
+}
+
+/*
+ *  Map bytes of a file, starting at a page-aligned offset, as private
+ *  copy-on-write memory tracked by pool.  Pages are read on first access and
+ *  writes never reach the file.  repalloc() moves the buffer to the heap.
+ */
+void *
+pmmap(POOL *pool, int fd, off_t offset, size_t bytes)
+{
+    struct memex_pool_t *p = (struct memex_pool_t*)pool;
+
+    if (!p) {
+        error("Null pool pointer");
         return NULL;
     }
-    memset(addr, 0, bytes);
+
+    if (p->state != MEMEX_STATE_VALID) {
+        if (p->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid Pool: (state = %d)", __FUNCTION__, __LINE__, p->state);
+        }
+        return NULL;
+    }
+
+    void *addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+    if (addr == MAP_FAILED) {
+        error("%s: Failed to map %zu bytes at offset %jd", __FUNCTION__, bytes, (intmax_t)offset);
+        return NULL;
+    }
+
+    pool_lock(p);
+    trace("%p: Data map (%p)", pool, addr);
+    alloc_track(p, addr, bytes, ALLOC_FILE);
+    pool_unlock(p);
+
+    return addr;
+}
+
+/*
+ *  Reserve bytes of address space, tracked by pool, without committing any
+ *  memory.  The range is inaccessible until the caller commits pages of it
+ *  with mprotect(); it never moves and cannot be passed to repalloc().
+ */
+void *
+pvreserve(POOL *pool, size_t bytes)
+{
+    struct memex_pool_t *p = (struct memex_pool_t*)pool;
+
+    if (!p) {
+        error("Null pool pointer");
+        return NULL;
+    }
+
+    if (p->state != MEMEX_STATE_VALID) {
+        if (p->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid Pool: (state = %d)", __FUNCTION__, __LINE__, p->state);
+        }
+        return NULL;
+    }
+
+    void *addr = mmap(NULL, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED) {
+        error("%s: Failed to reserve %zu bytes", __FUNCTION__, bytes);
+        return NULL;
+    }
+
+    pool_lock(p);
+    trace("%p: Address reserve (%p, %zu bytes)", pool, addr, bytes);
+    alloc_track(p, addr, bytes, ALLOC_RESERVED);
+    pool_unlock(p);
+
     return addr;
 }
 
@@ -171,20 +438,39 @@ repalloc(void *addr, size_t bytes, POOL *pool)
         }
         return NULL;
     }
-    pthread_mutex_lock(&p->lock);
+    pool_lock(p);
 
     uint32_t i;
     // Search pool for alloc addr
-    for (i = 0; i < p->alloc_count; i++) {
-        if (p->allocs[i].addr == addr) {
-            void *re = p->allocs[i].addr;
-            trace("Reallocating from %zd to %zd bytes", p->allocs[i].len, bytes);
-            re = realloc(re, bytes);
-            p->allocs[i].addr = re;
-            p->allocs[i].len = bytes;
-            ret = re;
+    int64_t slot = alloc_find(p, addr);
+    if (slot >= 0) {
+        struct alloc_info *info = p->allocs + slot;
+        trace("Reallocating from %zd to %zd bytes", info->len, bytes);
+        void *re;
+        if (info->mapped == ALLOC_RESERVED) {
+            error("%s: Cannot reallocate a reserved range", __FUNCTION__);
             goto do_return;
+        } else if (info->mapped) {
+            // A mapping can't grow in place; copy it to the heap
+            re = malloc(bytes);
+            if (!re) {
+                goto do_return;
+            }
+            memcpy(re, addr, (info->len < bytes) ? info->len : bytes);
+            munmap(addr, info->len);
+            info->mapped = 0;
+        } else {
+            re = realloc(addr, bytes);
+        }
+        if (p->index && re != addr) {
+            index_remove(p, index_find(p, addr));
+            info->addr = re;
+            index_insert(p, slot);
         }
+        info->addr = re;
+        info->len = bytes;
+        ret = re;
+        goto do_return;
     }
 
     // Search each sub-pool recursively
@@ -196,7 +482,7 @@ repalloc(void *addr, size_t bytes, POOL *pool)
     }
 
 do_return:
-    pthread_mutex_unlock(&p->lock);
+    pool_unlock(p);
     return ret;
 }
 
@@ -204,7 +490,7 @@ static void
 add_subpool(POOL *pool, POOL *sub)
 {
     struct memex_pool_t *p = (struct memex_pool_t*)pool;
-    pthread_mutex_lock(&p->lock);
+    pool_lock(p);
 
     // Resize the pools array, if necessary
     if (p->pool_space == p->pool_count) {
@@ -222,7 +508,7 @@ add_subpool(POOL *pool, POOL *sub)
     p->pools[p->pool_count++] = (struct memex_pool_t*)sub;
     ((struct memex_pool_t*)sub)->super_pool = p;
 
-    pthread_mutex_unlock(&p->lock);
+    pool_unlock(p);
 }
 
 POOL *
@@ -230,12 +516,12 @@ create_pool_unmanaged()
 {
     info("Allocating unmanaged pool");
     POOL *pool = malloc(sizeof(struct memex_pool_t));
-    init_pool(pool);
+    init_pool(pool, 0);
     return pool;
 }
 
 POOL *
-create_pool()
+create_pool_flags(int flags)
 {
     // Logging init
     if (memex_logging_init == 0 && ENVEX_EXISTS("MEMEX_POOL_LOG_LEVEL")) {
@@ -250,7 +536,7 @@ create_pool()
 
     struct memex_pool_t *p = malloc(sizeof(struct memex_pool_t));
     trace("%p:  Buf alloc (%p)", p, p);
-    init_pool(p);
+    init_pool(p, flags);
 
     // Every pool is a sub of the master pool
     add_subpool(master_pool, p);
@@ -260,7 +546,18 @@ create_pool()
 }
 
 POOL *
-create_subpool(POOL *pool)
+create_pool()
+{
+    return create_pool_flags(0);
+}
+
+/*
+ *  flags: MEMEX_NOLOCK for a pool only ever used by one thread at a time.
+ *  The parent stays locked, so sub-pools can be created and freed from any
+ *  thread.
+ */
+POOL *
+create_subpool_flags(POOL *pool, int flags)
 {
     // Cast to implementation struct
     struct memex_pool_t *p = (struct memex_pool_t*)pool;
@@ -269,13 +566,19 @@ create_subpool(POOL *pool)
     struct memex_pool_t *sub = malloc(sizeof(struct memex_pool_t));
     info("%p: Creating sub pool %p", pool, sub);
     trace("%p:  Buf alloc (%p)", sub, sub);
-    init_pool(sub);
+    init_pool(sub, flags);
 
     add_subpool(p, sub);
 
     return (POOL *)sub;
 }
 
+POOL *
+create_subpool(POOL *pool)
+{
+    return create_subpool_flags(pool, 0);
+}
+
 POOL *
 copy_pool(POOL *pool)
 {
@@ -286,9 +589,14 @@ copy_pool(POOL *pool)
 
     POOL *new = create_pool();
 
-    pthread_mutex_lock(&p->lock);
+    pool_lock(p);
     for (i = 0; i < p->alloc_count; i++) {
         struct alloc_info *src = p->allocs + i;
+        if (src->mapped == ALLOC_RESERVED) {
+            // Only the owner knows which pages are committed
+            error("%s: Skipping reserved range %p", __FUNCTION__, src->addr);
+            continue;
+        }
         char *dst = palloc(new, src->len);
         memcpy(dst, src->addr, src->len);
     }
@@ -297,7 +605,7 @@ copy_pool(POOL *pool)
         POOL *sub = copy_pool((POOL*)p->pools[i]);
         add_subpool(new, sub);
     }
-    pthread_mutex_unlock(&p->lock);
+    pool_unlock(p);
 
     return new;
 }
@@ -311,7 +619,7 @@ unlink_pool(POOL *pool) {
         }
         return NULL;
     }
-    pthread_mutex_lock(&p->lock);
+    pool_lock(p);
 
     // If no parent, there's no need to unlink
     if (!p->super_pool) {
@@ -326,7 +634,7 @@ unlink_pool(POOL *pool) {
         }
         goto no_parent;
     }
-    pthread_mutex_lock(&parent->lock);
+    pool_lock(parent);
 
     // Find this pool in it's parent's pool list
     uint32_t i, j;
@@ -348,10 +656,10 @@ unlink_pool(POOL *pool) {
     }
 
 do_return:
-    pthread_mutex_unlock(&parent->lock);
+    pool_unlock(parent);
 
 no_parent:
-    pthread_mutex_unlock(&p->lock);
+    pool_unlock(p);
 }
 
 // Free allocations in pool
@@ -363,12 +671,13 @@ pfree_allocs(struct memex_pool_t *p)
         struct alloc_info *info = p->allocs + i;
         if (info->addr) {
             trace("%p: Data free (%p)", p, info->addr);
-            free(info->addr);
+            alloc_release(info);
         }
     }
 
     trace("%p:  Buf free (%p)", p, p->allocs);
     free(p->allocs);
+    free(p->index);
 }
 
 // Recursively free pool and sub-pools without unlinking the parent
@@ -383,11 +692,11 @@ pfree_sub(POOL *pool)
         return;
     }
 
-    pthread_mutex_lock(&p->lock);
+    pool_lock(p);
     p->state = MEMEX_STATE_FREED;
-    pthread_mutex_unlock(&p->lock);
+    pool_unlock(p);
 
-    pthread_mutex_lock(&p->lock);
+    pool_lock(p);
     info("%p: Free", pool);
     uint32_t i;
     for (i = 0; i < p->pool_count; i++) {
@@ -398,13 +707,55 @@ pfree_sub(POOL *pool)
     trace("%p:  Buf free (%p)", p, p->pools);
     free(p->pools);
 
-    pthread_mutex_unlock(&p->lock);
+    pool_unlock(p);
     pthread_mutex_destroy(&p->lock);
 
     trace("%p:  Buf free (%p)", p, p);
     free(p);
 }
 
+/*
+ *  Free everything allocated from pool and its sub-pools, but keep the pool
+ *  itself, ready for reuse
+ */
+void
+pool_reset(POOL *pool)
+{
+    struct memex_pool_t *p = (struct memex_pool_t*)pool;
+    if (!p) {
+        error("Null pool pointer");
+        return;
+    }
+
+    if (p->state != MEMEX_STATE_VALID) {
+        if (p->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid Pool: (state = %d)", __FUNCTION__, __LINE__, p->state);
+        }
+        return;
+    }
+
+    pool_lock(p);
+    uint32_t i;
+    for (i = 0; i < p->pool_count; i++) {
+        pfree_sub((POOL *)p->pools[i]);
+    }
+    p->pool_count = 0;
+
+    for (i = 0; i < p->alloc_count; i++) {
+        if (p->allocs[i].addr) {
+            alloc_release(p->allocs + i);
+        }
+    }
+    p->alloc_count = 0;
+
+    free(p->index);
+    p->index = NULL;
+    p->index_space = 0;
+    pool_unlock(p);
+
+    trace("%p: Reset", pool);
+}
+
 void
 free_pool(POOL *pool)
 {
@@ -438,20 +789,64 @@ pfree(POOL *pool, void *addr)
         return;
     }
 
-    pthread_mutex_lock(&p->lock);
-    uint32_t i;
-    for (i = 0; i < p->alloc_count; i++) {
-        struct alloc_info *info = p->allocs + i;
-        if (info->addr != addr) {
-            continue;
-        }
+    pool_lock(p);
+    int64_t slot = alloc_find(p, addr);
+    if (slot < 0) {
+        goto do_return;
+    }
 
-        trace("%p: Data free (%p)", p, info->addr);
-        free(info->addr);
-        info->addr = NULL;
-        info->len = 0;
+    trace("%p: Data free (%p)", p, addr);
+    struct alloc_info info = p->allocs[slot];
+    alloc_untrack(p, slot);
+    alloc_release(&info);
+
+do_return:
+    pool_unlock(p);
+}
+
+/*
+ *  Hand an allocation tracked by src over to dst without copying it
+ */
+int
+pool_move(POOL *src, POOL *dst, void *addr)
+{
+    struct memex_pool_t *s = (struct memex_pool_t *)src;
+    struct memex_pool_t *d = (struct memex_pool_t *)dst;
+
+    if (!s || !d) {
+        error("Null pool pointer");
+        return 1;
     }
-    pthread_mutex_unlock(&p->lock);
+
+    if (s->state != MEMEX_STATE_VALID || d->state != MEMEX_STATE_VALID) {
+        error("%s:%d: Invalid Pool: (state = %d, %d)", __FUNCTION__, __LINE__, s->state, d->state);
+        return 1;
+    }
+
+    if (s == d) {
+        return 0;
+    }
+
+    // The pools are locked one at a time, so moves never deadlock
+    pool_lock(s);
+    int64_t slot = alloc_find(s, addr);
+    if (slot < 0) {
+        pool_unlock(s);
+        error("%s: %p is not tracked by pool %p", __FUNCTION__, addr, src);
+        return 1;
+    }
+    uint64_t len = s->allocs[slot].len;
+    int mapped = s->allocs[slot].mapped;
+    alloc_untrack(s, slot);
+    pool_unlock(s);
+
+    pool_lock(d);
+    alloc_track(d, addr, len, mapped);
+    pool_unlock(d);
+
+    trace("%p: Data moved to %p (%p)", src, dst, addr);
+
+    return 0;
 }
 
 void
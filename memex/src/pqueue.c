@@ -0,0 +1,369 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "memex.h"
+#include "memex-list.h"
+
+#define LOGEX_TAG "MEMEX-LIST"
+#include "memex-log.h"
+
+#define PQUEUE_FREE UINT32_MAX
+
+/*
+ *  Binary heap priority queue
+ *
+ *  Entries live in the list buffer in heap order, keyed by the same typed
+ *  sort descriptor as memex_list_sort().  Every entry carries a handle that
+ *  survives sifting: heap[i] is the handle of the entry in slot i and pos[h]
+ *  the slot of handle h.  Released handles are reused from a free stack, so
+ *  all three arrays are bounded by the list size.
+ */
+struct memex_pqueue_t {
+    uint32_t *heap;
+    uint32_t *pos;
+    uint32_t *free;
+    uint32_t n_handle;
+    uint32_t n_free;
+
+    // Sift scratch entry
+    void *tmp;
+};
+
+MLIST *
+_memex_pqueue_create(POOL *pool, const size_t entry_size, int offset, int type)
+{
+    if (type <= MEMEX_SORT_TYPE_NOINIT || type > MEMEX_SORT_TYPE_INT8) {
+        error("%s: Invalid key type (%d)", __FUNCTION__, type);
+        return NULL;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)memex_list_create(pool, entry_size);
+    if (!m) {
+        return NULL;
+    }
+
+    struct memex_pqueue_t *q = pcalloc(m->pool, sizeof(struct memex_pqueue_t));
+    if (!q || !(q->tmp = palloc(m->pool, entry_size))) {
+        error("%s: Failed to allocate priority queue", __FUNCTION__);
+        memex_list_destroy(m);
+        return NULL;
+    }
+
+    m->type = MEMEX_TYPE_PQUEUE;
+    m->sort_off = offset;
+    m->sort_type = type;
+    m->impl = q;
+
+    trace("%p: priority queue created (key offset=%d, type=%d)", m, offset, type);
+
+    return (MLIST *)m;
+}
+
+static inline char *
+pq_entry(struct memex_list_t *m, uint32_t i)
+{
+    return (char *)m->entries + ((size_t)i * m->entry_size);
+}
+
+static inline int64_t
+pq_key(struct memex_list_t *m, const void *entry)
+{
+    // The key type was validated at creation
+    int64_t val = 0;
+    memex_sort_key(entry, m->sort_off, m->sort_type, &val);
+    return val;
+}
+
+static inline void
+pq_place(struct memex_list_t *m, struct memex_pqueue_t *q, uint32_t i, const void *entry, uint32_t h)
+{
+    memcpy(pq_entry(m, i), entry, m->entry_size);
+    q->heap[i] = h;
+    q->pos[h] = i;
+}
+
+// Move the entry in slot i toward the root while it is smaller than its parent
+static uint32_t
+pq_sift_up(struct memex_list_t *m, struct memex_pqueue_t *q, uint32_t i)
+{
+    uint32_t h = q->heap[i];
+    memcpy(q->tmp, pq_entry(m, i), m->entry_size);
+    int64_t key = pq_key(m, q->tmp);
+
+    while (i > 0) {
+        uint32_t p = (i - 1) / 2;
+        if (memex_sort_cmp(key, pq_key(m, pq_entry(m, p)), m->sort_type) >= 0) {
+            break;
+        }
+        pq_place(m, q, i, pq_entry(m, p), q->heap[p]);
+        i = p;
+    }
+
+    pq_place(m, q, i, q->tmp, h);
+    return i;
+}
+
+// Move the entry in slot i toward the leaves while a child is smaller
+static uint32_t
+pq_sift_down(struct memex_list_t *m, struct memex_pqueue_t *q, uint32_t i)
+{
+    uint32_t h = q->heap[i];
+    memcpy(q->tmp, pq_entry(m, i), m->entry_size);
+    int64_t key = pq_key(m, q->tmp);
+
+    while (1) {
+        uint32_t c = (2 * i) + 1;
+        if (c >= m->n_entry) {
+            break;
+        }
+
+        int64_t ckey = pq_key(m, pq_entry(m, c));
+        if (c + 1 < m->n_entry) {
+            int64_t rkey = pq_key(m, pq_entry(m, c + 1));
+            if (memex_sort_cmp(rkey, ckey, m->sort_type) < 0) {
+                c++;
+                ckey = rkey;
+            }
+        }
+
+        if (memex_sort_cmp(ckey, key, m->sort_type) >= 0) {
+            break;
+        }
+        pq_place(m, q, i, pq_entry(m, c), q->heap[c]);
+        i = c;
+    }
+
+    pq_place(m, q, i, q->tmp, h);
+    return i;
+}
+
+// Grow the entry buffer and the handle arrays, following the list's growth policy
+static int
+pq_grow(struct memex_list_t *m, struct memex_pqueue_t *q)
+{
+    uint64_t inc = m->step;
+    if (m->growth > 1.0 && (uint64_t)(m->size * (m->growth - 1.0)) > inc) {
+        inc = (uint64_t)(m->size * (m->growth - 1.0));
+    }
+
+    uint64_t size = m->size + inc;
+    if (size > UINT32_MAX - 1) {
+        size = UINT32_MAX - 1;
+    }
+    if (size <= m->size) {
+        error("%s: Priority queue is full (%u entries)", __FUNCTION__, m->size);
+        return 1;
+    }
+
+    trace("Expanding priority queue size from %u to %lu", m->size, (unsigned long)size);
+
+    void *entries = repalloc(m->entries, size * m->entry_size, m->pool);
+    if (!entries) {
+        goto do_error;
+    }
+    m->entries = entries;
+
+    uint32_t **arrays[] = {&q->heap, &q->pos, &q->free};
+    int i;
+    for (i = 0; i < 3; i++) {
+        uint32_t *a = repalloc(*arrays[i], size * sizeof(uint32_t), m->pool);
+        if (!a) {
+            goto do_error;
+        }
+        *arrays[i] = a;
+    }
+
+    m->size = (uint32_t)size;
+    return 0;
+
+do_error:
+    error("%s: Failed to expand priority queue to %lu entries", __FUNCTION__, (unsigned long)size);
+    return 1;
+}
+
+static inline struct memex_pqueue_t *
+pq_get(MLIST *list, const char *fn)
+{
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    if (!m) {
+        error("%s: Invalid MLIST", fn);
+        return NULL;
+    }
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", fn, __LINE__, m->state);
+        }
+        return NULL;
+    }
+
+    if (m->type != MEMEX_TYPE_PQUEUE) {
+        error("%s: Not a priority queue", fn);
+        return NULL;
+    }
+
+    return (struct memex_pqueue_t *)m->impl;
+}
+
+int
+memex_pqueue_push(MLIST *list, void *entry, uint32_t *handle)
+{
+    struct memex_pqueue_t *q = pq_get(list, __FUNCTION__);
+    if (!q) {
+        return 1;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    int ret = 1;
+    memex_list_lock(m);
+    if (m->n_entry == m->size && pq_grow(m, q) != 0) {
+        goto do_return;
+    }
+
+    uint32_t h = (q->n_free > 0) ? q->free[--q->n_free] : q->n_handle++;
+    uint32_t i = m->n_entry++;
+    pq_place(m, q, i, entry, h);
+    pq_sift_up(m, q, i);
+
+    if (handle) {
+        *handle = h;
+    }
+    ret = 0;
+
+do_return:
+    memex_list_unlock(m);
+    return ret;
+}
+
+// Take the entry in slot i out of the heap and release its handle
+static void
+pq_take(struct memex_list_t *m, struct memex_pqueue_t *q, uint32_t i, void *entry)
+{
+    uint32_t h = q->heap[i];
+    if (entry) {
+        memcpy(entry, pq_entry(m, i), m->entry_size);
+    }
+    q->pos[h] = PQUEUE_FREE;
+    q->free[q->n_free++] = h;
+
+    // Fill the hole with the last entry and restore the heap around it
+    uint32_t last = --m->n_entry;
+    if (i == last) {
+        return;
+    }
+    pq_place(m, q, i, pq_entry(m, last), q->heap[last]);
+    if (pq_sift_up(m, q, i) == i) {
+        pq_sift_down(m, q, i);
+    }
+}
+
+int
+memex_pqueue_pop(MLIST *list, void *entry, uint32_t *n_entries)
+{
+    if (n_entries) {
+        *n_entries = 0;
+    }
+
+    struct memex_pqueue_t *q = pq_get(list, __FUNCTION__);
+    if (!q) {
+        return 1;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    memex_list_lock(m);
+    if (m->n_entry > 0) {
+        pq_take(m, q, 0, entry);
+        if (n_entries) {
+            *n_entries = 1;
+        }
+    }
+    memex_list_unlock(m);
+
+    return 0;
+}
+
+/*
+ *  Smallest entry, in place; the caller must hold memex_list_acquire() while
+ *  using it
+ */
+void *
+memex_pqueue_peek(MLIST *list)
+{
+    struct memex_pqueue_t *q = pq_get(list, __FUNCTION__);
+    if (!q) {
+        return NULL;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    memex_list_lock(m);
+    void *entry = (m->n_entry > 0) ? m->entries : NULL;
+    memex_list_unlock(m);
+
+    return entry;
+}
+
+/*
+ *  Replace the entry behind a handle, moving it to match its new key.  This
+ *  covers decrease-key as well as increasing a key.
+ */
+int
+memex_pqueue_update(MLIST *list, uint32_t handle, void *entry)
+{
+    struct memex_pqueue_t *q = pq_get(list, __FUNCTION__);
+    if (!q) {
+        return 1;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    int ret = 1;
+    memex_list_lock(m);
+    if (handle >= q->n_handle || q->pos[handle] == PQUEUE_FREE) {
+        error("%s: Invalid handle (%u)", __FUNCTION__, handle);
+        goto do_return;
+    }
+
+    uint32_t i = q->pos[handle];
+    memcpy(pq_entry(m, i), entry, m->entry_size);
+    if (pq_sift_up(m, q, i) == i) {
+        pq_sift_down(m, q, i);
+    }
+    ret = 0;
+
+do_return:
+    memex_list_unlock(m);
+    return ret;
+}
+
+int
+memex_pqueue_remove(MLIST *list, uint32_t handle, void *entry)
+{
+    struct memex_pqueue_t *q = pq_get(list, __FUNCTION__);
+    if (!q) {
+        return 1;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    int ret = 1;
+    memex_list_lock(m);
+    if (handle >= q->n_handle || q->pos[handle] == PQUEUE_FREE) {
+        error("%s: Invalid handle (%u)", __FUNCTION__, handle);
+        goto do_return;
+    }
+
+    pq_take(m, q, q->pos[handle], entry);
+    ret = 0;
+
+do_return:
+    memex_list_unlock(m);
+    return ret;
+}
+
+// Caller holds the list lock
+void
+memex_pqueue_clear(struct memex_list_t *m)
+{
+    struct memex_pqueue_t *q = (struct memex_pqueue_t *)m->impl;
+    q->n_handle = 0;
+    q->n_free = 0;
+}
@@ -0,0 +1,306 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "memex.h"
+#include "memex-list.h"
+
+#define LOGEX_TAG "MEMEX-LIST"
+#include "memex-log.h"
+
+/*
+ *  Blocking bounded multi-producer/multi-consumer queue
+ *
+ *  Entries live in the list's ring (entries, size, head, n_entry) and are
+ *  guarded by the list lock.  Producers wait on not_full, consumers on
+ *  not_empty.  With MEMEX_EVENTFD, a semaphore-mode eventfd holds one count
+ *  per queued entry, so it is readable exactly while the queue is non-empty.
+ *
+ *  The list lock is recursive, and a condition wait only drops one level of
+ *  it.  held counts memex_list_acquire() calls on the queue; while it is
+ *  non-zero the thread holding the lock must not wait, or nothing could ever
+ *  signal it.
+ */
+struct memex_queue_t {
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint32_t held;
+    int closed;
+    int efd;
+};
+
+MLIST *
+memex_queue_create(POOL *pool, const size_t entry_size, uint32_t capacity, int flags)
+{
+    if (capacity == 0) {
+        error("%s: Invalid capacity (%u)", __FUNCTION__, capacity);
+        return NULL;
+    }
+
+    // Blocking needs the list lock
+    if (flags & MEMEX_NOLOCK) {
+        error("%s: MEMEX_NOLOCK is not supported for queues", __FUNCTION__);
+        return NULL;
+    }
+
+    // The queue state is allocated alongside the list and freed with its pool
+    if (flags & MEMEX_NOSUBPOOL) {
+        error("%s: MEMEX_NOSUBPOOL is not supported for queues", __FUNCTION__);
+        return NULL;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)memex_list_create_flags(pool, entry_size, flags);
+    if (!m) {
+        return NULL;
+    }
+
+    struct memex_queue_t *q = pcalloc(m->pool, sizeof(struct memex_queue_t));
+    m->entries = palloc(m->pool, (size_t)capacity * entry_size);
+    if (!q || !m->entries) {
+        error("%s: Failed to allocate queue", __FUNCTION__);
+        memex_list_destroy(m);
+        return NULL;
+    }
+
+    // Timeouts are measured against the monotonic clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&q->not_empty, &attr);
+    pthread_cond_init(&q->not_full, &attr);
+    pthread_condattr_destroy(&attr);
+
+    q->efd = -1;
+    if (flags & MEMEX_EVENTFD) {
+        q->efd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+        if (q->efd < 0) {
+            error("%s: eventfd failed: %s", __FUNCTION__, strerror(errno));
+        }
+    }
+
+    m->type = MEMEX_TYPE_QUEUE;
+    m->size = capacity;
+    m->impl = q;
+
+    trace("%p: queue created (capacity=%u, fd=%d)", m, capacity, q->efd);
+
+    return (MLIST *)m;
+}
+
+// Returns 0 on wakeup, ETIMEDOUT once the deadline passes; the list lock is held
+static int
+queue_wait(struct memex_queue_t *q, pthread_cond_t *cond, pthread_mutex_t *lock,
+    struct timespec *deadline)
+{
+    if (q->held) {
+        error("%s: Cannot block on a queue inside memex_list_acquire()", __FUNCTION__);
+        return ETIMEDOUT;
+    }
+
+    if (!deadline) {
+        return pthread_cond_wait(cond, lock);
+    }
+    return pthread_cond_timedwait(cond, lock, deadline);
+}
+
+static struct timespec *
+queue_deadline(struct timespec *ts, int timeout_ms)
+{
+    if (timeout_ms < 0) {
+        return NULL;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+int
+memex_queue_push_timed(MLIST *list, void *entry, int timeout_ms)
+{
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return 1;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    if (m->type != MEMEX_TYPE_QUEUE) {
+        error("%s: Not a queue", __FUNCTION__);
+        return 1;
+    }
+    struct memex_queue_t *q = (struct memex_queue_t *)m->impl;
+
+    struct timespec ts;
+    struct timespec *deadline = queue_deadline(&ts, timeout_ms);
+
+    int ret = 1;
+    pthread_mutex_lock(&m->lock);
+    while (m->n_entry == m->size && !q->closed) {
+        if (timeout_ms == 0 || queue_wait(q, &q->not_full, &m->lock, deadline) == ETIMEDOUT) {
+            goto do_return;
+        }
+    }
+
+    if (q->closed) {
+        goto do_return;
+    }
+
+    uint32_t slot = (m->head + m->n_entry) % m->size;
+    memcpy((char *)m->entries + ((size_t)slot * m->entry_size), entry, m->entry_size);
+    m->n_entry++;
+
+    if (q->efd >= 0) {
+        uint64_t one = 1;
+        if (write(q->efd, &one, sizeof(one)) != sizeof(one)) {
+            error("%s: eventfd write failed: %s", __FUNCTION__, strerror(errno));
+        }
+    }
+
+    pthread_cond_signal(&q->not_empty);
+    ret = 0;
+
+do_return:
+    pthread_mutex_unlock(&m->lock);
+    return ret;
+}
+
+int
+memex_queue_pop_timed(MLIST *list, void *entry, uint32_t *n_entries, int timeout_ms)
+{
+    if (n_entries) {
+        *n_entries = 0;
+    }
+
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return 1;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    if (m->type != MEMEX_TYPE_QUEUE) {
+        error("%s: Not a queue", __FUNCTION__);
+        return 1;
+    }
+    struct memex_queue_t *q = (struct memex_queue_t *)m->impl;
+
+    struct timespec ts;
+    struct timespec *deadline = queue_deadline(&ts, timeout_ms);
+
+    int ret = 0;
+    pthread_mutex_lock(&m->lock);
+    while (m->n_entry == 0 && !q->closed) {
+        if (timeout_ms == 0 || queue_wait(q, &q->not_empty, &m->lock, deadline) == ETIMEDOUT) {
+            goto do_return;
+        }
+    }
+
+    // A closed queue still drains before reporting the close
+    if (m->n_entry == 0) {
+        ret = 1;
+        goto do_return;
+    }
+
+    memcpy(entry, (char *)m->entries + ((size_t)m->head * m->entry_size), m->entry_size);
+    m->head = (m->head + 1) % m->size;
+    m->n_entry--;
+
+    if (q->efd >= 0) {
+        uint64_t one;
+        if (read(q->efd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN) {
+            error("%s: eventfd read failed: %s", __FUNCTION__, strerror(errno));
+        }
+    }
+
+    pthread_cond_signal(&q->not_full);
+    if (n_entries) {
+        *n_entries = 1;
+    }
+
+do_return:
+    pthread_mutex_unlock(&m->lock);
+    return ret;
+}
+
+int
+memex_queue_get_fd(MLIST *list)
+{
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    if (!m || m->type != MEMEX_TYPE_QUEUE) {
+        error("%s: Not a queue", __FUNCTION__);
+        return -1;
+    }
+
+    return ((struct memex_queue_t *)m->impl)->efd;
+}
+
+void
+memex_queue_close(MLIST *list)
+{
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    if (!m || m->type != MEMEX_TYPE_QUEUE) {
+        error("%s: Not a queue", __FUNCTION__);
+        return;
+    }
+    struct memex_queue_t *q = (struct memex_queue_t *)m->impl;
+
+    pthread_mutex_lock(&m->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&m->lock);
+}
+
+// Called by memex_list_clear() with the list lock held, after the ring is emptied
+void
+memex_queue_clear(struct memex_list_t *m)
+{
+    struct memex_queue_t *q = (struct memex_queue_t *)m->impl;
+
+    // Semaphore mode: each read takes one count, until none are left
+    if (q->efd >= 0) {
+        uint64_t one;
+        while (read(q->efd, &one, sizeof(one)) == sizeof(one)) {
+        }
+        if (errno != EAGAIN) {
+            error("%s: eventfd read failed: %s", __FUNCTION__, strerror(errno));
+        }
+    }
+
+    pthread_cond_broadcast(&q->not_full);
+}
+
+// Called by memex_list_acquire() and memex_list_release() with the list lock held
+void
+memex_queue_hold(struct memex_list_t *m, int held)
+{
+    struct memex_queue_t *q = (struct memex_queue_t *)m->impl;
+
+    if (held) {
+        q->held++;
+    } else if (q->held) {
+        q->held--;
+    }
+}
+
+void
+memex_queue_release(struct memex_list_t *m)
+{
+    struct memex_queue_t *q = (struct memex_queue_t *)m->impl;
+
+    if (q->efd >= 0) {
+        close(q->efd);
+        q->efd = -1;
+    }
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "memex.h"
+#include "memex-list.h"
+
+#define LOGEX_TAG "MEMEX-LIST"
+#include "memex-log.h"
+
+#define SEGLIST_DEFAULT_CHUNK 0x400
+#define SEGLIST_DIR_SIZE 0x400
+#define SEGLIST_PAGE_SIZE 0x400
+#define SEGLIST_PAGE_SHIFT 10
+
+/*
+ *  Segmented list
+ *
+ *  Entries live in fixed-size chunks that are never moved or resized, so
+ *  entry addresses stay valid for the life of the list.  Chunks are found
+ *  through a two-level table: a fixed directory of pages, each holding
+ *  SEGLIST_PAGE_SIZE chunk pointers.  Pages and chunks are allocated on
+ *  first use under the list lock and published with release stores, so
+ *  indexing never takes a lock.
+ */
+struct memex_seglist_t {
+    _Atomic uint64_t n_reserved;
+    uint32_t chunk_shift;
+    uint32_t chunk_mask;
+    uint64_t max_entries;
+    char *_Atomic *_Atomic dir[SEGLIST_DIR_SIZE];
+};
+
+MLIST *
+memex_seglist_create(POOL *pool, const size_t entry_size, uint32_t chunk_entries)
+{
+    if (chunk_entries == 0) {
+        chunk_entries = SEGLIST_DEFAULT_CHUNK;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)memex_list_create(pool, entry_size);
+    if (!m) {
+        return NULL;
+    }
+
+    struct memex_seglist_t *sl = pcalloc(m->pool, sizeof(struct memex_seglist_t));
+    if (!sl) {
+        error("%s: Failed to allocate segmented list", __FUNCTION__);
+        memex_list_destroy(m);
+        return NULL;
+    }
+
+    // Round the chunk size up to a power of two so indexing is shift/mask
+    sl->chunk_shift = 0;
+    while ((1U << sl->chunk_shift) < chunk_entries && sl->chunk_shift < 31) {
+        sl->chunk_shift++;
+    }
+    sl->chunk_mask = (1U << sl->chunk_shift) - 1;
+
+    sl->max_entries = (uint64_t)SEGLIST_DIR_SIZE * SEGLIST_PAGE_SIZE << sl->chunk_shift;
+    if (sl->max_entries > UINT32_MAX) {
+        sl->max_entries = UINT32_MAX;
+    }
+
+    m->type = MEMEX_TYPE_SEGMENTED;
+    m->size = sl->chunk_mask + 1;
+    m->impl = sl;
+
+    trace("%p: segmented list created (chunk=%u)", m, m->size);
+
+    return (MLIST *)m;
+}
+
+static inline char *
+seglist_chunk(struct memex_seglist_t *sl, uint64_t c)
+{
+    char *_Atomic *page = atomic_load_explicit(&sl->dir[c >> SEGLIST_PAGE_SHIFT], memory_order_acquire);
+    if (!page) {
+        return NULL;
+    }
+    return atomic_load_explicit(&page[c & (SEGLIST_PAGE_SIZE - 1)], memory_order_acquire);
+}
+
+// Allocate a missing chunk (and its table page) under the list lock
+static char *
+seglist_chunk_alloc(struct memex_list_t *m, struct memex_seglist_t *sl, uint64_t c)
+{
+    memex_list_lock(m);
+
+    char *chunk = NULL;
+    uint64_t d = c >> SEGLIST_PAGE_SHIFT;
+    char *_Atomic *page = atomic_load_explicit(&sl->dir[d], memory_order_acquire);
+    if (!page) {
+        page = pcalloc(m->pool, SEGLIST_PAGE_SIZE * sizeof(char *));
+        if (!page) {
+            goto do_return;
+        }
+        atomic_store_explicit(&sl->dir[d], page, memory_order_release);
+    }
+
+    uint64_t p = c & (SEGLIST_PAGE_SIZE - 1);
+    chunk = atomic_load_explicit(&page[p], memory_order_acquire);
+    if (!chunk) {
+        chunk = palloc(m->pool, (size_t)m->entry_size << sl->chunk_shift);
+        if (!chunk) {
+            goto do_return;
+        }
+        trace("%p: Allocated chunk %lu", m, (unsigned long)c);
+        atomic_store_explicit(&page[p], chunk, memory_order_release);
+    }
+
+do_return:
+    memex_list_unlock(m);
+    return chunk;
+}
+
+void *
+memex_seglist_new_entry(struct memex_list_t *m, int zero)
+{
+    struct memex_seglist_t *sl = (struct memex_seglist_t *)m->impl;
+
+    // One atomic reserves the slot; appenders never wait on each other
+    uint64_t i = atomic_fetch_add(&sl->n_reserved, 1);
+    if (i >= sl->max_entries) {
+        atomic_fetch_sub(&sl->n_reserved, 1);
+        error("%s: Segmented list is full (%lu entries)", __FUNCTION__, (unsigned long)i);
+        return NULL;
+    }
+
+    uint64_t c = i >> sl->chunk_shift;
+    char *chunk = seglist_chunk(sl, c);
+    if (!chunk) {
+        chunk = seglist_chunk_alloc(m, sl, c);
+        if (!chunk) {
+            error("%s: Failed to allocate chunk", __FUNCTION__);
+
+            // Give the slot back, unless a later append has already reserved past it
+            uint64_t next = i + 1;
+            if (!atomic_compare_exchange_strong(&sl->n_reserved, &next, i)) {
+                error("%s: Entry %lu left unset", __FUNCTION__, (unsigned long)i);
+            }
+            return NULL;
+        }
+    }
+
+    char *entry = chunk + ((size_t)(i & sl->chunk_mask) * m->entry_size);
+    if (zero) {
+        memset(entry, 0, m->entry_size);
+    }
+
+    return entry;
+}
+
+void *
+memex_seglist_get_entry(struct memex_list_t *m, uint32_t index)
+{
+    struct memex_seglist_t *sl = (struct memex_seglist_t *)m->impl;
+    if (index >= atomic_load_explicit(&sl->n_reserved, memory_order_acquire)) {
+        return NULL;
+    }
+
+    char *chunk = seglist_chunk(sl, index >> sl->chunk_shift);
+    if (!chunk) {
+        return NULL;
+    }
+    return chunk + ((size_t)(index & sl->chunk_mask) * m->entry_size);
+}
+
+uint32_t
+memex_seglist_count(struct memex_list_t *m)
+{
+    struct memex_seglist_t *sl = (struct memex_seglist_t *)m->impl;
+    uint64_t n = atomic_load_explicit(&sl->n_reserved, memory_order_acquire);
+    return (n > sl->max_entries) ? (uint32_t)sl->max_entries : (uint32_t)n;
+}
+
+// Chunks are kept for reuse
+void
+memex_seglist_clear(struct memex_list_t *m)
+{
+    struct memex_seglist_t *sl = (struct memex_seglist_t *)m->impl;
+    atomic_store(&sl->n_reserved, 0);
+}
@@ -0,0 +1,284 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "memex.h"
+#include "memex-list.h"
+
+#define LOGEX_TAG "MEMEX-LIST"
+#include "memex-log.h"
+
+/*
+ *  Read-only list snapshots
+ *
+ *  Taking a snapshot moves the list's entry buffer into a standalone pool
+ *  that is shared, refcounted, between the list and its readers.  The list
+ *  keeps using the buffer for reads and pops, which only move head and
+ *  n_entry; the first write to the buffer gives the list a private copy, or
+ *  takes the buffer back if every reader has already let go.  Readers never
+ *  take the list lock, and writers only pay for a copy while a snapshot is
+ *  live.
+ */
+struct memex_snapshot_t {
+    _Atomic uint32_t refs;
+    POOL *pool;
+    void *entries;
+    uint32_t n_entry;
+    uint32_t entry_size;
+};
+
+static void
+snapshot_put(struct memex_snapshot_t *s)
+{
+    if (atomic_fetch_sub_explicit(&s->refs, 1, memory_order_acq_rel) == 1) {
+        trace("%p: snapshot freed", s);
+        free_pool(s->pool);
+    }
+}
+
+/*
+ *  Share the list's buffer as a snapshot; caller holds the list lock.  The
+ *  returned snapshot carries one reference for the caller.
+ */
+static struct memex_snapshot_t *
+snapshot_share(struct memex_list_t *m)
+{
+    struct memex_snapshot_t *s = NULL;
+
+    // Nothing changed since the last snapshot: share its generation
+    if (m->snap && m->head == 0 && m->n_entry == m->snap->n_entry) {
+        s = m->snap;
+        atomic_fetch_add_explicit(&s->refs, 1, memory_order_relaxed);
+        return s;
+    }
+
+    if (m->snap && memex_snapshot_detach(m, 1) != 0) {
+        return NULL;
+    }
+
+    POOL *pool = create_pool();
+    s = pcalloc(pool, sizeof(struct memex_snapshot_t));
+    if (!s) {
+        error("%s: Failed to allocate snapshot", __FUNCTION__);
+        free_pool(pool);
+        return NULL;
+    }
+    s->pool = pool;
+    s->entry_size = m->entry_size;
+    s->n_entry = m->n_entry;
+    atomic_init(&s->refs, 1);
+
+    if (m->n_entry == 0) {
+        return s;
+    }
+
+    memex_list_linearize(m);
+    if (pool_move(m->pool, pool, m->entries) != 0) {
+        error("%s: Failed to share list buffer", __FUNCTION__);
+        free_pool(pool);
+        return NULL;
+    }
+
+    // The list holds a reference until its next write
+    s->entries = m->entries;
+    atomic_store_explicit(&s->refs, 2, memory_order_relaxed);
+    m->snap = s;
+
+    trace("%p: snapshot %p (%u entries)", m, s, s->n_entry);
+    return s;
+}
+
+static struct memex_list_t *
+snapshot_list(MLIST *list, const char *fn)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", fn);
+        return NULL;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", fn, __LINE__, m->state);
+        }
+        return NULL;
+    }
+
+    return m;
+}
+
+MSNAP *
+memex_list_snapshot(MLIST *list)
+{
+    struct memex_list_t *m = snapshot_list(list, __FUNCTION__);
+    if (!m) {
+        return NULL;
+    }
+
+    if (m->impl) {
+        error("%s: Cannot snapshot this list type", __FUNCTION__);
+        return NULL;
+    }
+
+    memex_list_lock(m);
+    struct memex_snapshot_t *s = snapshot_share(m);
+    memex_list_unlock(m);
+
+    return (MSNAP *)s;
+}
+
+/*
+ *  Copy a list without copying its entries.  The copy shares the source's
+ *  buffer the way a snapshot does; whichever list writes first takes a
+ *  private copy, or takes the buffer back if the other has let go.  Taking
+ *  the copy costs the same as a snapshot.  Note that get_entries() and
+ *  get_entry() count as writes, since the caller may change what they
+ *  return.
+ */
+MLIST *
+memex_list_copy_shared(POOL *pool, MLIST *list)
+{
+    struct memex_list_t *m = snapshot_list(list, __FUNCTION__);
+    if (!m) {
+        return NULL;
+    }
+
+    if (m->impl || m->journal) {
+        error("%s: Cannot copy this list type", __FUNCTION__);
+        return NULL;
+    }
+
+    struct memex_list_t *new = NULL;
+    memex_list_lock(m);
+
+    struct memex_snapshot_t *s = snapshot_share(m);
+    if (!s) {
+        goto do_return;
+    }
+
+    new = (struct memex_list_t *)memex_list_create_flags(pool, (const size_t)m->entry_size, m->flags);
+    if (!new) {
+        snapshot_put(s);
+        goto do_return;
+    }
+
+    new->step = m->step;
+    new->growth = m->growth;
+    new->type = m->type;
+    new->sort_type = m->sort_type;
+    new->sort_off = m->sort_off;
+    new->sorted = m->sorted;
+
+    if (!s->entries) {
+        snapshot_put(s);
+        goto do_return;
+    }
+
+    // The copy owns the caller's reference
+    new->entries = s->entries;
+    new->size = m->size;
+    new->n_entry = m->n_entry;
+    new->snap = s;
+
+    trace("%p: shared copy %p of %u entries", m, new, new->n_entry);
+
+do_return:
+    memex_list_unlock(m);
+    return (MLIST *)new;
+}
+
+void *
+memex_snapshot_get_entries(MSNAP *snap, uint32_t *n_entries)
+{
+    struct memex_snapshot_t *s = (struct memex_snapshot_t *)snap;
+    if (!s) {
+        error("%s: Invalid MSNAP", __FUNCTION__);
+        *n_entries = 0;
+        return NULL;
+    }
+
+    *n_entries = s->n_entry;
+    return s->entries;
+}
+
+void *
+memex_snapshot_get_entry(MSNAP *snap, uint32_t index)
+{
+    struct memex_snapshot_t *s = (struct memex_snapshot_t *)snap;
+    if (!s) {
+        error("%s: Invalid MSNAP", __FUNCTION__);
+        return NULL;
+    }
+
+    if (index >= s->n_entry) {
+        return NULL;
+    }
+    return (char *)s->entries + ((size_t)index * s->entry_size);
+}
+
+void
+memex_snapshot_release(MSNAP *snap)
+{
+    if (!snap) {
+        error("%s: Invalid MSNAP", __FUNCTION__);
+        return;
+    }
+    snapshot_put((struct memex_snapshot_t *)snap);
+}
+
+/*
+ *  Stop sharing the list's buffer ahead of a write; caller holds the list
+ *  lock.  With keep set the list gets a private buffer holding the same
+ *  entries, otherwise it is left empty.
+ */
+int
+memex_snapshot_detach(struct memex_list_t *m, int keep)
+{
+    struct memex_snapshot_t *s = m->snap;
+
+    // New readers need the list lock, so a lone reference is ours to take
+    if (atomic_load_explicit(&s->refs, memory_order_acquire) == 1) {
+        if (pool_move(s->pool, m->pool, s->entries) != 0) {
+            return 1;
+        }
+        m->snap = NULL;
+        free_pool(s->pool);
+        return 0;
+    }
+
+    // Reserved slots are being filled in the shared buffer
+    if (m->reserved) {
+        error("%s: List has an open append reservation", __FUNCTION__);
+        return 1;
+    }
+
+    void *entries = NULL;
+    if (keep) {
+        entries = palloc(m->pool, (size_t)m->size * m->entry_size);
+        if (!entries) {
+            error("%s: Failed to copy shared list buffer", __FUNCTION__);
+            return 1;
+        }
+
+        // Pops may have moved the head; the copy starts at the front
+        size_t es = m->entry_size;
+        uint32_t n_first = (m->head + m->n_entry > m->size) ? m->size - m->head : m->n_entry;
+        memcpy(entries, (char *)s->entries + (m->head * es), n_first * es);
+        memcpy((char *)entries + (n_first * es), s->entries, (m->n_entry - n_first) * es);
+        m->head = 0;
+
+        trace("%p: copied %u entries away from snapshot %p", m, m->n_entry, s);
+    } else {
+        m->size = 0;
+        m->n_entry = 0;
+        m->head = 0;
+    }
+
+    m->entries = entries;
+    m->snap = NULL;
+    snapshot_put(s);
+
+    return 0;
+}
@@ -1,11 +1,83 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "memex.h"
+#include "memex-list.h"
 
 #define LOGEX_TAG "MEMEX-LIST"
 #include "memex-log.h"
 
+/*
+ *  Read the typed key at offset off of an entry.  Floating point keys are
+ *  stored as a double's bit pattern, integer keys as their value.
+ */
+int
+memex_sort_key(const void *entry, int off, int type, int64_t *val)
+{
+    const uint8_t *ptr = (const uint8_t *)entry + off;
+    double d;
+
+    switch (type) {
+    case MEMEX_SORT_TYPE_DOUBLE:
+        memcpy(&d, ptr, sizeof(double));
+        memcpy(val, &d, sizeof(double));
+        return 0;
+    case MEMEX_SORT_TYPE_FLOAT:
+        d = (double)(*(float *)(ptr));
+        memcpy(val, &d, sizeof(double));
+        return 0;
+    case MEMEX_SORT_TYPE_UINT64:
+        *val = *(uint64_t *)(ptr);
+        return 0;
+    case MEMEX_SORT_TYPE_INT64:
+        *val = *(int64_t *)(ptr);
+        return 0;
+    case MEMEX_SORT_TYPE_UINT32:
+        *val = (int64_t)(*(uint32_t *)(ptr));
+        return 0;
+    case MEMEX_SORT_TYPE_INT32:
+        *val = (int64_t)(*(int32_t *)(ptr));
+        return 0;
+    case MEMEX_SORT_TYPE_UINT16:
+        *val = (int64_t)(*(uint16_t *)(ptr));
+        return 0;
+    case MEMEX_SORT_TYPE_INT16:
+        *val = (int64_t)(*(int16_t *)(ptr));
+        return 0;
+    case MEMEX_SORT_TYPE_UINT8:
+        *val = (int64_t)(*(uint8_t *)(ptr));
+        return 0;
+    case MEMEX_SORT_TYPE_INT8:
+        *val = (int64_t)(*(int8_t *)(ptr));
+        return 0;
+    case MEMEX_SORT_TYPE_NOINIT:
+        error("Uninitialized sort type");
+        return 1;
+    default:
+        error("Invalid memex sort type: %d", type);
+        return 1;
+    }
+}
+
+// Compare two keys read by memex_sort_key(): <0, 0 or >0
+int
+memex_sort_cmp(int64_t a, int64_t b, int type)
+{
+    if (type == MEMEX_SORT_TYPE_DOUBLE || type == MEMEX_SORT_TYPE_FLOAT) {
+        double da, db;
+        memcpy(&da, &a, sizeof(double));
+        memcpy(&db, &b, sizeof(double));
+        return (da > db) - (da < db);
+    }
+
+    if (type == MEMEX_SORT_TYPE_UINT64) {
+        return ((uint64_t)a > (uint64_t)b) - ((uint64_t)a < (uint64_t)b);
+    }
+
+    return (a > b) - (a < b);
+}
+
 void
 memex_merge_sort(struct memex_sort_t *list, int len)
 {
@@ -50,34 +122,13 @@ memex_merge_sort(struct memex_sort_t *list, int len)
             continue;
         }
 
-        // Handle unsigned 64-bit case
-        if (list->type == MEMEX_SORT_TYPE_UINT64) {
-            if ((uint64_t)b->val < (uint64_t)a->val) {
-                *m++ = *b++;
-                blen--;
-            } else {
-                *m++ = *a++;
-                alen--;
-            }
-
-        // Handle all other integers
-        } else if (list->type >= MEMEX_SORT_TYPE_INT64) {
-            if ((int64_t)b->val < (int64_t)a->val) {
-                *m++ = *b++;
-                blen--;
-            } else {
-                *m++ = *a++;
-                alen--;
-            }
-
-        } else if (list->type >= MEMEX_SORT_TYPE_DOUBLE) {
-            if ((int64_t)b->val < (int64_t)a->val) {
-                *m++ = *b++;
-                blen--;
-            } else {
-                *m++ = *a++;
-                alen--;
-            }
+        // Take from b only when strictly smaller, so the sort is stable
+        if (memex_sort_cmp(b->val, a->val, list->type) < 0) {
+            *m++ = *b++;
+            blen--;
+        } else {
+            *m++ = *a++;
+            alen--;
         }
     }
 
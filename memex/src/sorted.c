@@ -0,0 +1,309 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "memex.h"
+#include "memex-list.h"
+
+#define LOGEX_TAG "MEMEX-LIST"
+#include "memex-log.h"
+
+/*
+ *  Sorted lists
+ *
+ *  A plain list in sorted mode keeps its entries ordered by the sort
+ *  descriptor, so lookups are binary searches over the contiguous buffer.
+ *  Inserts shift the tail of the buffer; bulk loads can instead append with
+ *  memex_list_new_entry(), which marks the list dirty, and the next lookup
+ *  sorts once.
+ */
+int
+_memex_list_set_sorted(MLIST *list, int offset, enum memex_sort_type_e type)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return 1;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return 1;
+    }
+
+    if (m->type != MEMEX_TYPE_LIST || m->impl) {
+        error("%s: Only plain lists can be sorted", __FUNCTION__);
+        return 1;
+    }
+
+    if (type <= MEMEX_SORT_TYPE_NOINIT || type > MEMEX_SORT_TYPE_INT8) {
+        error("%s: Invalid key type (%d)", __FUNCTION__, type);
+        return 1;
+    }
+
+    memex_list_lock(m);
+    m->sort_off = offset;
+    m->sort_type = type;
+    m->sorted = MEMEX_SORTED_DIRTY;
+    memex_list_sort(list);
+    memex_list_unlock(m);
+
+    trace("%p: sorted mode (key offset=%d, type=%d)", m, offset, type);
+
+    return 0;
+}
+
+static inline char *
+sorted_entry(struct memex_list_t *m, uint32_t i)
+{
+    return (char *)m->entries + ((size_t)i * m->entry_size);
+}
+
+// Logical entry i of any list, following a FIFO ring
+static inline char *
+ring_entry(struct memex_list_t *m, uint32_t i)
+{
+    uint32_t slot = m->head + i;
+    if (slot >= m->size) {
+        slot -= m->size;
+    }
+    return (char *)m->entries + ((size_t)slot * m->entry_size);
+}
+
+// First index whose key is >= key (upper: > key); caller holds the lock
+static uint32_t
+sorted_bound(struct memex_list_t *m, int64_t key, int upper)
+{
+    uint32_t lo = 0;
+    uint32_t hi = m->n_entry;
+    while (lo < hi) {
+        uint32_t mid = lo + ((hi - lo) / 2);
+        int64_t val = 0;
+        memex_sort_key(sorted_entry(m, mid), m->sort_off, m->sort_type, &val);
+
+        int c = memex_sort_cmp(val, key, m->sort_type);
+        if (c < 0 || (upper && c == 0)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Validate a sorted list and lock it, sorting any pending appends first
+static struct memex_list_t *
+sorted_acquire(MLIST *list, const char *fn)
+{
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    if (!m) {
+        error("%s: Invalid MLIST", fn);
+        return NULL;
+    }
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", fn, __LINE__, m->state);
+        }
+        return NULL;
+    }
+
+    if (!m->sorted) {
+        error("%s: List is not in sorted mode", fn);
+        return NULL;
+    }
+
+    memex_list_lock(m);
+    if (m->sorted == MEMEX_SORTED_DIRTY) {
+        memex_list_sort(list);
+    }
+    return m;
+}
+
+/*
+ *  Insert a copy of entry after any entries with an equal key, and return
+ *  its address in the list
+ */
+void *
+memex_list_insert(MLIST *list, void *entry)
+{
+    struct memex_list_t *m = sorted_acquire(list, __FUNCTION__);
+    if (!m) {
+        return NULL;
+    }
+
+    // The tail shift would run into the reserved slots
+    char *dst = NULL;
+    if (m->reserved) {
+        error("%s: List has an open append reservation", __FUNCTION__);
+        goto do_return;
+    }
+
+    if (memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+
+    if (m->n_entry >= m->size && memex_list_grow(m, m->n_entry + 1) != 0) {
+        goto do_return;
+    }
+
+    int64_t key = 0;
+    memex_sort_key(entry, m->sort_off, m->sort_type, &key);
+    uint32_t i = sorted_bound(m, key, 1);
+
+    if (i < m->n_entry && m->index) {
+        memex_index_stale(m);
+    }
+
+    dst = sorted_entry(m, i);
+    memmove(dst + m->entry_size, dst, (size_t)(m->n_entry - i) * m->entry_size);
+    memcpy(dst, entry, m->entry_size);
+    m->n_entry++;
+
+do_return:
+    memex_list_unlock(m);
+    return dst;
+}
+
+uint32_t
+memex_list_lower_bound(MLIST *list, void *key)
+{
+    struct memex_list_t *m = sorted_acquire(list, __FUNCTION__);
+    if (!m) {
+        return 0;
+    }
+
+    int64_t val = 0;
+    memex_sort_key(key, 0, m->sort_type, &val);
+    uint32_t i = sorted_bound(m, val, 0);
+    memex_list_unlock(m);
+
+    return i;
+}
+
+uint32_t
+memex_list_upper_bound(MLIST *list, void *key)
+{
+    struct memex_list_t *m = sorted_acquire(list, __FUNCTION__);
+    if (!m) {
+        return 0;
+    }
+
+    int64_t val = 0;
+    memex_sort_key(key, 0, m->sort_type, &val);
+    uint32_t i = sorted_bound(m, val, 1);
+    memex_list_unlock(m);
+
+    return i;
+}
+
+/*
+ *  First entry whose key equals key, or NULL.  Indexed lists look the key up
+ *  in their index, sorted lists are binary searched, and other lists with a
+ *  sort descriptor are scanned.
+ */
+void *
+memex_list_find(MLIST *list, void *key)
+{
+    struct memex_list_t *m = (struct memex_list_t *)list;
+    if (!m) {
+        error("%s: Invalid MLIST", __FUNCTION__);
+        return NULL;
+    }
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", __FUNCTION__, __LINE__, m->state);
+        }
+        return NULL;
+    }
+
+    if (m->sort_type == MEMEX_SORT_TYPE_NOINIT && !m->index) {
+        error("%s: List has no sort key", __FUNCTION__);
+        return NULL;
+    }
+
+    if (m->impl) {
+        error("%s: Not supported for this list type", __FUNCTION__);
+        return NULL;
+    }
+
+    int64_t val = 0;
+    int64_t v = 0;
+    if (!m->index) {
+        memex_sort_key(key, 0, m->sort_type, &val);
+    }
+
+    uint32_t found = UINT32_MAX;
+    if (m->index) {
+        memex_list_lock(m);
+        found = memex_index_find(m, key);
+
+    } else if (m->sorted) {
+        sorted_acquire(list, __FUNCTION__);
+        uint32_t i = sorted_bound(m, val, 0);
+        if (i < m->n_entry) {
+            memex_sort_key(sorted_entry(m, i), m->sort_off, m->sort_type, &v);
+            if (memex_sort_cmp(v, val, m->sort_type) == 0) {
+                found = i;
+            }
+        }
+
+    } else {
+        memex_list_lock(m);
+        uint32_t i;
+        for (i = 0; i < m->n_entry; i++) {
+            memex_sort_key(ring_entry(m, i), m->sort_off, m->sort_type, &v);
+            if (memex_sort_cmp(v, val, m->sort_type) == 0) {
+                found = i;
+                break;
+            }
+        }
+    }
+
+    // The caller may write through the returned entry
+    void *entry = NULL;
+    if (found != UINT32_MAX && memex_list_modify(m) == 0) {
+        entry = ring_entry(m, found);
+    }
+    memex_list_unlock(m);
+
+    return entry;
+}
+
+/*
+ *  Entries with lo <= key <= hi, in place: returns the first and sets
+ *  n_entries.  The caller must hold memex_list_acquire() while using them.
+ */
+void *
+memex_list_get_range(MLIST *list, void *lo, void *hi, uint32_t *n_entries)
+{
+    *n_entries = 0;
+
+    struct memex_list_t *m = sorted_acquire(list, __FUNCTION__);
+    if (!m) {
+        return NULL;
+    }
+
+    void *first = NULL;
+    int64_t klo = 0;
+    int64_t khi = 0;
+    memex_sort_key(lo, 0, m->sort_type, &klo);
+    memex_sort_key(hi, 0, m->sort_type, &khi);
+
+    uint32_t a = sorted_bound(m, klo, 0);
+    uint32_t b = sorted_bound(m, khi, 1);
+    if (a >= b || memex_list_modify(m) != 0) {
+        goto do_return;
+    }
+
+    first = sorted_entry(m, a);
+    *n_entries = b - a;
+
+do_return:
+    memex_list_unlock(m);
+    return first;
+}
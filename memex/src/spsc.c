@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "memex.h"
+#include "memex-list.h"
+
+#define LOGEX_TAG "MEMEX-LIST"
+#include "memex-log.h"
+
+#define CACHE_LINE 64
+
+/*
+ *  Bounded single-producer/single-consumer ring
+ *
+ *  head and tail are free-running counters.  Each side owns one of them and
+ *  keeps a cached copy of the other, so the shared cache line is only read
+ *  when the ring looks full (producer) or empty (consumer).
+ */
+struct memex_spsc_t {
+    // Consumer side
+    _Alignas(CACHE_LINE) _Atomic uint32_t head;
+    uint32_t tail_cache;
+
+    // Producer side
+    _Alignas(CACHE_LINE) _Atomic uint32_t tail;
+    uint32_t head_cache;
+
+    // Read-only after creation
+    _Alignas(CACHE_LINE) uint32_t mask;
+    uint32_t entry_size;
+    char *entries;
+};
+
+MLIST *
+memex_spsc_create(POOL *pool, const size_t entry_size, uint32_t capacity)
+{
+    if (capacity == 0 || capacity > 0x80000000) {
+        error("%s: Invalid capacity (%u)", __FUNCTION__, capacity);
+        return NULL;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)memex_list_create(pool, entry_size);
+    if (!m) {
+        return NULL;
+    }
+
+    // Round up to a power of two so indices wrap with a mask
+    uint32_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    // Pool memory is only malloc-aligned; align the ring to a cache line
+    size_t bytes = sizeof(struct memex_spsc_t) + CACHE_LINE;
+    uintptr_t raw = (uintptr_t)pcalloc(m->pool, bytes);
+    struct memex_spsc_t *q = (struct memex_spsc_t *)((raw + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1));
+
+    q->entries = palloc(m->pool, (size_t)size * entry_size);
+    q->mask = size - 1;
+    q->entry_size = entry_size;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+
+    m->type = MEMEX_TYPE_SPSC;
+    m->size = size;
+    m->impl = q;
+
+    trace("%p: spsc created (capacity=%u)", m, size);
+
+    return (MLIST *)m;
+}
+
+int
+memex_spsc_push(struct memex_list_t *m, void *entry)
+{
+    struct memex_spsc_t *q = (struct memex_spsc_t *)m->impl;
+
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (tail - q->head_cache > q->mask) {
+        q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (tail - q->head_cache > q->mask) {
+            return 1;
+        }
+    }
+
+    memcpy(q->entries + ((size_t)(tail & q->mask) * q->entry_size), entry, q->entry_size);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+
+    return 0;
+}
+
+int
+memex_spsc_pop(struct memex_list_t *m, void *entry, uint32_t *n_entries)
+{
+    struct memex_spsc_t *q = (struct memex_spsc_t *)m->impl;
+    if (n_entries) {
+        *n_entries = 0;
+    }
+
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head == q->tail_cache) {
+        q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if (head == q->tail_cache) {
+            return 0;
+        }
+    }
+
+    memcpy(entry, q->entries + ((size_t)(head & q->mask) * q->entry_size), q->entry_size);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+
+    if (n_entries) {
+        *n_entries = 1;
+    }
+    return 0;
+}
+
+// Either side may call this; the result is a snapshot that may already be stale
+uint32_t
+memex_spsc_count(struct memex_list_t *m)
+{
+    struct memex_spsc_t *q = (struct memex_spsc_t *)m->impl;
+
+    // head first: it can only grow while tail is read, so tail - head >= 0
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    uint32_t n = tail - head;
+    return (n > q->mask + 1) ? q->mask + 1 : n;
+}
@@ -0,0 +1,526 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <envex.h>
+
+#include "memex.h"
+
+#define LOGEX_TAG "MEMEX-TIMER"
+#include "memex-log.h"
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1U << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+// 11 levels of 6 bits cover every 64-bit delta, so nothing overflows
+#define WHEEL_LEVELS 11
+
+// Lists that are not wheel slots
+#define WHERE_DUE (WHEEL_LEVELS * WHEEL_SLOTS)
+#define WHERE_BATCH (WHERE_DUE + 1)
+#define WHERE_LISTS (WHERE_BATCH + 1)
+#define WHERE_FIRING 0xFFFE
+#define WHERE_FREE 0xFFFF
+
+#define NODE_NONE UINT32_MAX
+#define WHEEL_MIN_NODES 64
+
+/*
+ *  Hierarchical timer wheel
+ *
+ *  Level l has 64 slots, each covering 64^l ticks.  A timer goes in the
+ *  lowest level whose span holds its distance from now, in the slot its
+ *  deadline falls in.  When time reaches the start of a slot above level 0,
+ *  the slot's timers are cascaded down relative to the new time; level 0
+ *  slots fire.  Schedule and cancel are a list link and unlink.
+ *
+ *  Each level keeps a bitmap of non-empty slots, so advance() jumps straight
+ *  to the next slot with work instead of stepping every tick.
+ *
+ *  Timers live in one node array, with the caller's entry stored inline
+ *  after the links.  A timer's handle is its node index; freed nodes are
+ *  kept on a free list for reuse.
+ */
+struct wheel_node_t {
+    uint64_t deadline;
+    uint32_t next;
+    uint32_t prev;
+    uint16_t where;
+};
+
+#define NODE_ENTRY_OFF ((sizeof(struct wheel_node_t) + 7) & ~(size_t)7)
+
+struct memex_wheel_t {
+    uint64_t now;
+
+    uint32_t head[WHERE_LISTS];
+    uint64_t occupied[WHEEL_LEVELS];
+
+    char *nodes;
+    uint32_t node_size;
+    uint32_t n_nodes;
+    uint32_t n_used;
+    uint32_t free;
+    uint32_t count;
+
+    uint32_t entry_size;
+
+    // Fired entries are copied out, so callbacks may schedule
+    char *fire;
+
+    pthread_mutex_t lock;
+    int state;
+    POOL *pool;
+};
+
+static inline struct wheel_node_t *
+wheel_node(struct memex_wheel_t *w, uint32_t i)
+{
+    return (struct wheel_node_t *)(w->nodes + ((size_t)i * w->node_size));
+}
+
+static inline void *
+node_entry(struct wheel_node_t *n)
+{
+    return (char *)n + NODE_ENTRY_OFF;
+}
+
+static void
+wheel_link(struct memex_wheel_t *w, uint32_t i, uint16_t where)
+{
+    struct wheel_node_t *n = wheel_node(w, i);
+    n->where = where;
+    n->prev = NODE_NONE;
+    n->next = w->head[where];
+    if (n->next != NODE_NONE) {
+        wheel_node(w, n->next)->prev = i;
+    }
+    w->head[where] = i;
+
+    if (where < WHERE_DUE) {
+        w->occupied[where >> WHEEL_BITS] |= 1ULL << (where & WHEEL_MASK);
+    }
+}
+
+static void
+wheel_unlink(struct memex_wheel_t *w, uint32_t i)
+{
+    struct wheel_node_t *n = wheel_node(w, i);
+    uint16_t where = n->where;
+
+    if (n->prev != NODE_NONE) {
+        wheel_node(w, n->prev)->next = n->next;
+    } else {
+        w->head[where] = n->next;
+    }
+    if (n->next != NODE_NONE) {
+        wheel_node(w, n->next)->prev = n->prev;
+    }
+
+    if (where < WHERE_DUE && w->head[where] == NODE_NONE) {
+        w->occupied[where >> WHEEL_BITS] &= ~(1ULL << (where & WHEEL_MASK));
+    }
+}
+
+// Slot for a deadline, relative to the wheel's current time
+static uint16_t
+wheel_where(struct memex_wheel_t *w, uint64_t deadline)
+{
+    if (deadline <= w->now) {
+        return WHERE_DUE;
+    }
+
+    uint64_t delta = deadline - w->now;
+    uint32_t level = 0;
+    if (delta >= WHEEL_SLOTS) {
+        level = (63 - __builtin_clzll(delta)) / WHEEL_BITS;
+    }
+
+    uint32_t slot = (deadline >> (level * WHEEL_BITS)) & WHEEL_MASK;
+    return (uint16_t)((level << WHEEL_BITS) | slot);
+}
+
+static int
+wheel_grow(struct memex_wheel_t *w)
+{
+    uint32_t n = w->n_nodes * 2;
+    if (n <= w->n_nodes) {
+        error("%s: Timer wheel is full (%u timers)", __FUNCTION__, w->count);
+        return 1;
+    }
+
+    char *nodes = repalloc(w->nodes, (size_t)n * w->node_size, w->pool);
+    if (!nodes) {
+        error("%s: Failed to grow timer wheel to %u timers", __FUNCTION__, n);
+        return 1;
+    }
+    w->nodes = nodes;
+    w->n_nodes = n;
+
+    trace("%p: grown to %u timers", w, n);
+    return 0;
+}
+
+static uint32_t
+node_alloc(struct memex_wheel_t *w)
+{
+    uint32_t i = w->free;
+    if (i != NODE_NONE) {
+        w->free = wheel_node(w, i)->next;
+        return i;
+    }
+
+    if (w->n_used == w->n_nodes && wheel_grow(w) != 0) {
+        return NODE_NONE;
+    }
+    return w->n_used++;
+}
+
+static void
+node_free(struct memex_wheel_t *w, uint32_t i)
+{
+    struct wheel_node_t *n = wheel_node(w, i);
+    n->where = WHERE_FREE;
+    n->next = w->free;
+    w->free = i;
+    w->count--;
+}
+
+/*
+ *  Earliest tick after now with work: a level 0 slot to fire, or the start
+ *  of a higher slot to cascade.  The slot under the current position of a
+ *  level belongs to its next lap.
+ */
+static uint64_t
+wheel_next(struct memex_wheel_t *w)
+{
+    uint64_t next = UINT64_MAX;
+    uint32_t l;
+    for (l = 0; l < WHEEL_LEVELS; l++) {
+        uint64_t bits = w->occupied[l];
+        if (!bits) {
+            continue;
+        }
+
+        uint32_t shift = l * WHEEL_BITS;
+        uint32_t pos = (w->now >> shift) & WHEEL_MASK;
+        uint64_t lap = (w->now >> shift) & ~(uint64_t)WHEEL_MASK;
+        uint64_t ahead = (pos == WHEEL_MASK) ? 0 : bits & (~0ULL << (pos + 1));
+
+        uint64_t t;
+        if (ahead) {
+            t = (lap + __builtin_ctzll(ahead)) << shift;
+        } else if (l == WHEEL_LEVELS - 1) {
+            // The top level never laps within 64 bits
+            continue;
+        } else {
+            t = (lap + WHEEL_SLOTS + __builtin_ctzll(bits)) << shift;
+        }
+
+        if (t < next) {
+            next = t;
+        }
+    }
+
+    return next;
+}
+
+// Move a slot's timers down, relative to the current time
+static void
+wheel_cascade(struct memex_wheel_t *w, uint16_t where)
+{
+    uint32_t i = w->head[where];
+    w->head[where] = NODE_NONE;
+    w->occupied[where >> WHEEL_BITS] &= ~(1ULL << (where & WHEEL_MASK));
+
+    while (i != NODE_NONE) {
+        struct wheel_node_t *n = wheel_node(w, i);
+        uint32_t next = n->next;
+
+        // Due on this very tick: fire with the level 0 slot under it
+        uint16_t to = wheel_where(w, n->deadline);
+        if (to == WHERE_DUE) {
+            to = (uint16_t)(w->now & WHEEL_MASK);
+        }
+        wheel_link(w, i, to);
+        i = next;
+    }
+}
+
+/*
+ *  Fire every timer on a list.  The list is moved to the batch list first,
+ *  so a callback may cancel timers from the same batch or schedule new ones.
+ */
+static uint32_t
+wheel_fire(struct memex_wheel_t *w, uint16_t where, memex_timer_fn fn, void *ctx)
+{
+    uint32_t i = w->head[where];
+    if (i == NODE_NONE) {
+        return 0;
+    }
+
+    w->head[where] = NODE_NONE;
+    if (where < WHERE_DUE) {
+        w->occupied[where >> WHEEL_BITS] &= ~(1ULL << (where & WHEEL_MASK));
+    }
+
+    w->head[WHERE_BATCH] = i;
+    for (; i != NODE_NONE; i = wheel_node(w, i)->next) {
+        wheel_node(w, i)->where = WHERE_BATCH;
+    }
+
+    uint32_t fired = 0;
+    while ((i = w->head[WHERE_BATCH]) != NODE_NONE) {
+        struct wheel_node_t *n = wheel_node(w, i);
+        wheel_unlink(w, i);
+        n->where = WHERE_FIRING;
+
+        uint64_t deadline = n->deadline;
+        memcpy(w->fire, node_entry(n), w->entry_size);
+        node_free(w, i);
+
+        if (fn) {
+            fn(w->fire, deadline, ctx);
+        }
+        fired++;
+    }
+
+    return fired;
+}
+
+static struct memex_wheel_t *
+wheel_valid(MWHEEL *wheel, const char *fn)
+{
+    // Dereference input pointer
+    if (!wheel) {
+        error("%s: Invalid MWHEEL", fn);
+        return NULL;
+    }
+    struct memex_wheel_t *w = (struct memex_wheel_t *)wheel;
+
+    if (w->state != MEMEX_STATE_VALID) {
+        if (w->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MWHEEL: (state = %d)", fn, __LINE__, w->state);
+        }
+        return NULL;
+    }
+
+    return w;
+}
+
+/*
+ *  Create a timer wheel holding entries of entry_size bytes.  Times are
+ *  plain 64-bit ticks in whatever unit the caller advances by; now is the
+ *  starting time.
+ */
+MWHEEL *
+memex_timer_wheel_create(POOL *pool, const size_t entry_size, uint64_t now)
+{
+    if (memex_logging_init == 0 && ENVEX_EXISTS("MEMEX_TIMER_LOG_LEVEL")) {
+        char lvl[32];
+        ENVEX_COPY(lvl, 32, "MEMEX_TIMER_LOG_LEVEL", "");
+        memex_timer_set_log_level(lvl);
+    }
+
+    if (entry_size > UINT16_MAX) {
+        error("%s: Invalid entry size (%zd)", __FUNCTION__, entry_size);
+        return NULL;
+    }
+
+    POOL *p = create_subpool(pool);
+    struct memex_wheel_t *w = (struct memex_wheel_t *)pcalloc(p, sizeof(struct memex_wheel_t));
+    if (!w) {
+        error("%s: Failed to allocate MWHEEL", __FUNCTION__);
+        free_pool(p);
+        return NULL;
+    }
+    w->pool = p;
+    w->now = now;
+
+    w->entry_size = entry_size;
+    w->node_size = (NODE_ENTRY_OFF + entry_size + 7) & ~7U;
+    w->n_nodes = WHEEL_MIN_NODES;
+    w->free = NODE_NONE;
+    memset(w->head, 0xFF, sizeof(w->head));
+
+    w->nodes = palloc(p, (size_t)w->n_nodes * w->node_size);
+    w->fire = palloc(p, entry_size ? entry_size : 1);
+    if (!w->nodes || !w->fire) {
+        error("%s: Failed to allocate timers", __FUNCTION__);
+        free_pool(p);
+        return NULL;
+    }
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&w->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    w->state = MEMEX_STATE_VALID;
+
+    trace("%p: created (entry=%zd, now=%lu)", w, entry_size, (unsigned long)now);
+
+    return (MWHEEL *)w;
+}
+
+/*
+ *  Arm a timer for deadline, copying entry into the wheel.  A deadline at
+ *  or before the current time fires on the next advance.  The handle stays
+ *  valid until the timer fires or is cancelled.
+ */
+int
+memex_timer_schedule(MWHEEL *wheel, uint64_t deadline, const void *entry, uint32_t *handle)
+{
+    struct memex_wheel_t *w = wheel_valid(wheel, __FUNCTION__);
+    if (!w) {
+        return 1;
+    }
+
+    int ret = 1;
+    pthread_mutex_lock(&w->lock);
+
+    uint32_t i = node_alloc(w);
+    if (i == NODE_NONE) {
+        goto do_return;
+    }
+
+    struct wheel_node_t *n = wheel_node(w, i);
+    n->deadline = deadline;
+    if (entry) {
+        memcpy(node_entry(n), entry, w->entry_size);
+    } else {
+        memset(node_entry(n), 0, w->entry_size);
+    }
+    wheel_link(w, i, wheel_where(w, deadline));
+    w->count++;
+
+    if (handle) {
+        *handle = i;
+    }
+    ret = 0;
+
+do_return:
+    pthread_mutex_unlock(&w->lock);
+    return ret;
+}
+
+/*
+ *  Disarm a timer, copying its entry out if entry is not NULL.  Fails for a
+ *  timer that has already fired.
+ */
+int
+memex_timer_cancel(MWHEEL *wheel, uint32_t handle, void *entry)
+{
+    struct memex_wheel_t *w = wheel_valid(wheel, __FUNCTION__);
+    if (!w) {
+        return 1;
+    }
+
+    int ret = 1;
+    pthread_mutex_lock(&w->lock);
+
+    struct wheel_node_t *n;
+    if (handle >= w->n_used ||
+        (n = wheel_node(w, handle))->where == WHERE_FREE || n->where == WHERE_FIRING) {
+        error("%s: Invalid handle (%u)", __FUNCTION__, handle);
+        goto do_return;
+    }
+
+    wheel_unlink(w, handle);
+    if (entry) {
+        memcpy(entry, node_entry(n), w->entry_size);
+    }
+    node_free(w, handle);
+    ret = 0;
+
+do_return:
+    pthread_mutex_unlock(&w->lock);
+    return ret;
+}
+
+/*
+ *  Move the wheel forward to now, calling fn on every timer whose deadline
+ *  has passed, in deadline order between slots.  Timers that share a tick
+ *  fire together as one batch.  fn gets a copy of the entry and may schedule
+ *  or cancel, but not advance; timers it schedules for now or earlier fire
+ *  on the next call.
+ *  Returns the number of timers fired.
+ */
+uint32_t
+memex_timer_advance(MWHEEL *wheel, uint64_t now, memex_timer_fn fn, void *ctx)
+{
+    struct memex_wheel_t *w = wheel_valid(wheel, __FUNCTION__);
+    if (!w) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    uint32_t fired = wheel_fire(w, WHERE_DUE, fn, ctx);
+
+    while (w->now < now) {
+        uint64_t next = wheel_next(w);
+        if (next > now) {
+            w->now = now;
+            break;
+        }
+        w->now = next;
+
+        // A tick with the low bits of a level clear starts that level's slot
+        uint32_t l;
+        for (l = 1; l < WHEEL_LEVELS; l++) {
+            uint32_t shift = l * WHEEL_BITS;
+            if (next & ((1ULL << shift) - 1)) {
+                break;
+            }
+            wheel_cascade(w, (uint16_t)((l << WHEEL_BITS) | ((next >> shift) & WHEEL_MASK)));
+        }
+
+        fired += wheel_fire(w, (uint16_t)(next & WHEEL_MASK), fn, ctx);
+    }
+
+    pthread_mutex_unlock(&w->lock);
+
+    if (fired) {
+        trace("%p: fired %u timers at %lu", w, fired, (unsigned long)now);
+    }
+    return fired;
+}
+
+uint32_t
+memex_timer_count(MWHEEL *wheel)
+{
+    struct memex_wheel_t *w = wheel_valid(wheel, __FUNCTION__);
+    if (!w) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    uint32_t count = w->count;
+    pthread_mutex_unlock(&w->lock);
+    return count;
+}
+
+void
+memex_timer_wheel_destroy(MWHEEL *wheel)
+{
+    struct memex_wheel_t *w = wheel_valid(wheel, __FUNCTION__);
+    if (!w) {
+        return;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    w->state = MEMEX_STATE_FREED;
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_mutex_destroy(&w->lock);
+    free_pool(w->pool);
+
+    trace("%p: destroyed", wheel);
+}
+
+void
+memex_timer_set_log_level(char *level)
+{
+    memex_set_log_level_str(level);
+}
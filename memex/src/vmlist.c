@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+#include "memex.h"
+#include "memex-list.h"
+
+#define LOGEX_TAG "MEMEX-LIST"
+#include "memex-log.h"
+
+// Commit at least this much at a time, so small entries don't mprotect() per page
+#define VMLIST_COMMIT_MIN 0x100000
+
+/*
+ *  Reserved-range list
+ *
+ *  The list reserves address space for max_entries up front and commits
+ *  pages of it as entries are added, doubling the committed size each time.
+ *  Entries never move and growth never copies.  Counts are 64-bit; the
+ *  generic list calls see at most UINT32_MAX entries, and the memex_vmlist
+ *  calls see all of them.
+ *
+ *  Appends reserve their slot with one atomic, as in a segmented list, and
+ *  only take the list lock to commit more pages.  Readers treat a slot as
+ *  present once its pages are committed.
+ */
+struct memex_vmlist_t {
+    _Atomic uint64_t n_reserved;
+    _Atomic uint64_t committed;
+    uint64_t max_entries;
+    uint64_t bytes;
+    char *base;
+};
+
+MLIST *
+memex_vmlist_create(POOL *pool, const size_t entry_size, uint64_t max_entries)
+{
+    if (entry_size == 0 || max_entries == 0 || max_entries > UINT64_MAX / entry_size) {
+        error("%s: Invalid list size (%zd x %lu)", __FUNCTION__, entry_size,
+            (unsigned long)max_entries);
+        return NULL;
+    }
+
+    struct memex_list_t *m = (struct memex_list_t *)memex_list_create(pool, entry_size);
+    if (!m) {
+        return NULL;
+    }
+
+    struct memex_vmlist_t *vl = pcalloc(m->pool, sizeof(struct memex_vmlist_t));
+    if (!vl) {
+        error("%s: Failed to allocate reserved list", __FUNCTION__);
+        memex_list_destroy(m);
+        return NULL;
+    }
+
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    vl->bytes = ((max_entries * entry_size) + page - 1) & ~(page - 1);
+    vl->max_entries = max_entries;
+    vl->base = pvreserve(m->pool, vl->bytes);
+    if (!vl->base) {
+        memex_list_destroy(m);
+        return NULL;
+    }
+
+    m->type = MEMEX_TYPE_RESERVED;
+    m->impl = vl;
+
+    trace("%p: reserved list created (%lu bytes)", m, (unsigned long)vl->bytes);
+
+    return (MLIST *)m;
+}
+
+// Commit pages until entry i is backed, under the list lock
+static int
+vmlist_commit(struct memex_list_t *m, struct memex_vmlist_t *vl, uint64_t i)
+{
+    int ret = 1;
+    memex_list_lock(m);
+
+    uint64_t need = (i + 1) * m->entry_size;
+    uint64_t committed = atomic_load_explicit(&vl->committed, memory_order_relaxed);
+    if (need <= committed) {
+        ret = 0;
+        goto do_return;
+    }
+
+    uint64_t size = committed ? committed * 2 : VMLIST_COMMIT_MIN;
+    while (size < need) {
+        size *= 2;
+    }
+    if (size > vl->bytes) {
+        size = vl->bytes;
+    }
+
+    if (mprotect(vl->base + committed, size - committed, PROT_READ | PROT_WRITE) != 0) {
+        error("%s: Failed to commit %lu bytes", __FUNCTION__, (unsigned long)size);
+        goto do_return;
+    }
+    atomic_store_explicit(&vl->committed, size, memory_order_release);
+    ret = 0;
+
+    trace("%p: Committed %lu bytes", m, (unsigned long)size);
+
+do_return:
+    memex_list_unlock(m);
+    return ret;
+}
+
+void *
+memex_vmlist_new_entry(struct memex_list_t *m, int zero)
+{
+    struct memex_vmlist_t *vl = (struct memex_vmlist_t *)m->impl;
+
+    uint64_t i = atomic_fetch_add(&vl->n_reserved, 1);
+    if (i >= vl->max_entries) {
+        atomic_fetch_sub(&vl->n_reserved, 1);
+        error("%s: Reserved list is full (%lu entries)", __FUNCTION__, (unsigned long)i);
+        return NULL;
+    }
+
+    uint64_t end = (i + 1) * m->entry_size;
+    if (end > atomic_load_explicit(&vl->committed, memory_order_acquire) &&
+        vmlist_commit(m, vl, i) != 0) {
+        // Give the slot back, unless a later append has already reserved past it
+        uint64_t next = i + 1;
+        if (!atomic_compare_exchange_strong(&vl->n_reserved, &next, i)) {
+            error("%s: Entry %lu left unset", __FUNCTION__, (unsigned long)i);
+        }
+        return NULL;
+    }
+
+    // Fresh pages are already zero, but cleared slots are not
+    char *entry = vl->base + (i * m->entry_size);
+    if (zero) {
+        memset(entry, 0, m->entry_size);
+    }
+
+    return entry;
+}
+
+// Entries whose pages are committed; caller has checked the list
+static inline uint64_t
+vmlist_count(struct memex_list_t *m, struct memex_vmlist_t *vl)
+{
+    uint64_t n = atomic_load_explicit(&vl->n_reserved, memory_order_acquire);
+    uint64_t backed = atomic_load_explicit(&vl->committed, memory_order_acquire) / m->entry_size;
+    if (n > vl->max_entries) {
+        n = vl->max_entries;
+    }
+    return (n < backed) ? n : backed;
+}
+
+static inline void *
+vmlist_entry(struct memex_list_t *m, struct memex_vmlist_t *vl, uint64_t index)
+{
+    if (index >= vmlist_count(m, vl)) {
+        return NULL;
+    }
+    return vl->base + (index * m->entry_size);
+}
+
+void *
+memex_vmlist_list_get_entry(struct memex_list_t *m, uint32_t index)
+{
+    return vmlist_entry(m, (struct memex_vmlist_t *)m->impl, index);
+}
+
+uint32_t
+memex_vmlist_list_count(struct memex_list_t *m)
+{
+    uint64_t n = vmlist_count(m, (struct memex_vmlist_t *)m->impl);
+    return (n > UINT32_MAX) ? UINT32_MAX : (uint32_t)n;
+}
+
+// Committed pages are kept for reuse
+void
+memex_vmlist_clear(struct memex_list_t *m)
+{
+    struct memex_vmlist_t *vl = (struct memex_vmlist_t *)m->impl;
+    atomic_store(&vl->n_reserved, 0);
+}
+
+static struct memex_list_t *
+vmlist_valid(MLIST *list, const char *fn)
+{
+    // Dereference input pointer
+    if (!list) {
+        error("%s: Invalid MLIST", fn);
+        return NULL;
+    }
+    struct memex_list_t *m = (struct memex_list_t *)list;
+
+    if (m->state != MEMEX_STATE_VALID) {
+        if (m->state != MEMEX_STATE_FREED) {
+            error("%s:%d: Invalid MLIST: (state = %d)", fn, __LINE__, m->state);
+        }
+        return NULL;
+    }
+
+    if (m->type != MEMEX_TYPE_RESERVED) {
+        error("%s: Not a reserved list", fn);
+        return NULL;
+    }
+
+    return m;
+}
+
+uint64_t
+memex_vmlist_count(MLIST *list)
+{
+    struct memex_list_t *m = vmlist_valid(list, __FUNCTION__);
+    if (!m) {
+        return 0;
+    }
+    return vmlist_count(m, (struct memex_vmlist_t *)m->impl);
+}
+
+void *
+memex_vmlist_get_entry(MLIST *list, uint64_t index)
+{
+    struct memex_list_t *m = vmlist_valid(list, __FUNCTION__);
+    if (!m) {
+        return NULL;
+    }
+    return vmlist_entry(m, (struct memex_vmlist_t *)m->impl, index);
+}
+
+// The whole list as one array; the address never changes
+void *
+memex_vmlist_get_entries(MLIST *list, uint64_t *n_entries)
+{
+    struct memex_list_t *m = vmlist_valid(list, __FUNCTION__);
+    if (!m) {
+        *n_entries = 0;
+        return NULL;
+    }
+
+    struct memex_vmlist_t *vl = (struct memex_vmlist_t *)m->impl;
+    *n_entries = vmlist_count(m, vl);
+    return vl->base;
+}
@@ -0,0 +1,279 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "memex.h"
+
+#define LOGEX_TAG "EXEC-BENCH"
+#define LOGEX_MAIN
+#include <logex.h>
+
+#define BENCH_WORKERS 4
+#define BENCH_N 1000000
+#define BENCH_PINGS 20000
+#define BENCH_DEPTH 16
+
+static inline uint64_t
+now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static _Atomic uint64_t done = 0;
+
+static void *
+tiny_task(void *arg, POOL *scratch)
+{
+    atomic_fetch_add_explicit(&done, 1, memory_order_relaxed);
+    return NULL;
+}
+
+/*
+ *  Baseline: every worker pops from one shared FIFO under one mutex
+ */
+struct fifo_task_t {
+    memex_task_fn fn;
+    void *arg;
+    _Atomic int *flag;
+};
+
+struct fifo_pool_t {
+    MLIST *fifo;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t idle;
+    uint64_t active;
+    int stop;
+    pthread_t thread[BENCH_WORKERS];
+};
+
+static void *
+fifo_worker(void *args)
+{
+    struct fifo_pool_t *f = (struct fifo_pool_t *)args;
+    struct fifo_task_t task;
+    uint32_t n;
+
+    pthread_mutex_lock(&f->lock);
+    while (1) {
+        memex_list_pop(f->fifo, &task, &n);
+        if (n == 0) {
+            if (f->stop) {
+                break;
+            }
+            pthread_cond_wait(&f->work, &f->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&f->lock);
+
+        task.fn(task.arg, NULL);
+        if (task.flag) {
+            atomic_store(task.flag, 1);
+        }
+
+        pthread_mutex_lock(&f->lock);
+        if (--f->active == 0) {
+            pthread_cond_broadcast(&f->idle);
+        }
+    }
+    pthread_mutex_unlock(&f->lock);
+
+    return NULL;
+}
+
+static void
+fifo_submit(struct fifo_pool_t *f, memex_task_fn fn, void *arg, _Atomic int *flag)
+{
+    struct fifo_task_t task = {fn, arg, flag};
+    pthread_mutex_lock(&f->lock);
+    memex_list_push(f->fifo, &task);
+    f->active++;
+    pthread_cond_signal(&f->work);
+    pthread_mutex_unlock(&f->lock);
+}
+
+static void
+fifo_wait(struct fifo_pool_t *f)
+{
+    pthread_mutex_lock(&f->lock);
+    while (f->active > 0) {
+        pthread_cond_wait(&f->idle, &f->lock);
+    }
+    pthread_mutex_unlock(&f->lock);
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void
+report_latency(const char *name, uint64_t *lat)
+{
+    qsort(lat, BENCH_PINGS, sizeof(uint64_t), cmp_u64);
+    info("%-6s latency     p50=%" PRIu64 "ns  p99=%" PRIu64 "ns",
+        name, lat[BENCH_PINGS / 2], lat[(BENCH_PINGS * 99) / 100]);
+}
+
+static void
+report_throughput(const char *name, const char *op, uint64_t n, uint64_t elapsed)
+{
+    info("%-6s %-11s %10.0f tasks/s  (check %" PRIu64 ")",
+        name, op, (double)n * 1e9 / (double)elapsed, atomic_load(&done));
+}
+
+static void
+bench_fifo(POOL *pool, uint64_t *lat)
+{
+    struct fifo_pool_t f = {0};
+    f.fifo = memex_fifo_create(pool, sizeof(struct fifo_task_t));
+    pthread_mutex_init(&f.lock, NULL);
+    pthread_cond_init(&f.work, NULL);
+    pthread_cond_init(&f.idle, NULL);
+
+    int i;
+    for (i = 0; i < BENCH_WORKERS; i++) {
+        pthread_create(&f.thread[i], NULL, fifo_worker, &f);
+    }
+
+    atomic_store(&done, 0);
+    uint64_t start = now_ns();
+    for (i = 0; i < BENCH_N; i++) {
+        fifo_submit(&f, tiny_task, NULL, NULL);
+    }
+    fifo_wait(&f);
+    report_throughput("fifo", "throughput", BENCH_N, now_ns() - start);
+
+    // One task in flight at a time: submit to completion
+    for (i = 0; i < BENCH_PINGS; i++) {
+        _Atomic int flag = 0;
+        uint64_t t = now_ns();
+        fifo_submit(&f, tiny_task, NULL, &flag);
+        while (!atomic_load(&flag));
+        lat[i] = now_ns() - t;
+    }
+    report_latency("fifo", lat);
+
+    pthread_mutex_lock(&f.lock);
+    f.stop = 1;
+    pthread_cond_broadcast(&f.work);
+    pthread_mutex_unlock(&f.lock);
+    for (i = 0; i < BENCH_WORKERS; i++) {
+        pthread_join(f.thread[i], NULL);
+    }
+    memex_list_destroy(f.fifo);
+}
+
+/*
+ *  Fan-out: each task spawns two children until BENCH_DEPTH, which is where
+ *  a single shared queue contends most
+ */
+static struct fifo_pool_t *fan_fifo = NULL;
+static MEXEC *fan_exec = NULL;
+
+static void *
+fan_task(void *arg, POOL *scratch)
+{
+    uintptr_t depth = (uintptr_t)arg;
+    atomic_fetch_add_explicit(&done, 1, memory_order_relaxed);
+    if (depth == 0) {
+        return NULL;
+    }
+
+    int i;
+    for (i = 0; i < 2; i++) {
+        if (fan_exec) {
+            memex_exec_submit(fan_exec, fan_task, (void *)(depth - 1));
+        } else {
+            fifo_submit(fan_fifo, fan_task, (void *)(depth - 1), NULL);
+        }
+    }
+    return NULL;
+}
+
+static void
+bench_fifo_fan(POOL *pool)
+{
+    struct fifo_pool_t f = {0};
+    f.fifo = memex_fifo_create(pool, sizeof(struct fifo_task_t));
+    pthread_mutex_init(&f.lock, NULL);
+    pthread_cond_init(&f.work, NULL);
+    pthread_cond_init(&f.idle, NULL);
+    fan_fifo = &f;
+
+    int i;
+    for (i = 0; i < BENCH_WORKERS; i++) {
+        pthread_create(&f.thread[i], NULL, fifo_worker, &f);
+    }
+
+    atomic_store(&done, 0);
+    uint64_t start = now_ns();
+    fifo_submit(&f, fan_task, (void *)(uintptr_t)BENCH_DEPTH, NULL);
+    fifo_wait(&f);
+    report_throughput("fifo", "fan-out", (2ULL << BENCH_DEPTH) - 1, now_ns() - start);
+
+    pthread_mutex_lock(&f.lock);
+    f.stop = 1;
+    pthread_cond_broadcast(&f.work);
+    pthread_mutex_unlock(&f.lock);
+    for (i = 0; i < BENCH_WORKERS; i++) {
+        pthread_join(f.thread[i], NULL);
+    }
+    memex_list_destroy(f.fifo);
+    fan_fifo = NULL;
+}
+
+static void
+bench_exec(POOL *pool, uint64_t *lat)
+{
+    MEXEC *exec = memex_exec_create(pool, BENCH_WORKERS);
+
+    atomic_store(&done, 0);
+    uint64_t start = now_ns();
+    int i;
+    for (i = 0; i < BENCH_N; i++) {
+        memex_exec_submit(exec, tiny_task, NULL);
+    }
+    memex_exec_wait(exec);
+    report_throughput("memex", "throughput", BENCH_N, now_ns() - start);
+
+    for (i = 0; i < BENCH_PINGS; i++) {
+        uint64_t t = now_ns();
+        memex_future_join(memex_exec_async(exec, tiny_task, NULL));
+        lat[i] = now_ns() - t;
+    }
+    report_latency("memex", lat);
+
+    fan_exec = exec;
+    atomic_store(&done, 0);
+    start = now_ns();
+    memex_exec_submit(exec, fan_task, (void *)(uintptr_t)BENCH_DEPTH);
+    memex_exec_wait(exec);
+    report_throughput("memex", "fan-out", (2ULL << BENCH_DEPTH) - 1, now_ns() - start);
+    fan_exec = NULL;
+
+    memex_exec_destroy(exec);
+}
+
+int
+main(int nargs, char *argv[])
+{
+    set_log_level_default_str("info");
+
+    POOL *pool = create_pool();
+    uint64_t *lat = palloc(pool, BENCH_PINGS * sizeof(uint64_t));
+    bench_fifo(pool, lat);
+    bench_fifo_fan(pool);
+    bench_exec(pool, lat);
+    pool_cleanup();
+
+    return 0;
+}
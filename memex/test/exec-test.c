@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include <testex.h>
+#include "memex.h"
+
+#define LOGEX_TAG "EXEC-TEST"
+#define LOGEX_MAIN
+#include <logex.h>
+
+static _Atomic int counter = 0;
+
+static void *
+count_task(void *arg, POOL *scratch)
+{
+    atomic_fetch_add(&counter, 1);
+    return NULL;
+}
+
+static void *
+square_task(void *arg, POOL *scratch)
+{
+    uintptr_t x = (uintptr_t)arg;
+    return (void *)(x * x);
+}
+
+static int
+basic_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MEXEC *exec = memex_exec_create(pool, 4);
+    ASSERT_NOT_NULL(exec);
+    ASSERT_NULL(memex_exec_create(pool, 0));
+
+    atomic_store(&counter, 0);
+    int i;
+    for (i = 0; i < 10000; i++) {
+        ASSERT_SUCCESS(memex_exec_submit(exec, count_task, NULL));
+    }
+    memex_exec_wait(exec);
+    ASSERT_EQUAL(atomic_load(&counter), 10000);
+
+    MFUTURE *f[100];
+    for (i = 0; i < 100; i++) {
+        f[i] = memex_exec_async(exec, square_task, (void *)(uintptr_t)i);
+        ASSERT_NOT_NULL(f[i]);
+    }
+    for (i = 0; i < 100; i++) {
+        ASSERT_EQUAL((uintptr_t)memex_future_join(f[i]), (uintptr_t)(i * i));
+    }
+
+    memex_exec_destroy(exec);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+// Sum [lo, hi) by splitting in half; each task joins its own children
+struct range_t {
+    MEXEC *exec;
+    uint64_t lo;
+    uint64_t hi;
+};
+
+static void *
+sum_task(void *arg, POOL *scratch)
+{
+    struct range_t *r = (struct range_t *)arg;
+    if (r->hi - r->lo <= 64) {
+        uint64_t sum = 0;
+        uint64_t i;
+        for (i = r->lo; i < r->hi; i++) {
+            sum += i;
+        }
+        return (void *)(uintptr_t)sum;
+    }
+
+    // Children's arguments live in this task's scratch pool
+    uint64_t mid = r->lo + (r->hi - r->lo) / 2;
+    struct range_t *a = palloc(scratch, sizeof(struct range_t));
+    struct range_t *b = palloc(scratch, sizeof(struct range_t));
+    *a = (struct range_t){r->exec, r->lo, mid};
+    *b = (struct range_t){r->exec, mid, r->hi};
+
+    MFUTURE *fa = memex_exec_async(r->exec, sum_task, a);
+    uint64_t sum = (uintptr_t)sum_task(b, scratch);
+    sum += (uintptr_t)memex_future_join(fa);
+    return (void *)(uintptr_t)sum;
+}
+
+static int
+nested_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MEXEC *exec = memex_exec_create(pool, 4);
+    ASSERT_NOT_NULL(exec);
+
+    uint64_t n = 1 << 18;
+    struct range_t r = {exec, 0, n};
+    MFUTURE *f = memex_exec_async(exec, sum_task, &r);
+    ASSERT_EQUAL((uint64_t)(uintptr_t)memex_future_join(f), n * (n - 1) / 2);
+
+    memex_exec_destroy(exec);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static _Atomic int dirty = 0;
+
+static void *
+scratch_task(void *arg, POOL *scratch)
+{
+    // A reset scratch pool hands out fresh, zeroed memory again
+    int *x = pcalloc(scratch, 64 * sizeof(int));
+    if (x[0] != 0) {
+        atomic_fetch_add(&dirty, 1);
+    }
+    memset(x, 0xff, 64 * sizeof(int));
+
+    POOL *sub = create_subpool(scratch);
+    palloc(sub, 1024);
+    return NULL;
+}
+
+static int
+scratch_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MEXEC *exec = memex_exec_create(pool, 2);
+    ASSERT_NOT_NULL(exec);
+
+    int i;
+    for (i = 0; i < 1000; i++) {
+        memex_exec_submit(exec, scratch_task, NULL);
+    }
+    memex_exec_wait(exec);
+    ASSERT_EQUAL(atomic_load(&dirty), 0);
+
+    // Queued tasks still run when the executor is destroyed
+    atomic_store(&counter, 0);
+    for (i = 0; i < 1000; i++) {
+        memex_exec_submit(exec, count_task, NULL);
+    }
+    memex_exec_destroy(exec);
+    ASSERT_EQUAL(atomic_load(&counter), 1000);
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+int
+main(int nargs, char *argv[])
+{
+    memex_exec_set_log_level("critical");
+    TESTEX_LOG_INIT("info");
+    testex_setup();
+
+    testex_add(basic_test);
+    testex_add(nested_test);
+    testex_add(scratch_test);
+
+    testex_run();
+    testex_cleanup();
+}
@@ -1,7 +1,12 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
+#include <sched.h>
+#include <poll.h>
+#include <stdatomic.h>
 
 #include <testex.h>
 #include "memex.h"
@@ -312,6 +317,1669 @@ testex_return:
     return ret;
 }
 
+static int
+fifo_ring_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *f = memex_fifo_create(pool, sizeof(int));
+
+    // Wrap the ring, then force growth while it is wrapped
+    int next_in = 0;
+    int next_out = 0;
+    for (int i = 0; i < 12; i++) {
+        memex_list_push(f, &next_in);
+        next_in++;
+    }
+    for (int i = 0; i < 8; i++) {
+        int x;
+        memex_list_pop(f, &x, NULL);
+        ASSERT_EQUAL(x, next_out);
+        next_out++;
+    }
+    for (int i = 0; i < 40; i++) {
+        memex_list_push(f, &next_in);
+        next_in++;
+    }
+
+    uint32_t N0, N1;
+    void *second;
+    int *first = memex_list_get_segments(f, &N0, &second, &N1);
+    ASSERT_EQUAL(N0 + N1, next_in - next_out);
+    for (int n = 0; n < N0; n++) {
+        ASSERT_EQUAL(first[n], next_out + n);
+    }
+    for (int n = 0; n < N1; n++) {
+        ASSERT_EQUAL(((int *)second)[n], next_out + N0 + n);
+    }
+
+    MLIST *c = memex_list_copy(pool, f);
+    int x;
+    memex_list_pop(c, &x, NULL);
+    ASSERT_EQUAL(x, next_out);
+
+    memex_list_remove_before_index(f, 5);
+    next_out += 5;
+
+    uint32_t N;
+    int *entries = memex_list_get_entries(f, &N);
+    ASSERT_EQUAL(N, next_in - next_out);
+    for (int n = 0; n < N; n++) {
+        ASSERT_EQUAL(entries[n], next_out + n);
+    }
+
+    while (next_out < next_in) {
+        memex_list_pop(f, &x, &N);
+        ASSERT_EQUAL(N, 1);
+        ASSERT_EQUAL(x, next_out);
+        next_out++;
+    }
+    memex_list_pop(f, &x, &N);
+    ASSERT_EQUAL(N, 0);
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+#define SPSC_TEST_N 100000
+
+static void *
+spsc_producer(void *args)
+{
+    MLIST *q = (MLIST *)args;
+    for (int i = 0; i < SPSC_TEST_N; i++) {
+        while (memex_list_push(q, &i) != 0) {
+            sched_yield();
+        }
+    }
+    pthread_exit(NULL);
+}
+
+static int
+spsc_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *q = memex_spsc_create(pool, sizeof(int), 100);
+
+    // Capacity is rounded up to a power of two
+    int i;
+    for (i = 0; i < 128; i++) {
+        ASSERT_SUCCESS(memex_list_push(q, &i));
+    }
+    ASSERT_FAILURE(memex_list_push(q, &i));
+    ASSERT_EQUAL(memex_list_count(q), 128);
+
+    // Only the consumer may empty the ring
+    memex_list_clear(q);
+    ASSERT_EQUAL(memex_list_count(q), 128);
+
+    uint32_t N;
+    for (i = 0; i < 128; i++) {
+        int x;
+        memex_list_pop(q, &x, &N);
+        ASSERT_EQUAL(N, 1);
+        ASSERT_EQUAL(x, i);
+        ASSERT_EQUAL(memex_list_count(q), 127 - i);
+    }
+    ASSERT_SUCCESS(memex_list_pop(q, &i, &N));
+    ASSERT_EQUAL(N, 0);
+    ASSERT_EQUAL(memex_list_count(q), 0);
+
+    pthread_t id;
+    pthread_create(&id, NULL, spsc_producer, q);
+
+    int expected = 0;
+    while (expected < SPSC_TEST_N) {
+        int x;
+        memex_list_pop(q, &x, &N);
+        if (N == 0) {
+            continue;
+        }
+        ASSERT_EQUAL(x, expected);
+        expected++;
+    }
+    pthread_join(id, NULL);
+
+    memex_list_destroy(q);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+#define DEQUE_TEST_N 200000
+#define DEQUE_THIEVES 3
+
+struct deque_args_t {
+    MLIST *q;
+    _Atomic int done;
+    _Atomic int *seen;
+};
+
+static void *
+deque_thief(void *args)
+{
+    struct deque_args_t *a = (struct deque_args_t *)args;
+    while (1) {
+        int x;
+        uint32_t N;
+        memex_deque_steal(a->q, &x, &N);
+        if (N == 1) {
+            atomic_fetch_add(&a->seen[x], 1);
+        } else if (atomic_load(&a->done)) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int
+deque_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *q = memex_deque_create(pool, sizeof(int), 4);
+
+    // The owner pops LIFO, thieves steal FIFO, and the ring grows past 4
+    int i, x;
+    uint32_t N;
+    for (i = 0; i < 10; i++) {
+        ASSERT_SUCCESS(memex_list_push(q, &i));
+    }
+    ASSERT_EQUAL(memex_list_count(q), 10);
+    memex_list_pop(q, &x, &N);
+    ASSERT_EQUAL(x, 9);
+    memex_deque_steal(q, &x, &N);
+    ASSERT_EQUAL(N, 1);
+    ASSERT_EQUAL(x, 0);
+    for (i = 8; i > 0; i--) {
+        memex_list_pop(q, &x, &N);
+        ASSERT_EQUAL(N, 1);
+        ASSERT_EQUAL(x, i);
+    }
+    memex_list_pop(q, &x, &N);
+    ASSERT_EQUAL(N, 0);
+    memex_deque_steal(q, &x, &N);
+    ASSERT_EQUAL(N, 0);
+
+    // Every item is taken exactly once, by the owner or a thief
+    struct deque_args_t args;
+    args.q = q;
+    args.seen = calloc(DEQUE_TEST_N, sizeof(_Atomic int));
+    atomic_init(&args.done, 0);
+
+    pthread_t id[DEQUE_THIEVES];
+    for (i = 0; i < DEQUE_THIEVES; i++) {
+        pthread_create(&id[i], NULL, deque_thief, &args);
+    }
+
+    for (i = 0; i < DEQUE_TEST_N; i++) {
+        ASSERT_SUCCESS(memex_list_push(q, &i));
+        if (i % 3 == 0) {
+            memex_list_pop(q, &x, &N);
+            if (N == 1) {
+                atomic_fetch_add(&args.seen[x], 1);
+            }
+        }
+    }
+    while (1) {
+        memex_list_pop(q, &x, &N);
+        if (N == 0) {
+            break;
+        }
+        atomic_fetch_add(&args.seen[x], 1);
+    }
+    atomic_store(&args.done, 1);
+
+    for (i = 0; i < DEQUE_THIEVES; i++) {
+        pthread_join(id[i], NULL);
+    }
+    for (i = 0; i < DEQUE_TEST_N; i++) {
+        ASSERT_EQUAL(atomic_load(&args.seen[i]), 1);
+    }
+
+    free((void *)args.seen);
+    memex_list_destroy(q);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static void *
+queue_consumer(void *args)
+{
+    MLIST *q = (MLIST *)args;
+    intptr_t sum = 0;
+
+    // Runs until the queue is closed and drained
+    while (1) {
+        int x;
+        uint32_t N;
+        if (memex_queue_pop_timed(q, &x, &N, -1) != 0) {
+            break;
+        }
+        sum += x;
+    }
+    pthread_exit((void *)sum);
+}
+
+static void *
+queue_producer(void *args)
+{
+    MLIST *q = (MLIST *)args;
+    int x = 100;
+    pthread_exit((void *)(intptr_t)memex_queue_push_timed(q, &x, 2000));
+}
+
+static int
+queue_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    ASSERT_NULL(memex_queue_create(pool, sizeof(int), 4, MEMEX_NOSUBPOOL));
+
+    MLIST *q = memex_queue_create(pool, sizeof(int), 4, MEMEX_EVENTFD);
+    ASSERT_NOT_NULL(q);
+
+    int fd = memex_queue_get_fd(q);
+    ASSERT_NOT_EQUAL(fd, -1);
+
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    ASSERT_EQUAL(poll(&pfd, 1, 0), 0);
+
+    for (int i = 0; i < 4; i++) {
+        ASSERT_SUCCESS(memex_list_push(q, &i));
+    }
+    ASSERT_EQUAL(poll(&pfd, 1, 0), 1);
+
+    // Full queue times out
+    int x = 4;
+    ASSERT_FAILURE(memex_queue_push_timed(q, &x, 10));
+
+    // Blocking under memex_list_acquire() fails rather than deadlocking
+    memex_list_acquire(q);
+    ASSERT_FAILURE(memex_list_push(q, &x));
+    memex_list_release(q);
+
+    uint32_t N;
+    for (int i = 0; i < 4; i++) {
+        ASSERT_SUCCESS(memex_queue_pop_timed(q, &x, &N, 10));
+        ASSERT_EQUAL(N, 1);
+        ASSERT_EQUAL(x, i);
+    }
+    ASSERT_EQUAL(poll(&pfd, 1, 0), 0);
+
+    // Empty queue times out without an entry
+    ASSERT_SUCCESS(memex_queue_pop_timed(q, &x, &N, 10));
+    ASSERT_EQUAL(N, 0);
+
+    // Clearing a full queue wakes a blocked producer and resets the fd
+    for (int i = 0; i < 4; i++) {
+        ASSERT_SUCCESS(memex_list_push(q, &i));
+    }
+    pthread_t producer;
+    pthread_create(&producer, NULL, queue_producer, q);
+    usleep(20000);
+    memex_list_clear(q);
+    void *pushed;
+    pthread_join(producer, &pushed);
+    ASSERT_EQUAL((intptr_t)pushed, 0);
+    ASSERT_EQUAL(memex_list_count(q), 1);
+    ASSERT_EQUAL(poll(&pfd, 1, 0), 1);
+    ASSERT_SUCCESS(memex_queue_pop_timed(q, &x, &N, 0));
+    ASSERT_EQUAL(x, 100);
+    ASSERT_EQUAL(poll(&pfd, 1, 0), 0);
+
+    pthread_t id[2];
+    pthread_create(&id[0], NULL, queue_consumer, q);
+    pthread_create(&id[1], NULL, queue_consumer, q);
+
+    intptr_t expected = 0;
+    for (int i = 0; i < 1000; i++) {
+        memex_list_push(q, &i);
+        expected += i;
+    }
+    memex_queue_close(q);
+
+    intptr_t total = 0;
+    for (int i = 0; i < 2; i++) {
+        void *sum;
+        pthread_join(id[i], &sum);
+        total += (intptr_t)sum;
+    }
+    ASSERT_EQUAL(total, expected);
+    ASSERT_FAILURE(memex_list_push(q, &x));
+
+    memex_list_destroy(q);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static int
+batch_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *f = memex_fifo_create(pool, sizeof(int));
+    MLIST *s = memex_stack_create(pool, sizeof(int));
+
+    int in[100];
+    int out[100];
+    for (int i = 0; i < 100; i++) {
+        in[i] = i;
+    }
+
+    // Offset the FIFO head so the batch wraps the ring
+    ASSERT_SUCCESS(memex_list_push_n(f, in, 10));
+    uint32_t N;
+    ASSERT_SUCCESS(memex_list_pop_n(f, out, 7, &N));
+    ASSERT_EQUAL(N, 7);
+    ASSERT_SUCCESS(memex_list_push_n(f, in + 10, 90));
+
+    ASSERT_SUCCESS(memex_list_pop_n(f, out, 100, &N));
+    ASSERT_EQUAL(N, 93);
+    for (int i = 0; i < 93; i++) {
+        ASSERT_EQUAL(out[i], i + 7);
+    }
+
+    ASSERT_SUCCESS(memex_list_push_n(s, in, 100));
+    ASSERT_SUCCESS(memex_list_pop_n(s, out, 10, &N));
+    ASSERT_EQUAL(N, 10);
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQUAL(out[i], 99 - i);
+    }
+
+    MLIST *l = memex_list_create(pool, sizeof(int));
+    ASSERT_FAILURE(memex_list_push_n(l, in, 10));
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static int
+growth_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *m = memex_list_create(pool, sizeof(int));
+    memex_list_set_growth_factor(m, 2.0);
+
+    int N = 100000;
+    for (int n = 0; n < N; n++) {
+        int *x = memex_list_new_entry(m);
+        *x = n;
+    }
+
+    uint32_t M;
+    int *entries = memex_list_get_entries(m, &M);
+    ASSERT_EQUAL(M, N);
+    for (int n = 0; n < N; n++) {
+        ASSERT_EQUAL(entries[n], n);
+    }
+
+    memex_list_remove_after_index(m, 9);
+    memex_list_shrink_to_fit(m);
+    entries = memex_list_get_entries(m, &M);
+    ASSERT_EQUAL(M, 10);
+    ASSERT_EQUAL(entries[9], 9);
+
+    // A zero default step would leave new lists unable to grow
+    memex_list_set_default_step_size(0);
+    MLIST *d = memex_list_create(pool, sizeof(int));
+    for (int n = 0; n < 100; n++) {
+        ASSERT_NOT_NULL(memex_list_new_entry(d));
+    }
+    ASSERT_EQUAL(memex_list_count(d), 100);
+
+    // A reserved list does not move while it fills
+    MLIST *r = memex_list_create(pool, sizeof(int));
+    memex_list_set_step_size(r, 4);
+    ASSERT_SUCCESS(memex_list_reserve(r, 1000));
+    int *first = memex_list_new_entry(r);
+    for (int n = 1; n < 1000; n++) {
+        memex_list_new_entry(r);
+    }
+    entries = memex_list_get_entries(r, &M);
+    ASSERT_EQUAL(M, 1000);
+    ASSERT_EQUAL(entries, first);
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static void *
+seglist_appender(void *args)
+{
+    MLIST *m = (MLIST *)args;
+    for (int i = 0; i < 10000; i++) {
+        int *x = memex_list_new_entry(m);
+        *x = 1;
+    }
+    pthread_exit(NULL);
+}
+
+static int
+seglist_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *m = memex_seglist_create(pool, sizeof(int), 64);
+    ASSERT_NOT_NULL(m);
+
+    // Entry addresses survive growth
+    int *first = memex_list_new_entry(m);
+    *first = 0;
+    for (int n = 1; n < 1000; n++) {
+        int *x = memex_list_new_entry(m);
+        *x = n;
+    }
+    ASSERT_EQUAL(memex_list_get_entry(m, 0), first);
+    ASSERT_EQUAL(*first, 0);
+    ASSERT_EQUAL(memex_list_count(m), 1000);
+    for (int n = 0; n < 1000; n++) {
+        int *x = memex_list_get_entry(m, n);
+        ASSERT_EQUAL(*x, n);
+    }
+    ASSERT_NULL(memex_list_get_entry(m, 1000));
+
+    uint32_t N;
+    ASSERT_NULL(memex_list_get_entries(m, &N));
+
+    memex_list_clear(m);
+    ASSERT_EQUAL(memex_list_count(m), 0);
+
+    pthread_t id[4];
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&id[i], NULL, seglist_appender, m);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(id[i], NULL);
+    }
+
+    ASSERT_EQUAL(memex_list_count(m), 40000);
+    for (int n = 0; n < 40000; n++) {
+        int *x = memex_list_get_entry(m, n);
+        ASSERT_EQUAL(*x, 1);
+    }
+
+    memex_list_destroy(m);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static int
+vmlist_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+
+    // Address space for 8G entries; only what is used gets committed
+    MLIST *m = memex_vmlist_create(pool, sizeof(uint64_t), 1ULL << 33);
+    ASSERT_NOT_NULL(m);
+
+    // Growth never moves the base
+    uint64_t *first = memex_list_new_entry(m);
+    *first = 0;
+    for (uint64_t n = 1; n < 1000000; n++) {
+        uint64_t *x = memex_list_new_entry(m);
+        *x = n;
+    }
+    ASSERT_EQUAL(memex_list_count(m), 1000000);
+    ASSERT_EQUAL(memex_vmlist_count(m), 1000000);
+    ASSERT_EQUAL(memex_list_get_entry(m, 0), first);
+    ASSERT_EQUAL(*(uint64_t *)memex_vmlist_get_entry(m, 999999), 999999);
+    ASSERT_NULL(memex_vmlist_get_entry(m, 1000000));
+
+    uint64_t N;
+    uint64_t *e = memex_vmlist_get_entries(m, &N);
+    ASSERT_EQUAL(e, first);
+    ASSERT_EQUAL(N, 1000000);
+    for (uint64_t n = 0; n < N; n++) {
+        ASSERT_EQUAL(e[n], n);
+    }
+
+    uint32_t M;
+    ASSERT_EQUAL(memex_list_get_entries(m, &M), first);
+    ASSERT_EQUAL(M, 1000000);
+
+    // Cleared slots are reused and zeroed
+    memex_list_clear(m);
+    ASSERT_EQUAL(memex_list_count(m), 0);
+    ASSERT_EQUAL(memex_list_new_entry(m), first);
+    ASSERT_EQUAL(*first, 0);
+    memex_list_clear(m);
+
+    pthread_t id[4];
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&id[i], NULL, seglist_appender, m);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(id[i], NULL);
+    }
+    ASSERT_EQUAL(memex_list_count(m), 40000);
+    memex_list_destroy(m);
+
+    // A full list refuses more entries
+    m = memex_vmlist_create(pool, sizeof(int), 10);
+    for (int n = 0; n < 10; n++) {
+        ASSERT_NOT_NULL(memex_list_new_entry(m));
+    }
+    ASSERT_NULL(memex_list_new_entry(m));
+    ASSERT_EQUAL(memex_vmlist_count(m), 10);
+
+    // Not for other list types
+    MLIST *l = memex_list_create(pool, sizeof(int));
+    ASSERT_EQUAL(memex_vmlist_count(l), 0);
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static int
+peek_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *f = memex_fifo_create(pool, sizeof(int));
+    MLIST *s = memex_stack_create(pool, sizeof(int));
+
+    uint32_t N;
+    ASSERT_NULL(memex_list_peek_front(f, &N));
+    ASSERT_EQUAL(N, 0);
+
+    for (int i = 0; i < 10; i++) {
+        memex_list_push(f, &i);
+        memex_list_push(s, &i);
+    }
+
+    // Process FIFO entries in place, then drop them
+    memex_list_acquire(f);
+    int *front = memex_list_peek_front(f, &N);
+    ASSERT_EQUAL(N, 10);
+    for (int i = 0; i < 4; i++) {
+        ASSERT_EQUAL(front[i], i);
+    }
+    memex_list_consume(f, 4);
+    memex_list_release(f);
+
+    int x;
+    memex_list_pop(f, &x, NULL);
+    ASSERT_EQUAL(x, 4);
+
+    // Wrap the ring so the front run stops at the end of the buffer
+    for (int i = 10; i < 15; i++) {
+        memex_list_push(f, &i);
+    }
+    front = memex_list_peek_front(f, &N);
+    ASSERT_EQUAL(*front, 5);
+    uint32_t n_back;
+    int *back = memex_list_peek_back(f, &n_back);
+    ASSERT_EQUAL(*back, 14);
+    ASSERT_EQUAL(N + n_back >= 10, 1);
+
+    memex_list_acquire(s);
+    back = memex_list_peek_back(s, &N);
+    ASSERT_EQUAL(N, 10);
+    ASSERT_EQUAL(*back, 9);
+    ASSERT_EQUAL(*(back - 1), 8);
+    memex_list_consume(s, 2);
+    memex_list_release(s);
+
+    memex_list_pop(s, &x, NULL);
+    ASSERT_EQUAL(x, 7);
+
+    memex_list_consume(s, 100);
+    ASSERT_NULL(memex_list_peek_back(s, &N));
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+struct snap_reader_t {
+    MLIST *list;
+    int stop;
+    int bad;
+};
+
+static void *
+snap_reader(void *args)
+{
+    struct snap_reader_t *r = (struct snap_reader_t *)args;
+    while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+        MSNAP *snap = memex_list_snapshot(r->list);
+        uint32_t N;
+        int *e = memex_snapshot_get_entries(snap, &N);
+
+        // Entries are always pushed as a consecutive run
+        for (uint32_t i = 1; i < N; i++) {
+            if (e[i] != e[i - 1] + 1) {
+                r->bad++;
+            }
+        }
+        memex_snapshot_release(snap);
+    }
+    return NULL;
+}
+
+static int
+snapshot_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *list = memex_fifo_create(pool, sizeof(int));
+
+    for (int i = 0; i < 100; i++) {
+        memex_list_push(list, &i);
+    }
+
+    MSNAP *a = memex_list_snapshot(list);
+    ASSERT_NOT_NULL(a);
+
+    // No write in between: both snapshots share one generation
+    MSNAP *b = memex_list_snapshot(list);
+    ASSERT_EQUAL(a, b);
+    memex_snapshot_release(b);
+
+    // Pops leave the shared buffer alone; writes copy it
+    int x;
+    memex_list_pop(list, &x, NULL);
+    ASSERT_EQUAL(x, 0);
+    x = 1000;
+    memex_list_push(list, &x);
+    *(int *)memex_list_get_entry(list, 0) = -1;
+
+    uint32_t N;
+    int *e = memex_snapshot_get_entries(a, &N);
+    ASSERT_EQUAL(N, 100);
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQUAL(e[i], i);
+    }
+    ASSERT_EQUAL(*(int *)memex_snapshot_get_entry(a, 99), 99);
+    ASSERT_NULL(memex_snapshot_get_entry(a, 100));
+
+    memex_list_pop(list, &x, NULL);
+    ASSERT_EQUAL(x, -1);
+    ASSERT_EQUAL(memex_list_count(list), 99);
+
+    // The snapshot outlives a clear and the list itself
+    MSNAP *c = memex_list_snapshot(list);
+    memex_list_clear(list);
+    memex_list_destroy(list);
+    e = memex_snapshot_get_entries(c, &N);
+    ASSERT_EQUAL(N, 99);
+    ASSERT_EQUAL(e[0], 2);
+    ASSERT_EQUAL(e[98], 1000);
+    memex_snapshot_release(c);
+    memex_snapshot_release(a);
+
+    // Readers scan while a writer keeps pushing and popping
+    list = memex_fifo_create(pool, sizeof(int));
+    struct snap_reader_t r = {list, 0, 0};
+    pthread_t tid;
+    pthread_create(&tid, NULL, snap_reader, &r);
+    for (int i = 0; i < 100000; i++) {
+        memex_list_push(list, &i);
+        if (memex_list_count(list) > 64) {
+            memex_list_pop(list, &x, NULL);
+        }
+    }
+    __atomic_store_n(&r.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(tid, NULL);
+    ASSERT_EQUAL(r.bad, 0);
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static int
+copy_shared_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *list = memex_fifo_create(pool, sizeof(int));
+
+    for (int i = 0; i < 100; i++) {
+        memex_list_push(list, &i);
+    }
+
+    // A ring that has wrapped is unwrapped into the shared buffer
+    int x;
+    memex_list_pop(list, &x, NULL);
+    x = 100;
+    memex_list_push(list, &x);
+
+    MLIST *a = memex_list_copy_shared(pool, list);
+    MLIST *b = memex_list_copy_shared(pool, list);
+    ASSERT_NOT_NULL(a);
+    ASSERT_EQUAL(memex_list_count(a), 100);
+    ASSERT_EQUAL(memex_list_count(b), 100);
+
+    // Writing to the source leaves both copies alone
+    x = -1;
+    memex_list_push(list, &x);
+    *(int *)memex_list_get_entry(list, 0) = -2;
+    ASSERT_EQUAL(memex_list_count(list), 101);
+
+    memex_list_pop(a, &x, NULL);
+    ASSERT_EQUAL(x, 1);
+    ASSERT_EQUAL(*(int *)memex_list_get_entry(a, 98), 100);
+
+    // Writing to one copy leaves the other alone
+    *(int *)memex_list_get_entry(a, 0) = 7;
+    ASSERT_EQUAL(*(int *)memex_list_get_entry(b, 0), 1);
+    memex_list_destroy(a);
+
+    // b now holds the last reference and takes the buffer back
+    uint32_t N;
+    int *e = memex_list_get_entries(b, &N);
+    ASSERT_EQUAL(N, 100);
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQUAL(e[i], i + 1);
+    }
+    x = 101;
+    memex_list_push(b, &x);
+    ASSERT_EQUAL(memex_list_count(b), 101);
+    memex_list_destroy(b);
+
+    memex_list_pop(list, &x, NULL);
+    ASSERT_EQUAL(x, -2);
+
+    // Copying an empty list shares nothing
+    memex_list_clear(list);
+    a = memex_list_copy_shared(pool, list);
+    ASSERT_NOT_NULL(a);
+    ASSERT_EQUAL(memex_list_count(a), 0);
+    memex_list_push(a, &x);
+    ASSERT_EQUAL(memex_list_count(a), 1);
+    ASSERT_EQUAL(memex_list_count(list), 0);
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+struct deadline_t {
+    int id;
+    double when;
+};
+
+static int
+pqueue_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *pq = memex_pqueue_create(pool, struct deadline_t, when, MEMEX_SORT_TYPE_DOUBLE);
+    ASSERT_NOT_NULL(pq);
+    ASSERT_NULL(memex_pqueue_create(pool, struct deadline_t, when, MEMEX_SORT_TYPE_NOINIT));
+
+    int N = 1000;
+    uint32_t *handles = palloc(pool, N * sizeof(uint32_t));
+    for (int i = 0; i < N; i++) {
+        struct deadline_t d = {i, (double)((i * 7919) % N) - (N / 2)};
+        ASSERT_SUCCESS(memex_pqueue_push(pq, &d, &handles[i]));
+    }
+    ASSERT_EQUAL(memex_list_count(pq), N);
+
+    struct deadline_t *top = memex_pqueue_peek(pq);
+    ASSERT_EQUAL(top->when, -(N / 2));
+
+    // Pull one deadline to the front, push another to the back
+    struct deadline_t d = {7, -1e9};
+    ASSERT_SUCCESS(memex_pqueue_update(pq, handles[7], &d));
+    d.id = 8;
+    d.when = 1e9;
+    ASSERT_SUCCESS(memex_pqueue_update(pq, handles[8], &d));
+
+    // Cancel one outright
+    ASSERT_SUCCESS(memex_pqueue_remove(pq, handles[9], &d));
+    ASSERT_EQUAL(d.id, 9);
+    ASSERT_FAILURE(memex_pqueue_remove(pq, handles[9], NULL));
+
+    // Generic removes and sorts would break the heap and its handles
+    memex_list_remove_index(pq, 0);
+    memex_list_remove_after_index(pq, 10);
+    memex_list_remove_before_index(pq, 10);
+    memex_list_sort(pq);
+    ASSERT_EQUAL(memex_list_count(pq), N - 1);
+    top = memex_pqueue_peek(pq);
+    ASSERT_EQUAL(top->id, 7);
+
+    uint32_t n;
+    memex_list_pop(pq, &d, &n);
+    ASSERT_EQUAL(n, 1);
+    ASSERT_EQUAL(d.id, 7);
+
+    double last = -1e9;
+    int count = 1;
+    while (memex_pqueue_pop(pq, &d, &n) == 0 && n == 1) {
+        ASSERT_EQUAL(d.when >= last, 1);
+        last = d.when;
+        count++;
+    }
+    ASSERT_EQUAL(count, N - 1);
+    ASSERT_EQUAL(d.id, 8);
+    ASSERT_NULL(memex_pqueue_peek(pq));
+
+    // Handles are recycled once released
+    uint32_t h;
+    memex_pqueue_push(pq, &d, &h);
+    ASSERT_EQUAL(h < N, 1);
+
+    memex_list_clear(pq);
+    ASSERT_EQUAL(memex_list_count(pq), 0);
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+struct keyed_t {
+    int id;
+    int32_t key;
+};
+
+static int
+sorted_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *list = memex_list_create(pool, sizeof(struct keyed_t));
+    ASSERT_SUCCESS(memex_list_set_sorted(list, struct keyed_t, key, MEMEX_SORT_TYPE_INT32));
+
+    // Keys -100..98, even only, inserted out of order
+    for (int i = 0; i < 100; i++) {
+        struct keyed_t e = {i, (int32_t)(((i * 37) % 100) * 2) - 100};
+        struct keyed_t *in = memex_list_insert(list, &e);
+        ASSERT_NOT_NULL(in);
+        ASSERT_EQUAL(in->id, i);
+    }
+
+    uint32_t N;
+    struct keyed_t *entries = memex_list_get_entries(list, &N);
+    ASSERT_EQUAL(N, 100);
+    for (int i = 1; i < N; i++) {
+        ASSERT_EQUAL(entries[i - 1].key < entries[i].key, 1);
+    }
+
+    int32_t k = -100;
+    ASSERT_EQUAL(memex_list_lower_bound(list, &k), 0);
+    k = 3;
+    ASSERT_EQUAL(memex_list_lower_bound(list, &k), 52);
+    ASSERT_NULL(memex_list_find(list, &k));
+    k = 4;
+    ASSERT_EQUAL(memex_list_lower_bound(list, &k), 52);
+    ASSERT_EQUAL(memex_list_upper_bound(list, &k), 53);
+    struct keyed_t *f = memex_list_find(list, &k);
+    ASSERT_NOT_NULL(f);
+    ASSERT_EQUAL(f->key, 4);
+
+    // Equal keys keep insertion order
+    struct keyed_t dup = {1000, 4};
+    memex_list_insert(list, &dup);
+    ASSERT_EQUAL(memex_list_upper_bound(list, &k), 54);
+    ASSERT_EQUAL(((struct keyed_t *)memex_list_get_entry(list, 53))->id, 1000);
+
+    int32_t lo = -10;
+    int32_t hi = 10;
+    memex_list_acquire(list);
+    struct keyed_t *r = memex_list_get_range(list, &lo, &hi, &N);
+    ASSERT_EQUAL(N, 12);
+    ASSERT_EQUAL(r[0].key, -10);
+    ASSERT_EQUAL(r[N - 1].key, 10);
+    memex_list_release(list);
+
+    // Bulk appends are sorted on the next lookup
+    for (int i = 0; i < 10; i++) {
+        struct keyed_t *e = memex_list_new_entry(list);
+        e->id = 2000 + i;
+        e->key = 1 - (2 * i);
+    }
+    k = -17;
+    f = memex_list_find(list, &k);
+    ASSERT_NOT_NULL(f);
+    ASSERT_EQUAL(f->id, 2009);
+    entries = memex_list_get_entries(list, &N);
+    ASSERT_EQUAL(N, 111);
+    for (int i = 1; i < N; i++) {
+        ASSERT_EQUAL(entries[i - 1].key <= entries[i].key, 1);
+    }
+
+    // Inserts would shift entries into a reserved slot
+    struct keyed_t *slot;
+    ASSERT_SUCCESS(memex_list_append_reserve(list, 1, (void **)&slot));
+    ASSERT_NULL(memex_list_insert(list, &dup));
+    slot->id = 3000;
+    slot->key = 999;
+    ASSERT_SUCCESS(memex_list_append_commit(list, 1));
+    ASSERT_EQUAL(memex_list_count(list), 112);
+    k = 999;
+    f = memex_list_find(list, &k);
+    ASSERT_NOT_NULL(f);
+    ASSERT_EQUAL(f->id, 3000);
+
+    // Unsorted lists with a sort key fall back to a scan
+    MLIST *fifo = memex_fifo_create(pool, sizeof(struct keyed_t));
+    memex_list_sort_set(fifo, struct keyed_t, key, MEMEX_SORT_TYPE_INT32);
+    for (int i = 0; i < 10; i++) {
+        struct keyed_t e = {i, 10 - i};
+        memex_list_push(fifo, &e);
+    }
+    k = 3;
+    f = memex_list_find(fifo, &k);
+    ASSERT_NOT_NULL(f);
+    ASSERT_EQUAL(f->id, 7);
+    ASSERT_FAILURE(memex_list_set_sorted(fifo, struct keyed_t, key, MEMEX_SORT_TYPE_INT32));
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static int
+index_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *list = memex_list_create(pool, sizeof(struct keyed_t));
+    ASSERT_SUCCESS(memex_list_index_create(list, struct keyed_t, id, MEMEX_SORT_TYPE_INT32));
+
+    // Keys are written after new_entry(); the next lookup indexes them
+    for (int i = 0; i < 1000; i++) {
+        struct keyed_t *e = memex_list_new_entry(list);
+        e->id = i * 3;
+        e->key = i;
+    }
+
+    int id = 300;
+    struct keyed_t *f = memex_list_find(list, &id);
+    ASSERT_NOT_NULL(f);
+    ASSERT_EQUAL(f->key, 100);
+    id = 301;
+    ASSERT_NULL(memex_list_find(list, &id));
+
+    // Removing from the middle shifts entries; the index follows
+    memex_list_remove_index(list, 10);
+    id = 30;
+    ASSERT_NULL(memex_list_find(list, &id));
+    id = 33;
+    f = memex_list_find(list, &id);
+    ASSERT_NOT_NULL(f);
+    ASSERT_EQUAL(f->key, 11);
+
+    memex_list_remove_index(list, memex_list_count(list) - 1);
+    id = 2997;
+    ASSERT_NULL(memex_list_find(list, &id));
+
+    // Keys changed in place need the index re-created
+    f = memex_list_get_entry(list, 0);
+    f->id = 100000;
+    ASSERT_SUCCESS(memex_list_index_create(list, struct keyed_t, id, MEMEX_SORT_TYPE_INT32));
+    id = 100000;
+    f = memex_list_find(list, &id);
+    ASSERT_NOT_NULL(f);
+    ASSERT_EQUAL(f->key, 0);
+
+    // A lookup between new_entry() and writing the key must not index the
+    // entry under its zeroed key
+    struct keyed_t *e = memex_list_new_entry(list);
+    id = 33;
+    ASSERT_NOT_NULL(memex_list_find(list, &id));
+    id = 424242;
+    ASSERT_NULL(memex_list_find(list, &id));
+    e->id = 5000;
+    e->key = -1;
+    id = 5000;
+    f = memex_list_find(list, &id);
+    ASSERT_EQUAL(f, e);
+
+    // The next append publishes it
+    e = memex_list_new_entry(list);
+    e->id = 6000;
+    f = memex_list_find(list, &id);
+    ASSERT_NOT_NULL(f);
+    ASSERT_EQUAL(f->key, -1);
+    id = 6000;
+    ASSERT_EQUAL(memex_list_find(list, &id), e);
+    id = 0;
+    ASSERT_NULL(memex_list_find(list, &id));
+
+    memex_list_clear(list);
+    id = 6000;
+    ASSERT_NULL(memex_list_find(list, &id));
+
+    // FIFO pops and ring wraps keep the index
+    MLIST *fifo = memex_fifo_create(pool, sizeof(struct keyed_t));
+    ASSERT_SUCCESS(memex_list_index_create(fifo, struct keyed_t, id, MEMEX_SORT_TYPE_INT32));
+    int next = 0;
+    for (int round = 0; round < 50; round++) {
+        for (int i = 0; i < 7; i++, next++) {
+            struct keyed_t e = {next, round};
+            memex_list_push(fifo, &e);
+        }
+
+        struct keyed_t out;
+        uint32_t n;
+        for (int i = 0; i < 5; i++) {
+            memex_list_pop(fifo, &out, &n);
+            ASSERT_NULL(memex_list_find(fifo, &out.id));
+        }
+
+        id = next - 1;
+        f = memex_list_find(fifo, &id);
+        ASSERT_NOT_NULL(f);
+        ASSERT_EQUAL(f->key, round);
+    }
+    ASSERT_EQUAL(memex_list_count(fifo), 100);
+    id = next - 100;
+    f = memex_list_find(fifo, &id);
+    ASSERT_NOT_NULL(f);
+    ASSERT_EQUAL(f, memex_list_get_entry(fifo, 0));
+
+    // Duplicate keys find the first entry, including after it is popped
+    MLIST *stack = memex_stack_create(pool, sizeof(struct keyed_t));
+    ASSERT_SUCCESS(memex_list_index_create(stack, struct keyed_t, id, MEMEX_SORT_TYPE_INT32));
+    for (int i = 0; i < 4; i++) {
+        struct keyed_t e = {7, i};
+        memex_list_push(stack, &e);
+    }
+    id = 7;
+    f = memex_list_find(stack, &id);
+    ASSERT_EQUAL(f->key, 0);
+    memex_list_remove_before_index(stack, 1);
+    f = memex_list_find(stack, &id);
+    ASSERT_EQUAL(f->key, 1);
+    memex_list_consume(stack, 3);
+    ASSERT_NULL(memex_list_find(stack, &id));
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static int
+persist_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/memex-list-test-%d", (int)getpid());
+
+    MLIST *list = memex_list_create(pool, sizeof(struct keyed_t));
+    ASSERT_SUCCESS(memex_list_set_sorted(list, struct keyed_t, key, MEMEX_SORT_TYPE_INT32));
+    for (int i = 0; i < 10000; i++) {
+        struct keyed_t e = {i, (i * 7919) % 10000};
+        memex_list_insert(list, &e);
+    }
+    ASSERT_SUCCESS(memex_list_save(list, path));
+
+    // The copy keeps the entries and the sort descriptor
+    MLIST *mapped = memex_list_map(pool, path);
+    ASSERT_NOT_NULL(mapped);
+    uint32_t N, M;
+    struct keyed_t *a = memex_list_get_entries(list, &N);
+    struct keyed_t *b = memex_list_get_entries(mapped, &M);
+    ASSERT_EQUAL(M, N);
+    ASSERT_EQUAL(memcmp(a, b, N * sizeof(struct keyed_t)), 0);
+
+    int32_t k = 1234;
+    struct keyed_t *f = memex_list_find(mapped, &k);
+    ASSERT_NOT_NULL(f);
+    ASSERT_EQUAL(f->key, 1234);
+
+    // Writes stay private, and growing moves the buffer to the heap
+    f->id = -1;
+    struct keyed_t e = {-2, 5000};
+    ASSERT_NOT_NULL(memex_list_insert(mapped, &e));
+    ASSERT_EQUAL(memex_list_count(mapped), 10001);
+    f = memex_list_find(mapped, &k);
+    ASSERT_EQUAL(f->id, -1);
+
+    MLIST *again = memex_list_map(pool, path);
+    f = memex_list_find(again, &k);
+    ASSERT_NOT_EQUAL(f->id, -1);
+    ASSERT_EQUAL(memex_list_count(again), 10000);
+    memex_list_destroy(again);
+    memex_list_destroy(mapped);
+
+    // A wrapped FIFO ring is saved in pop order
+    MLIST *fifo = memex_fifo_create(pool, sizeof(int));
+    for (int i = 0; i < 16; i++) {
+        memex_list_push(fifo, &i);
+    }
+    int v;
+    for (int i = 0; i < 10; i++) {
+        memex_list_pop(fifo, &v, &N);
+    }
+    for (int i = 16; i < 24; i++) {
+        memex_list_push(fifo, &i);
+    }
+    ASSERT_SUCCESS(memex_list_save(fifo, path));
+    mapped = memex_list_map(pool, path);
+    ASSERT_EQUAL(memex_list_count(mapped), 14);
+    for (int i = 10; i < 24; i++) {
+        ASSERT_SUCCESS(memex_list_pop(mapped, &v, &N));
+        ASSERT_EQUAL(v, i);
+    }
+    memex_list_push(mapped, &v);
+    ASSERT_EQUAL(memex_list_count(mapped), 1);
+
+    // Empty lists round-trip; anything else is rejected
+    memex_list_clear(fifo);
+    ASSERT_SUCCESS(memex_list_save(fifo, path));
+    mapped = memex_list_map(pool, path);
+    ASSERT_NOT_NULL(mapped);
+    ASSERT_EQUAL(memex_list_count(mapped), 0);
+
+    FILE *fp = fopen(path, "w");
+    fputs("not a list", fp);
+    fclose(fp);
+    ASSERT_NULL(memex_list_map(pool, path));
+
+    unlink(path);
+    ASSERT_NULL(memex_list_map(pool, path));
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+// 1024 entries per journal segment
+struct journal_entry_t {
+    uint32_t seq;
+    char pad[16380];
+};
+
+static int
+journal_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    char path[64];
+    char seg[80];
+    snprintf(path, sizeof(path), "/tmp/memex-journal-test-%d", (int)getpid());
+
+    MLIST *fifo = memex_fifo_create(pool, sizeof(struct journal_entry_t));
+    ASSERT_SUCCESS(memex_fifo_set_journal(fifo, path, 64));
+    ASSERT_FAILURE(memex_fifo_set_journal(fifo, path, 64));
+    ASSERT_NULL(memex_list_new_entry(fifo));
+
+    struct journal_entry_t *batch = malloc(8 * sizeof(struct journal_entry_t));
+    struct journal_entry_t e;
+    uint32_t pushed = 0;
+    uint32_t popped = 0;
+    uint32_t n;
+
+    // Push 3 for every pop, so the journal spans several segments
+    while (pushed < 3000) {
+        for (int i = 0; i < 8; i++) {
+            batch[i].seq = pushed++;
+        }
+        ASSERT_SUCCESS(memex_list_push_n(fifo, batch, 8));
+
+        for (int i = 0; i < 2; i++) {
+            ASSERT_SUCCESS(memex_list_pop(fifo, &e, &n));
+            ASSERT_EQUAL(n, 1);
+            ASSERT_EQUAL(e.seq, popped++);
+        }
+        ASSERT_SUCCESS(memex_list_pop_n(fifo, batch, 1, &n));
+        ASSERT_EQUAL(batch[0].seq, popped++);
+
+        uint32_t n_mem;
+        memex_list_get_entries(fifo, &n_mem);
+        ASSERT_EQUAL(n_mem <= 64, 1);
+        ASSERT_EQUAL(memex_list_count(fifo), pushed - popped);
+    }
+
+    // Drain in order; read segments are removed
+    while (popped < pushed) {
+        ASSERT_SUCCESS(memex_list_pop_n(fifo, batch, 8, &n));
+        ASSERT_EQUAL(n > 0, 1);
+        for (int i = 0; i < n; i++) {
+            ASSERT_EQUAL(batch[i].seq, popped++);
+        }
+    }
+    ASSERT_SUCCESS(memex_list_pop(fifo, &e, &n));
+    ASSERT_EQUAL(n, 0);
+    snprintf(seg, sizeof(seg), "%s.000000", path);
+    ASSERT_NOT_EQUAL(access(seg, F_OK), 0);
+
+    // Peeks and consumes reach past the hot window
+    for (uint32_t i = 0; i < 200; i++) {
+        e.seq = i;
+        memex_list_push(fifo, &e);
+    }
+    memex_list_acquire(fifo);
+    ASSERT_NULL(memex_list_peek_back(fifo, NULL));
+    memex_list_consume(fifo, 64);
+    struct journal_entry_t *p = memex_list_peek_front(fifo, NULL);
+    ASSERT_NOT_NULL(p);
+    ASSERT_EQUAL(p->seq, 64);
+    memex_list_consume(fifo, 100);
+    p = memex_list_peek_front(fifo, NULL);
+    ASSERT_NOT_NULL(p);
+    ASSERT_EQUAL(p->seq, 164);
+    ASSERT_EQUAL(memex_list_count(fifo), 36);
+    memex_list_consume(fifo, 1000);
+    ASSERT_EQUAL(memex_list_count(fifo), 0);
+    ASSERT_NULL(memex_list_peek_front(fifo, NULL));
+    memex_list_release(fifo);
+
+    // Clearing drops the journal as well
+    for (uint32_t i = 0; i < 200; i++) {
+        e.seq = i;
+        memex_list_push(fifo, &e);
+    }
+    ASSERT_EQUAL(memex_list_count(fifo), 200);
+    memex_list_clear(fifo);
+    ASSERT_EQUAL(memex_list_count(fifo), 0);
+    e.seq = 7;
+    memex_list_push(fifo, &e);
+    ASSERT_SUCCESS(memex_list_pop(fifo, &e, &n));
+    ASSERT_EQUAL(e.seq, 7);
+
+    for (uint32_t i = 0; i < 200; i++) {
+        memex_list_push(fifo, &e);
+    }
+    memex_list_destroy(fifo);
+    for (int i = 0; i < 10; i++) {
+        snprintf(seg, sizeof(seg), "%s.%06d", path, i);
+        ASSERT_NOT_EQUAL(access(seg, F_OK), 0);
+    }
+
+    free(batch);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static int
+light_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+
+    int N = 1000;
+    MLIST **lists = palloc(pool, N * sizeof(MLIST *));
+    for (int n = 0; n < N; n++) {
+        lists[n] = memex_fifo_create_flags(pool, sizeof(int), MEMEX_NOSUBPOOL);
+        ASSERT_NOT_NULL(lists[n]);
+        ASSERT_EQUAL(memex_list_get_pool(lists[n]), pool);
+        for (int i = 0; i < 20; i++) {
+            memex_list_push(lists[n], &i);
+        }
+    }
+
+    for (int n = 0; n < N; n++) {
+        int x;
+        memex_list_pop(lists[n], &x, NULL);
+        ASSERT_EQUAL(x, 0);
+    }
+
+    // Destroy in an interleaved order to exercise the pool's free path
+    for (int n = 0; n < N; n += 2) {
+        memex_list_destroy(lists[n]);
+    }
+    for (int n = 1; n < N; n += 2) {
+        uint32_t M;
+        memex_list_get_entries(lists[n], &M);
+        ASSERT_EQUAL(M, 19);
+        memex_list_destroy(lists[n]);
+    }
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static int
+reserve_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+
+    MLIST *list = memex_list_create(pool, sizeof(int));
+    int *x = memex_list_new_entry_uninit(list);
+    ASSERT_NOT_NULL(x);
+    *x = -1;
+
+    // Fill outside the lock; only a part of the reservation is used
+    int *first;
+    void *other;
+    ASSERT_SUCCESS(memex_list_append_reserve(list, 100, (void **)&first));
+    ASSERT_FAILURE(memex_list_append_reserve(list, 1, &other));
+    ASSERT_NULL(other);
+    ASSERT_NULL(memex_list_new_entry(list));
+    ASSERT_EQUAL(memex_list_count(list), 1);
+
+    // The buffer must not move under the reservation
+    memex_list_shrink_to_fit(list);
+    for (int i = 0; i < 90; i++) {
+        first[i] = i;
+    }
+    ASSERT_FAILURE(memex_list_append_commit(list, 101));
+    ASSERT_SUCCESS(memex_list_append_commit(list, 90));
+    ASSERT_EQUAL(memex_list_count(list), 91);
+    ASSERT_EQUAL(*(int *)memex_list_get_entry(list, 90), 89);
+
+    // Removing entries while reserved slides the new ones down on commit
+    ASSERT_SUCCESS(memex_list_append_reserve(list, 10, (void **)&first));
+    memex_list_remove_index(list, 0);
+    memex_list_remove_index(list, 0);
+    for (int i = 0; i < 10; i++) {
+        first[i] = 1000 + i;
+    }
+    ASSERT_SUCCESS(memex_list_append_commit(list, 10));
+    ASSERT_EQUAL(memex_list_count(list), 99);
+    ASSERT_EQUAL(*(int *)memex_list_get_entry(list, 88), 89);
+    ASSERT_EQUAL(*(int *)memex_list_get_entry(list, 89), 1000);
+    ASSERT_EQUAL(*(int *)memex_list_get_entry(list, 98), 1009);
+
+    // A wrapped FIFO ring is unwrapped so the slots are contiguous
+    MLIST *fifo = memex_fifo_create(pool, sizeof(int));
+    memex_list_reserve(fifo, 16);
+    for (int i = 0; i < 12; i++) {
+        memex_list_push(fifo, &i);
+    }
+    int y;
+    for (int i = 0; i < 8; i++) {
+        memex_list_pop(fifo, &y, NULL);
+    }
+    for (int i = 12; i < 20; i++) {
+        memex_list_push(fifo, &i);
+    }
+    ASSERT_SUCCESS(memex_list_append_reserve(fifo, 4, (void **)&first));
+    ASSERT_FAILURE(memex_list_push(fifo, &y));
+    for (int i = 0; i < 4; i++) {
+        first[i] = 20 + i;
+    }
+
+    // Pops keep working, and the last one resets the ring
+    for (int i = 0; i < 12; i++) {
+        memex_list_pop(fifo, &y, NULL);
+        ASSERT_EQUAL(y, 8 + i);
+    }
+    ASSERT_SUCCESS(memex_list_append_commit(fifo, 4));
+    for (int i = 0; i < 4; i++) {
+        uint32_t n;
+        memex_list_pop(fifo, &y, &n);
+        ASSERT_EQUAL(n, 1);
+        ASSERT_EQUAL(y, 20 + i);
+    }
+    ASSERT_EQUAL(memex_list_count(fifo), 0);
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static int
+is_odd(const void *entry, void *ctx)
+{
+    return *(const int *)entry % 2;
+}
+
+static int
+bulk_remove_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+
+    MLIST *list = memex_list_create(pool, sizeof(int));
+    for (int i = 0; i < 1000; i++) {
+        int *x = memex_list_new_entry(list);
+        *x = i;
+    }
+    ASSERT_EQUAL(memex_list_remove_if(list, is_odd, NULL), 500);
+    ASSERT_EQUAL(memex_list_remove_if(list, is_odd, NULL), 0);
+    ASSERT_EQUAL(memex_list_count(list), 500);
+    for (int i = 0; i < 500; i++) {
+        ASSERT_EQUAL(*(int *)memex_list_get_entry(list, i), i * 2);
+    }
+
+    // Compaction follows the ring of a wrapped FIFO
+    MLIST *fifo = memex_fifo_create(pool, sizeof(int));
+    memex_list_reserve(fifo, 16);
+    int y;
+    for (int i = 0; i < 12; i++) {
+        memex_list_push(fifo, &i);
+    }
+    for (int i = 0; i < 8; i++) {
+        memex_list_pop(fifo, &y, NULL);
+    }
+    for (int i = 12; i < 20; i++) {
+        memex_list_push(fifo, &i);
+    }
+    ASSERT_EQUAL(memex_list_remove_if(fifo, is_odd, NULL), 6);
+    for (int i = 0; i < 6; i++) {
+        memex_list_pop(fifo, &y, NULL);
+        ASSERT_EQUAL(y, 8 + i * 2);
+    }
+
+    // Swap-remove moves the last entry into the hole, and keeps the index
+    MLIST *keyed = memex_list_create(pool, sizeof(struct keyed_t));
+    ASSERT_SUCCESS(memex_list_index_create(keyed, struct keyed_t, id, MEMEX_SORT_TYPE_INT32));
+    for (int i = 0; i < 100; i++) {
+        struct keyed_t *e = memex_list_new_entry(keyed);
+        e->id = i;
+    }
+    int id = 99;
+    ASSERT_NOT_NULL(memex_list_find(keyed, &id));
+    memex_list_swap_remove(keyed, 10);
+    memex_list_swap_remove(keyed, 98);
+    ASSERT_EQUAL(memex_list_count(keyed), 98);
+    ASSERT_EQUAL(((struct keyed_t *)memex_list_get_entry(keyed, 10))->id, 99);
+
+    id = 10;
+    ASSERT_NULL(memex_list_find(keyed, &id));
+    id = 98;
+    ASSERT_NULL(memex_list_find(keyed, &id));
+    id = 99;
+    ASSERT_EQUAL(((struct keyed_t *)memex_list_find(keyed, &id))->id, 99);
+    id = 97;
+    ASSERT_EQUAL(((struct keyed_t *)memex_list_find(keyed, &id))->id, 97);
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+struct sample_t {
+    double x;
+    double y;
+    int32_t pad;
+};
+
+static void
+square_fn(void *entry, void *ctx)
+{
+    struct sample_t *e = (struct sample_t *)entry;
+    e->y = e->x * e->x;
+}
+
+static void
+sum_fn(void *acc, const void *entry, void *ctx)
+{
+    *(double *)acc += ((const struct sample_t *)entry)->y;
+}
+
+static void
+add_fn(void *acc, const void *other, void *ctx)
+{
+    *(double *)acc += *(const double *)other;
+}
+
+static int
+parallel_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+
+    // A wrapped FIFO ring, with an entry size that is not a cache line divisor
+    int N = 100003;
+    MLIST *fifo = memex_fifo_create(pool, sizeof(struct sample_t));
+    struct sample_t e = {0};
+    for (int i = 0; i < N + 100; i++) {
+        e.x = i % 1000;
+        memex_list_push(fifo, &e);
+    }
+    for (int i = 0; i < 100; i++) {
+        memex_list_pop(fifo, &e, NULL);
+    }
+    for (int i = 0; i < 100; i++) {
+        e.x = i;
+        memex_list_push(fifo, &e);
+    }
+
+    ASSERT_SUCCESS(memex_list_parallel_for(fifo, square_fn, NULL, 7));
+
+    double expect = 0.0;
+    for (int i = 100; i < N + 100; i++) {
+        expect += (double)(i % 1000) * (i % 1000);
+    }
+    for (int i = 0; i < 100; i++) {
+        expect += (double)i * i;
+    }
+
+    double sum = 0.0;
+    ASSERT_SUCCESS(memex_list_parallel_reduce(fifo, sum_fn, add_fn, &sum, sizeof(sum), NULL, 5));
+    ASSERT_EQUAL(sum, expect);
+
+    // Small lists and the default thread count
+    MLIST *small = memex_list_create(pool, sizeof(struct sample_t));
+    sum = 0.0;
+    ASSERT_SUCCESS(memex_list_parallel_reduce(small, sum_fn, add_fn, &sum, sizeof(sum), NULL, 0));
+    ASSERT_EQUAL(sum, 0.0);
+    struct sample_t *s = memex_list_new_entry(small);
+    s->x = 3.0;
+    ASSERT_SUCCESS(memex_list_parallel_for(small, square_fn, NULL, 0));
+    ASSERT_SUCCESS(memex_list_parallel_reduce(small, sum_fn, add_fn, &sum, sizeof(sum), NULL, 0));
+    ASSERT_EQUAL(sum, 9.0);
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+// Thread-confined lists and pools behave the same without their locks
+static void *
+nolock_worker(void *args)
+{
+    POOL *pool = (POOL *)args;
+    MLIST *fifo = memex_fifo_create_flags(pool, sizeof(int), MEMEX_NOLOCK);
+    POOL *scratch = create_subpool_flags(pool, MEMEX_NOLOCK);
+
+    long sum = 0;
+    for (int i = 0; i < 10000; i++) {
+        memex_list_push(fifo, &i);
+        int *x = palloc(scratch, sizeof(int));
+        *x = i;
+        if (i % 3 == 0) {
+            int y;
+            memex_list_pop(fifo, &y, NULL);
+            sum += y;
+            pfree(scratch, x);
+        }
+    }
+
+    sum += memex_list_count(fifo);
+    memex_list_destroy(fifo);
+    free_pool(scratch);
+    return (void *)sum;
+}
+
+static int
+nolock_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+
+    MLIST *list = memex_list_create_flags(pool, sizeof(int), MEMEX_NOLOCK);
+    ASSERT_NOT_NULL(list);
+    for (int i = 0; i < 100; i++) {
+        int *x = memex_list_new_entry(list);
+        *x = i;
+    }
+    memex_list_remove_index(list, 10);
+    ASSERT_EQUAL(memex_list_count(list), 99);
+    ASSERT_EQUAL(*(int *)memex_list_get_entry(list, 10), 11);
+
+    memex_list_acquire(list);
+    memex_list_acquire(list);
+    memex_list_release(list);
+    memex_list_release(list);
+    memex_list_destroy(list);
+
+    ASSERT_NULL(memex_queue_create(pool, sizeof(int), 8, MEMEX_NOLOCK));
+
+    // One confined list and pool per thread, under a shared locked pool
+    pthread_t id[4];
+    for (int n = 0; n < 4; n++) {
+        pthread_create(&id[n], NULL, nolock_worker, pool);
+    }
+
+    // Pops take 0, 1, ... 3333 in order; 6666 entries remain
+    long expect = (3334L * 3333L) / 2 + 6666;
+    for (int n = 0; n < 4; n++) {
+        void *sum;
+        pthread_join(id[n], &sum);
+        ASSERT_EQUAL((long)sum, expect);
+    }
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
 int
 main(int nargs, char *argv[])
 {
@@ -324,6 +1992,27 @@ main(int nargs, char *argv[])
     testex_add(remove_test);
     testex_add(thread_test);
     testex_add(fifo_stack_test);
+    testex_add(fifo_ring_test);
+    testex_add(spsc_test);
+    testex_add(deque_test);
+    testex_add(queue_test);
+    testex_add(batch_test);
+    testex_add(growth_test);
+    testex_add(seglist_test);
+    testex_add(vmlist_test);
+    testex_add(peek_test);
+    testex_add(snapshot_test);
+    testex_add(copy_shared_test);
+    testex_add(pqueue_test);
+    testex_add(sorted_test);
+    testex_add(index_test);
+    testex_add(persist_test);
+    testex_add(journal_test);
+    testex_add(light_test);
+    testex_add(nolock_test);
+    testex_add(reserve_test);
+    testex_add(bulk_remove_test);
+    testex_add(parallel_test);
 
     testex_run();
     testex_cleanup();
@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "memex.h"
+
+#define LOGEX_TAG "MAP-BENCH"
+#define LOGEX_MAIN
+#include <logex.h>
+
+#define BENCH_N 1000000
+
+static inline uint64_t
+now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Scrambled keys, so neither table sees sequential hashes
+static inline uint64_t
+bench_key(uint64_t i)
+{
+    uint64_t x = (i + 1) * 0x9E3779B97F4A7C15ULL;
+    return x ^ (x >> 29);
+}
+
+/*
+ *  Lookups visit the keys in a different order than they were inserted;
+ *  otherwise chained nodes, allocated in insertion order, are walked in
+ *  memory order and look far cheaper than they are
+ */
+static inline uint64_t
+bench_order(uint64_t i)
+{
+    return (i * 7919) % BENCH_N;
+}
+
+/*
+ *  Naive chained table: one malloc per node, full rehash on growth
+ */
+struct chain_node_t {
+    uint64_t key;
+    uint64_t value;
+    struct chain_node_t *next;
+};
+
+struct chain_t {
+    struct chain_node_t **buckets;
+    uint64_t cap;
+    uint64_t count;
+};
+
+static inline uint64_t
+chain_hash(uint64_t key, uint64_t cap)
+{
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    return key & (cap - 1);
+}
+
+static void
+chain_rehash(struct chain_t *c)
+{
+    uint64_t cap = c->cap * 2;
+    struct chain_node_t **buckets = calloc(cap, sizeof(struct chain_node_t *));
+    uint64_t i;
+    for (i = 0; i < c->cap; i++) {
+        struct chain_node_t *n = c->buckets[i];
+        while (n) {
+            struct chain_node_t *next = n->next;
+            uint64_t b = chain_hash(n->key, cap);
+            n->next = buckets[b];
+            buckets[b] = n;
+            n = next;
+        }
+    }
+    free(c->buckets);
+    c->buckets = buckets;
+    c->cap = cap;
+}
+
+static void
+chain_put(struct chain_t *c, uint64_t key, uint64_t value)
+{
+    if (c->count >= c->cap) {
+        chain_rehash(c);
+    }
+
+    uint64_t b = chain_hash(key, c->cap);
+    struct chain_node_t *n;
+    for (n = c->buckets[b]; n; n = n->next) {
+        if (n->key == key) {
+            n->value = value;
+            return;
+        }
+    }
+
+    n = malloc(sizeof(struct chain_node_t));
+    n->key = key;
+    n->value = value;
+    n->next = c->buckets[b];
+    c->buckets[b] = n;
+    c->count++;
+}
+
+static uint64_t *
+chain_get(struct chain_t *c, uint64_t key)
+{
+    struct chain_node_t *n;
+    for (n = c->buckets[chain_hash(key, c->cap)]; n; n = n->next) {
+        if (n->key == key) {
+            return &n->value;
+        }
+    }
+    return NULL;
+}
+
+static int
+chain_remove(struct chain_t *c, uint64_t key)
+{
+    struct chain_node_t **p = &c->buckets[chain_hash(key, c->cap)];
+    while (*p) {
+        if ((*p)->key == key) {
+            struct chain_node_t *n = *p;
+            *p = n->next;
+            free(n);
+            c->count--;
+            return 0;
+        }
+        p = &(*p)->next;
+    }
+    return 1;
+}
+
+static void
+chain_free(struct chain_t *c)
+{
+    uint64_t i;
+    for (i = 0; i < c->cap; i++) {
+        while (c->buckets[i]) {
+            struct chain_node_t *n = c->buckets[i];
+            c->buckets[i] = n->next;
+            free(n);
+        }
+    }
+    free(c->buckets);
+}
+
+static void
+report(const char *name, const char *op, uint64_t elapsed, uint64_t worst, uint64_t check)
+{
+    info("%-6s %-7s %10.0f ops/s  worst=%" PRIu64 "ns  (check %" PRIu64 ")",
+        name, op, (double)BENCH_N * 1e9 / (double)elapsed, worst, check);
+}
+
+static void
+bench_chain()
+{
+    struct chain_t c = {calloc(16, sizeof(struct chain_node_t *)), 16, 0};
+    uint64_t i, start, t, worst = 0, check = 0;
+
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i++) {
+        t = now_ns();
+        chain_put(&c, bench_key(i), i);
+        t = now_ns() - t;
+        worst = (t > worst) ? t : worst;
+    }
+    report("chain", "insert", now_ns() - start, worst, c.count);
+
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i++) {
+        check += *chain_get(&c, bench_key(bench_order(i)));
+    }
+    report("chain", "hit", now_ns() - start, 0, check);
+
+    check = 0;
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i++) {
+        check += (chain_get(&c, bench_key(i + BENCH_N)) != NULL);
+    }
+    report("chain", "miss", now_ns() - start, 0, check);
+
+    check = 0;
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i++) {
+        check += chain_remove(&c, bench_key(bench_order(i)));
+    }
+    report("chain", "remove", now_ns() - start, 0, check);
+
+    chain_free(&c);
+}
+
+static void
+bench_map(POOL *pool)
+{
+    MMAP *map = memex_map_create(pool, sizeof(uint64_t), sizeof(uint64_t));
+    uint64_t i, start, t, worst = 0, check = 0;
+
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i++) {
+        uint64_t k = bench_key(i);
+        t = now_ns();
+        memex_map_put(map, &k, &i);
+        t = now_ns() - t;
+        worst = (t > worst) ? t : worst;
+    }
+    report("memex", "insert", now_ns() - start, worst, memex_map_count(map));
+
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i++) {
+        uint64_t k = bench_key(bench_order(i));
+        check += *(uint64_t *)memex_map_get(map, &k);
+    }
+    report("memex", "hit", now_ns() - start, 0, check);
+
+    check = 0;
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i++) {
+        uint64_t k = bench_key(i + BENCH_N);
+        check += (memex_map_get(map, &k) != NULL);
+    }
+    report("memex", "miss", now_ns() - start, 0, check);
+
+    check = 0;
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i++) {
+        uint64_t k = bench_key(bench_order(i));
+        check += memex_map_remove(map, &k, NULL);
+    }
+    report("memex", "remove", now_ns() - start, 0, check);
+
+    memex_map_destroy(map);
+}
+
+int
+main(int nargs, char *argv[])
+{
+    set_log_level_default_str("info");
+
+    POOL *pool = create_pool();
+    bench_chain();
+    bench_map(pool);
+    pool_cleanup();
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <testex.h>
+#include "memex.h"
+
+#define LOGEX_TAG "MAP-TEST"
+#define LOGEX_MAIN
+#include <logex.h>
+
+struct point_t {
+    double x;
+    double y;
+};
+
+static int
+basic_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MMAP *map = memex_map_create(pool, sizeof(uint64_t), sizeof(struct point_t));
+    ASSERT_NOT_NULL(map);
+
+    uint64_t k = 42;
+    ASSERT_NULL(memex_map_get(map, &k));
+
+    struct point_t p = {1.0, 2.0};
+    struct point_t *v = memex_map_put(map, &k, &p);
+    ASSERT_NOT_NULL(v);
+    ASSERT_EQUAL(v->y, 2.0);
+    ASSERT_EQUAL(((uintptr_t)v) % 8, 0);
+
+    // Overwrite in place
+    p.y = 3.0;
+    memex_map_put(map, &k, &p);
+    ASSERT_EQUAL(memex_map_count(map), 1);
+    v = memex_map_get(map, &k);
+    ASSERT_EQUAL(v->y, 3.0);
+
+    struct point_t out;
+    ASSERT_SUCCESS(memex_map_remove(map, &k, &out));
+    ASSERT_EQUAL(out.x, 1.0);
+    ASSERT_FAILURE(memex_map_remove(map, &k, NULL));
+    ASSERT_EQUAL(memex_map_count(map), 0);
+
+    // Odd-sized keys are compared bytewise
+    MMAP *names = memex_map_create(pool, 5, sizeof(int));
+    int one = 1;
+    int two = 2;
+    memex_map_put(names, "abcd", &one);
+    memex_map_put(names, "abce", &two);
+    ASSERT_EQUAL(*(int *)memex_map_get(names, "abcd"), 1);
+    ASSERT_EQUAL(*(int *)memex_map_get(names, "abce"), 2);
+    ASSERT_NULL(memex_map_get(names, "abcf"));
+
+    memex_map_destroy(names);
+    memex_map_destroy(map);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static int
+sum_fn(const void *key, void *value, void *ctx)
+{
+    *(uint64_t *)ctx += *(uint64_t *)value;
+    return 0;
+}
+
+static int
+resize_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MMAP *map = memex_map_create(pool, sizeof(uint64_t), sizeof(uint64_t));
+
+    // Interleave inserts and removes so both tables are live during growth
+    uint64_t N = 100000;
+    for (uint64_t i = 0; i < N; i++) {
+        uint64_t v = i * 3;
+        ASSERT_NOT_NULL(memex_map_put(map, &i, &v));
+        if (i % 3 == 0) {
+            uint64_t r = i / 3;
+            ASSERT_SUCCESS(memex_map_remove(map, &r, NULL));
+        }
+
+        // Keys 0..i/3 are gone by now, the rest up to i are present
+        uint64_t c = (i * 7919) % (i + 1);
+        uint64_t *got = memex_map_get(map, &c);
+        if (c <= i / 3) {
+            ASSERT_NULL(got);
+        } else {
+            ASSERT_NOT_NULL(got);
+            ASSERT_EQUAL(*got, c * 3);
+        }
+    }
+
+    uint64_t removed = (N + 2) / 3;
+    ASSERT_EQUAL(memex_map_count(map), N - removed);
+    for (uint64_t i = 0; i < N; i++) {
+        uint64_t *got = memex_map_get(map, &i);
+        if (i < removed) {
+            ASSERT_NULL(got);
+        } else {
+            ASSERT_NOT_NULL(got);
+            ASSERT_EQUAL(*got, i * 3);
+        }
+    }
+
+    uint64_t sum = 0;
+    uint64_t expect = 0;
+    for (uint64_t i = removed; i < N; i++) {
+        expect += i * 3;
+    }
+    memex_map_foreach(map, sum_fn, &sum);
+    ASSERT_EQUAL(sum, expect);
+
+    memex_map_clear(map);
+    ASSERT_EQUAL(memex_map_count(map), 0);
+    uint64_t k = N - 1;
+    ASSERT_NULL(memex_map_get(map, &k));
+
+    memex_map_destroy(map);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+struct map_thread_t {
+    MMAP *map;
+    uint64_t base;
+};
+
+static void *
+map_worker(void *args)
+{
+    struct map_thread_t *t = (struct map_thread_t *)args;
+    for (uint64_t i = 0; i < 10000; i++) {
+        uint64_t k = t->base + i;
+        memex_map_put(t->map, &k, &k);
+    }
+    pthread_exit(NULL);
+}
+
+static int
+thread_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MMAP *map = memex_map_create(pool, sizeof(uint64_t), sizeof(uint64_t));
+
+    pthread_t id[4];
+    struct map_thread_t info[4];
+    for (int n = 0; n < 4; n++) {
+        info[n].map = map;
+        info[n].base = n * 1000000;
+        pthread_create(id + n, NULL, map_worker, &info[n]);
+    }
+    for (int n = 0; n < 4; n++) {
+        pthread_join(id[n], NULL);
+    }
+
+    ASSERT_EQUAL(memex_map_count(map), 40000);
+    uint64_t k = 3000000 + 9999;
+    ASSERT_EQUAL(*(uint64_t *)memex_map_get(map, &k), k);
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+int
+main(int nargs, char *argv[])
+{
+    memex_map_set_log_level("critical");
+    TESTEX_LOG_INIT("info");
+    testex_setup();
+
+    testex_add(basic_test);
+    testex_add(resize_test);
+    testex_add(thread_test);
+
+    testex_run();
+    testex_cleanup();
+}
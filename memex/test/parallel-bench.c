@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include "memex.h"
+
+#define LOGEX_TAG "PARALLEL-BENCH"
+#define LOGEX_MAIN
+#include <logex.h>
+
+#define BENCH_N 1000000
+#define BENCH_ROUNDS 20
+
+struct sample_t {
+    double x;
+    double y;
+    uint64_t id;
+};
+
+static inline uint64_t
+now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+scale_fn(void *entry, void *ctx)
+{
+    struct sample_t *e = (struct sample_t *)entry;
+    e->y = sqrt(e->x) * 1.0001 + e->y * 0.5;
+}
+
+static void
+sum_fn(void *acc, const void *entry, void *ctx)
+{
+    *(double *)acc += ((const struct sample_t *)entry)->y;
+}
+
+static void
+add_fn(void *acc, const void *other, void *ctx)
+{
+    *(double *)acc += *(const double *)other;
+}
+
+static void
+report(const char *op, uint32_t n_threads, uint64_t elapsed, uint64_t base)
+{
+    info("%-7s threads=%-2u %8.2f ms/pass  speedup %.2fx",
+        op, n_threads, (double)elapsed / BENCH_ROUNDS / 1e6, (double)base / (double)elapsed);
+}
+
+int
+main(int nargs, char *argv[])
+{
+    set_log_level_default_str("info");
+
+    POOL *pool = create_pool();
+    MLIST *list = memex_list_create(pool, sizeof(struct sample_t));
+    memex_list_reserve(list, BENCH_N);
+    uint32_t i;
+    for (i = 0; i < BENCH_N; i++) {
+        struct sample_t *e = memex_list_new_entry(list);
+        e->x = i;
+        e->id = i;
+    }
+
+    uint32_t threads[] = {1, 2, 4, 8};
+    uint64_t for_base = 0;
+    uint64_t reduce_base = 0;
+    double check = 0.0;
+    for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        int r;
+        uint64_t start = now_ns();
+        for (r = 0; r < BENCH_ROUNDS; r++) {
+            memex_list_parallel_for(list, scale_fn, NULL, threads[i]);
+        }
+        uint64_t elapsed = now_ns() - start;
+        for_base = for_base ? for_base : elapsed;
+        report("for", threads[i], elapsed, for_base);
+
+        start = now_ns();
+        for (r = 0; r < BENCH_ROUNDS; r++) {
+            double sum = 0.0;
+            memex_list_parallel_reduce(list, sum_fn, add_fn, &sum, sizeof(sum), NULL, threads[i]);
+            check += sum;
+        }
+        elapsed = now_ns() - start;
+        reduce_base = reduce_base ? reduce_base : elapsed;
+        report("reduce", threads[i], elapsed, reduce_base);
+    }
+    info("check %g", check);
+
+    pool_cleanup();
+
+    return 0;
+}
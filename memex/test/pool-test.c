@@ -2,6 +2,7 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
+#include <stdatomic.h>
 
 #include <testex.h>
 #include <memex.h>
@@ -120,6 +121,48 @@ free_test()
     return TESTEX_SUCCESS;
 }
 
+static int
+index_test()
+{
+    POOL *pool = create_pool();
+
+    int N = 1000;
+    int **x = palloc(pool, N * sizeof(int *));
+    for (int n = 0; n < N; n++) {
+        x[n] = palloc(pool, sizeof(int));
+        *x[n] = n;
+    }
+
+    // Resize and free out of allocation order
+    for (int n = 0; n < N; n += 3) {
+        x[n] = repalloc(x[n], 64 * sizeof(int), pool);
+        if (!x[n] || *x[n] != n) {
+            verbose("repalloc lost allocation %d", n);
+            return TESTEX_FAILURE;
+        }
+    }
+
+    for (int n = N - 1; n >= 0; n -= 2) {
+        pfree(pool, x[n]);
+        x[n] = NULL;
+    }
+
+    for (int n = 0; n < N; n++) {
+        if (!x[n]) {
+            continue;
+        }
+
+        x[n] = repalloc(x[n], 128 * sizeof(int), pool);
+        if (!x[n] || *x[n] != n) {
+            verbose("allocation %d not tracked after frees", n);
+            return TESTEX_FAILURE;
+        }
+    }
+
+    free_pool(pool);
+    return TESTEX_SUCCESS;
+}
+
 static void *
 pool_worker(void *args)
 {
@@ -191,6 +234,69 @@ thread_test()
     return TESTEX_SUCCESS;
 }
 
+static _Atomic int epoch_reader_go = 0;
+
+static void *
+epoch_reader(void *args)
+{
+    int *_Atomic *shared = (int *_Atomic *)args;
+
+    memex_epoch_enter();
+    int *x = atomic_load_explicit(shared, memory_order_acquire);
+    atomic_store_explicit(&epoch_reader_go, 1, memory_order_release);
+    while (atomic_load_explicit(&epoch_reader_go, memory_order_acquire) == 1) {
+        usleep(1000);
+    }
+    int val = *x;
+    memex_epoch_exit();
+
+    pthread_exit((void *)(intptr_t)val);
+}
+
+static int
+epoch_test()
+{
+    POOL *pool = create_pool();
+    int *first = palloc(pool, sizeof(int));
+    *first = 42;
+    int *_Atomic shared = first;
+
+    pthread_t id;
+    pthread_create(&id, NULL, epoch_reader, (void *)&shared);
+    while (atomic_load_explicit(&epoch_reader_go, memory_order_acquire) == 0) {
+        usleep(1000);
+    }
+
+    // Swap the pointer and retire the old one while the reader still holds it
+    int *old = atomic_load_explicit(&shared, memory_order_acquire);
+    int *new = palloc(pool, sizeof(int));
+    *new = 43;
+    atomic_store_explicit(&shared, new, memory_order_release);
+    pfree_deferred(pool, old);
+
+    if (memex_epoch_reclaim() == 0) {
+        verbose("deferred free released inside reader epoch");
+        return TESTEX_FAILURE;
+    }
+
+    atomic_store_explicit(&epoch_reader_go, 2, memory_order_release);
+    void *val;
+    pthread_join(id, &val);
+    if ((intptr_t)val != 42) {
+        verbose("reader saw corrupted value");
+        return TESTEX_FAILURE;
+    }
+
+    memex_epoch_synchronize();
+    if (memex_epoch_reclaim() != 0) {
+        verbose("deferred free not released after synchronize");
+        return TESTEX_FAILURE;
+    }
+
+    free_pool(pool);
+    return TESTEX_SUCCESS;
+}
+
 int
 main(int nargs, char *argv[])
 {
@@ -199,6 +305,8 @@ main(int nargs, char *argv[])
 
     testex_add(basic_test);
     testex_add(free_test);
+    testex_add(index_test);
+    testex_add(epoch_test);
     testex_add(thread_test);
 
     testex_run();
@@ -242,6 +242,31 @@ basic_test()
     free_pool(pool);
 }
 
+static int
+negative_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MLIST *m = init_list(pool);
+
+    // Floating point keys must not be ordered by their bit patterns
+    uint32_t N;
+    struct test_t *entries = memex_list_get_entries(m, &N);
+    for (int n = 0; n < N; n++) {
+        entries[n].d -= 1.0;
+        entries[n].f -= 1.0f;
+    }
+
+    ASSERT_SUCCESS(sort_test_double(m));
+    ASSERT_SUCCESS(sort_test_float(m));
+
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
 static void *
 do_thread_fn(void *args)
 {
@@ -301,6 +326,7 @@ main(int nargs, char *argv[])
 
     testex_add(basic_test);
     testex_add(thread_test);
+    testex_add(negative_test);
 
     testex_run();
     testex_cleanup();
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "memex.h"
+
+#define LOGEX_TAG "SPSC-BENCH"
+#define LOGEX_MAIN
+#include <logex.h>
+
+#define BENCH_N 2000000
+#define BENCH_CAPACITY 1024
+
+struct bench_entry_t {
+    uint64_t seq;
+    uint64_t ts;
+};
+
+struct bench_t {
+    MLIST *q;
+    _Atomic uint64_t consumed;
+    uint64_t *latency;
+};
+
+static inline uint64_t
+now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *
+producer(void *args)
+{
+    struct bench_t *b = (struct bench_t *)args;
+
+    struct bench_entry_t e;
+    for (e.seq = 0; e.seq < BENCH_N; e.seq++) {
+        // Hold both queue types to the same capacity
+        while (e.seq - atomic_load_explicit(&b->consumed, memory_order_acquire) >= BENCH_CAPACITY) {
+            sched_yield();
+        }
+
+        e.ts = now_ns();
+        while (memex_list_push(b->q, &e) != 0) {
+            sched_yield();
+        }
+    }
+
+    pthread_exit(NULL);
+}
+
+static void *
+consumer(void *args)
+{
+    struct bench_t *b = (struct bench_t *)args;
+
+    uint64_t n = 0;
+    while (n < BENCH_N) {
+        struct bench_entry_t e;
+        uint32_t N;
+        memex_list_pop(b->q, &e, &N);
+        if (N == 0) {
+            continue;
+        }
+
+        b->latency[e.seq] = now_ns() - e.ts;
+        atomic_store_explicit(&b->consumed, ++n, memory_order_release);
+    }
+
+    pthread_exit(NULL);
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void
+run(const char *name, MLIST *q, POOL *pool)
+{
+    struct bench_t b;
+    b.q = q;
+    atomic_init(&b.consumed, 0);
+    b.latency = palloc(pool, BENCH_N * sizeof(uint64_t));
+
+    pthread_t p, c;
+    uint64_t start = now_ns();
+    pthread_create(&c, NULL, consumer, &b);
+    pthread_create(&p, NULL, producer, &b);
+    pthread_join(p, NULL);
+    pthread_join(c, NULL);
+    uint64_t elapsed = now_ns() - start;
+
+    qsort(b.latency, BENCH_N, sizeof(uint64_t), cmp_u64);
+    info("%-6s %10.0f ops/s  p50=%" PRIu64 "ns p99=%" PRIu64 "ns p99.9=%" PRIu64 "ns max=%" PRIu64 "ns",
+        name, (double)BENCH_N * 1e9 / (double)elapsed,
+        b.latency[BENCH_N / 2],
+        b.latency[(BENCH_N / 100) * 99],
+        b.latency[(BENCH_N / 1000) * 999],
+        b.latency[BENCH_N - 1]);
+}
+
+int
+main(int nargs, char *argv[])
+{
+    set_log_level_default_str("info");
+
+    POOL *pool = create_pool();
+    run("fifo", memex_fifo_create(pool, sizeof(struct bench_entry_t)), pool);
+    run("spsc", memex_spsc_create(pool, sizeof(struct bench_entry_t), BENCH_CAPACITY), pool);
+    pool_cleanup();
+
+    return 0;
+}
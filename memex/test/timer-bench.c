@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "memex.h"
+
+#define LOGEX_TAG "TIMER-BENCH"
+#define LOGEX_MAIN
+#include <logex.h>
+
+#define BENCH_N 1000000
+#define BENCH_SPAN 60000
+#define BENCH_SORT_TICKS 20
+
+static inline uint64_t
+now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Timeouts spread over a minute of millisecond ticks
+static inline uint64_t
+bench_deadline(uint64_t i)
+{
+    uint64_t x = (i + 1) * 0x9E3779B97F4A7C15ULL;
+    return 1 + ((x ^ (x >> 29)) % BENCH_SPAN);
+}
+
+struct timeout_t {
+    uint64_t deadline;
+    uint64_t id;
+};
+
+static uint64_t fired = 0;
+
+static void
+fire_fn(void *entry, uint64_t deadline, void *ctx)
+{
+    fired++;
+}
+
+static int
+expired(const void *entry, void *ctx)
+{
+    return ((const struct timeout_t *)entry)->deadline <= *(uint64_t *)ctx;
+}
+
+/*
+ *  Baseline: keep the timeouts in a list and sort it every tick, then drop
+ *  everything that has expired
+ */
+static void
+bench_sort(POOL *pool)
+{
+    MLIST *list = memex_list_create(pool, sizeof(struct timeout_t));
+    uint64_t i;
+    for (i = 0; i < BENCH_N; i++) {
+        struct timeout_t *t = memex_list_new_entry(list);
+        t->deadline = bench_deadline(i);
+        t->id = i;
+    }
+
+    fired = 0;
+    uint64_t start = now_ns();
+    uint64_t tick;
+    for (tick = 1; tick <= BENCH_SORT_TICKS; tick++) {
+        memex_list_sort_uint64(list, struct timeout_t, deadline);
+        fired += memex_list_remove_if(list, expired, &tick);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    info("sort   %10.1f us/tick  (%u ticks, fired %" PRIu64 ")",
+        (double)elapsed / 1000.0 / BENCH_SORT_TICKS, BENCH_SORT_TICKS, fired);
+
+    memex_list_destroy(list);
+}
+
+static void
+bench_wheel(POOL *pool)
+{
+    MWHEEL *wheel = memex_timer_wheel_create(pool, sizeof(uint64_t), 0);
+    uint32_t *handle = palloc(pool, BENCH_N * sizeof(uint32_t));
+
+    uint64_t start = now_ns();
+    uint64_t i;
+    for (i = 0; i < BENCH_N; i++) {
+        memex_timer_schedule(wheel, bench_deadline(i), &i, &handle[i]);
+    }
+    uint64_t elapsed = now_ns() - start;
+    info("wheel  %10.1f ns/schedule", (double)elapsed / BENCH_N);
+
+    // Cancel and re-arm a tenth of them, as a connection seeing traffic would
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i += 10) {
+        memex_timer_cancel(wheel, handle[i], NULL);
+        memex_timer_schedule(wheel, bench_deadline(i + BENCH_N), &i, &handle[i]);
+    }
+    elapsed = now_ns() - start;
+    info("wheel  %10.1f ns/cancel+schedule", (double)elapsed / (BENCH_N / 10));
+
+    fired = 0;
+    start = now_ns();
+    uint64_t tick;
+    for (tick = 1; tick <= BENCH_SPAN; tick++) {
+        memex_timer_advance(wheel, tick, fire_fn, NULL);
+    }
+    elapsed = now_ns() - start;
+
+    info("wheel  %10.1f us/tick  (%u ticks, fired %" PRIu64 ")",
+        (double)elapsed / 1000.0 / BENCH_SPAN, BENCH_SPAN, fired);
+
+    memex_timer_wheel_destroy(wheel);
+}
+
+int
+main(int nargs, char *argv[])
+{
+    set_log_level_default_str("info");
+
+    POOL *pool = create_pool();
+    bench_sort(pool);
+    bench_wheel(pool);
+    pool_cleanup();
+
+    return 0;
+}
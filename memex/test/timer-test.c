@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <testex.h>
+#include "memex.h"
+
+#define LOGEX_TAG "TIMER-TEST"
+#define LOGEX_MAIN
+#include <logex.h>
+
+struct fired_t {
+    uint64_t now;
+    uint32_t n;
+    uint32_t late;
+    uint64_t last;
+    uint32_t order;
+};
+
+static void
+count_fn(void *entry, uint64_t deadline, void *ctx)
+{
+    struct fired_t *f = (struct fired_t *)ctx;
+    uint64_t id = *(uint64_t *)entry;
+
+    // Entries carry their own deadline; nothing may fire early or late
+    if (id != deadline || deadline > f->now) {
+        f->late++;
+    }
+    if (deadline < f->last) {
+        f->order++;
+    }
+    f->last = deadline;
+    f->n++;
+}
+
+static int
+basic_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MWHEEL *wheel = memex_timer_wheel_create(pool, sizeof(uint64_t), 1000);
+    ASSERT_NOT_NULL(wheel);
+
+    uint64_t deadlines[] = {1001, 1005, 1063, 1064, 1065, 1200, 5000, 70000, 1ULL << 40};
+    int n = sizeof(deadlines) / sizeof(deadlines[0]);
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQUAL(memex_timer_schedule(wheel, deadlines[i], &deadlines[i], NULL), 0);
+    }
+    ASSERT_EQUAL(memex_timer_count(wheel), n);
+
+    struct fired_t f = {0};
+    f.now = 1000;
+    ASSERT_EQUAL(memex_timer_advance(wheel, 1000, count_fn, &f), 0);
+
+    f.now = 1064;
+    ASSERT_EQUAL(memex_timer_advance(wheel, 1064, count_fn, &f), 4);
+    f.now = 1064;
+    ASSERT_EQUAL(memex_timer_advance(wheel, 1064, count_fn, &f), 0);
+
+    f.now = 100000;
+    ASSERT_EQUAL(memex_timer_advance(wheel, 100000, count_fn, &f), 4);
+    ASSERT_EQUAL(memex_timer_count(wheel), 1);
+
+    f.now = 1ULL << 41;
+    ASSERT_EQUAL(memex_timer_advance(wheel, 1ULL << 41, count_fn, &f), 1);
+    ASSERT_EQUAL(memex_timer_count(wheel), 0);
+    ASSERT_EQUAL(f.late, 0);
+    ASSERT_EQUAL(f.order, 0);
+
+    // Already due: fires on the next advance without time moving
+    uint64_t past = 5;
+    memex_timer_schedule(wheel, past, &past, NULL);
+    ASSERT_EQUAL(memex_timer_advance(wheel, 1ULL << 41, NULL, NULL), 1);
+
+    memex_timer_wheel_destroy(wheel);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+static int
+cancel_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MWHEEL *wheel = memex_timer_wheel_create(pool, sizeof(uint64_t), 0);
+
+    uint32_t handle[1000];
+    for (uint64_t i = 0; i < 1000; i++) {
+        uint64_t d = (i * 7919) % 100000 + 1;
+        ASSERT_EQUAL(memex_timer_schedule(wheel, d, &d, &handle[i]), 0);
+    }
+
+    // Cancel every other timer
+    for (int i = 0; i < 1000; i += 2) {
+        uint64_t d;
+        ASSERT_EQUAL(memex_timer_cancel(wheel, handle[i], &d), 0);
+        ASSERT_EQUAL(d, (i * 7919ULL) % 100000 + 1);
+    }
+    ASSERT_EQUAL(memex_timer_count(wheel), 500);
+
+    // A cancelled handle is gone
+    ASSERT_NOT_EQUAL(memex_timer_cancel(wheel, handle[0], NULL), 0);
+
+    struct fired_t f = {0};
+    f.now = 100000;
+    ASSERT_EQUAL(memex_timer_advance(wheel, 100000, count_fn, &f), 500);
+    ASSERT_EQUAL(f.late, 0);
+    ASSERT_EQUAL(f.order, 0);
+
+    // Fired handles are gone too
+    ASSERT_NOT_EQUAL(memex_timer_cancel(wheel, handle[1], NULL), 0);
+
+    memex_timer_wheel_destroy(wheel);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+/*
+ *  Random deadlines, advanced in random steps, checked against a count of
+ *  how many deadlines each step passes
+ */
+static int
+random_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MWHEEL *wheel = memex_timer_wheel_create(pool, sizeof(uint64_t), 0);
+
+    int n = 100000;
+    uint64_t *d = palloc(pool, n * sizeof(uint64_t));
+    srand(7);
+    for (int i = 0; i < n; i++) {
+        d[i] = ((uint64_t)rand() << 8 | (rand() & 0xFF)) % 10000000;
+        ASSERT_EQUAL(memex_timer_schedule(wheel, d[i], &d[i], NULL), 0);
+    }
+
+    struct fired_t f = {0};
+    uint64_t now = 0;
+    uint32_t total = 0;
+    while (now < 10000000) {
+        uint64_t prev = now;
+        now += rand() % 50000;
+
+        uint32_t expect = 0;
+        for (int i = 0; i < n; i++) {
+            if (d[i] <= now && (d[i] > prev || (prev == 0 && d[i] == 0))) {
+                expect++;
+            }
+        }
+
+        f.now = now;
+        uint32_t fired = memex_timer_advance(wheel, now, count_fn, &f);
+        ASSERT_EQUAL(fired, expect);
+        total += fired;
+    }
+    ASSERT_EQUAL(total, n);
+    ASSERT_EQUAL(f.late, 0);
+    ASSERT_EQUAL(f.order, 0);
+    ASSERT_EQUAL(memex_timer_count(wheel), 0);
+
+    memex_timer_wheel_destroy(wheel);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+// Each firing re-arms itself until it has run ten times
+struct rearm_t {
+    MWHEEL *wheel;
+    uint32_t n;
+    uint32_t cancel;
+    uint32_t victim;
+};
+
+static void
+rearm_fn(void *entry, uint64_t deadline, void *ctx)
+{
+    struct rearm_t *r = (struct rearm_t *)ctx;
+    uint32_t runs = *(uint32_t *)entry + 1;
+    r->n++;
+
+    // The victim shares this timer's batch; it must not fire
+    if (r->cancel) {
+        r->cancel = 0;
+        memex_timer_cancel(r->wheel, r->victim, NULL);
+    }
+
+    if (runs < 10) {
+        memex_timer_schedule(r->wheel, deadline + 100, &runs, NULL);
+    }
+}
+
+static int
+callback_test()
+{
+    int ret = TESTEX_FAILURE;
+    POOL *pool = create_pool();
+    MWHEEL *wheel = memex_timer_wheel_create(pool, sizeof(uint32_t), 0);
+
+    struct rearm_t r = {wheel, 0, 1, 0};
+    uint32_t runs = 0;
+    memex_timer_schedule(wheel, 50, &runs, NULL);
+    memex_timer_schedule(wheel, 50, &runs, &r.victim);
+    memex_timer_schedule(wheel, 50, &runs, NULL);
+
+    memex_timer_advance(wheel, 10000, rearm_fn, &r);
+    ASSERT_EQUAL(r.n, 20);
+    ASSERT_EQUAL(memex_timer_count(wheel), 0);
+
+    memex_timer_wheel_destroy(wheel);
+    free_pool(pool);
+    ret = TESTEX_SUCCESS;
+
+testex_return:
+    return ret;
+}
+
+int
+main(int nargs, char *argv[])
+{
+    memex_timer_set_log_level("critical");
+    TESTEX_LOG_INIT("info");
+    testex_setup();
+
+    testex_add(basic_test);
+    testex_add(cancel_test);
+    testex_add(random_test);
+    testex_add(callback_test);
+
+    testex_run();
+    testex_cleanup();
+}